@@ -26,9 +26,11 @@ class Processor:
         assert 'get_metadata' in config
 
         start_time = time.time()
-        self.engine = InfiniGramMiniEngine(index_dirs=config['index_dirs'], load_to_ram=config['load_to_ram'], get_metadata=config['get_metadata'])
+        self.engine = InfiniGramMiniEngine(index_dirs=config['index_dirs'], load_to_ram=config['load_to_ram'], get_metadata=config['get_metadata'], numa_aware=config.get('numa_aware', False), load_threads=config.get('load_threads', 0))
         end_time = time.time()
         print(f'Loaded index "{config["name"]}" in {end_time - start_time:.3f} seconds')
+        for s, seconds in enumerate(self.engine.shard_load_seconds()):
+            print(f'  shard {s}: {seconds:.3f} seconds')
 
     def process(self, query_type, query, **kwargs):
         if type(query) != str:
@@ -0,0 +1,595 @@
+// g++ -std=c++17 -O3 cpp_api_server.cpp -o cpp_api_server -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread
+
+// Native counterpart of api_server.py. It speaks the same POST JSON protocol and returns the same response schema,
+// but serves all connections from one process: a single epoll loop accepts connections and hands ready sockets to a
+// pool of worker threads, and every index is backed by one Engine shared by all workers.
+
+#include "../engine/src/cpp_engine.h"
+#include "../nlohmann/json.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <charconv>
+#include <csignal>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+using json = nlohmann::json;
+
+class Processor {
+
+public:
+
+    Processor (const json& config) {
+
+        assert (config.contains("index_dirs"));
+        assert (config.contains("load_to_ram"));
+        assert (config.contains("get_metadata"));
+
+        auto start_time = steady_clock::now();
+        _engine = make_unique<Engine>(config["index_dirs"].get<vector<string>>(), config["load_to_ram"].get<bool>(), config["get_metadata"].get<bool>(), config.value("numa_aware", false), config.value("load_threads", (size_t)0));
+        auto end_time = steady_clock::now();
+        cout << "Loaded index \"" << config["name"].get<string>() << "\" in " << fixed << setprecision(3) << duration<double>(end_time - start_time).count() << " seconds" << endl;
+        auto shard_load_seconds = _engine->shard_load_seconds();
+        for (size_t s = 0; s < shard_load_seconds.size(); s++) {
+            cout << "  shard " << s << ": " << shard_load_seconds[s] << " seconds" << endl;
+        }
+
+        // Optional result cache; with "cache_path", the hot set is restored at startup and persisted periodically
+        if (config.contains("cache_mb")) {
+            _engine->enable_cache(config["cache_mb"].get<size_t>() << 20, config.value("cache_doc_kb", (size_t)64) << 10);
+            _cache_path = config.value("cache_path", string(""));
+            if (!_cache_path.empty()) {
+                cout << "Loaded " << _engine->load_cache(_cache_path) << " cached results for \"" << config["name"].get<string>() << "\"" << endl;
+                _persist_thread = thread(&Processor::_persist_loop, this, config.value("cache_save_interval", (size_t)300));
+            }
+        }
+    }
+
+    ~Processor() {
+        if (_persist_thread.joinable()) {
+            {
+                lock_guard<mutex> lock(_persist_mutex);
+                _stop = true;
+            }
+            _persist_cv.notify_all();
+            _persist_thread.join();
+        }
+    }
+
+    bool has_query_type(const string& query_type) const {
+        return query_type == "count" || query_type == "find" || query_type == "get_doc_by_rank";
+    }
+
+    json process(const string& query_type, const json& query, const json& kwargs) const {
+
+        if (!query.is_string()) {
+            return json{{"error", "query must be a string!"}};
+        }
+
+        auto start_time = steady_clock::now();
+        json result;
+        if (query_type == "count") {
+            result = count(query.get<string>(), kwargs);
+        } else if (query_type == "find") {
+            result = find(query.get<string>(), kwargs);
+        } else {
+            result = get_doc_by_rank(query.get<string>(), kwargs);
+        }
+        auto end_time = steady_clock::now();
+        result["latency"] = duration<double, milli>(end_time - start_time).count();
+
+        return result;
+    }
+
+private:
+
+    json count(const string& query, const json& kwargs) const {
+        _check_kwargs("count", kwargs, {});
+        auto result = _engine->count(query);
+        return json{{"count", result.count}};
+    }
+
+    json find(const string& query, const json& kwargs) const {
+        _check_kwargs("find", kwargs, {});
+        auto result = _engine->find(query);
+        return json{{"cnt", result.cnt}, {"segment_by_shard", result.segment_by_shard}};
+    }
+
+    json get_doc_by_rank(const string& query, const json& kwargs) const {
+        _check_kwargs("get_doc_by_rank", kwargs, {"s", "rank", "max_ctx_len"});
+        size_t s = kwargs["s"].get<size_t>();
+        size_t rank = kwargs["rank"].get<size_t>();
+        size_t max_ctx_len = kwargs["max_ctx_len"].get<size_t>();
+        if (s >= _engine->num_shards()) {
+            throw invalid_argument("s must be less than the number of shards");
+        }
+        if (rank >= _engine->shard_size(s)) {
+            throw invalid_argument("rank must be less than the size of shard s");
+        }
+
+        auto doc = _engine->get_doc_by_rank(s, rank, query.length(), max_ctx_len);
+
+        // The Python engine fails to decode a context cut in the middle of a multi-byte char; report it the same way
+        try {
+            json(doc.text).dump();
+        } catch (const json::type_error&) {
+            return json{{"error", "Failed to decode document text with UTF-8. This is likely because the context was cut off in the middle of a multi-byte char. Please try with a different max context length."}};
+        }
+
+        json result = {
+            {"doc_ix", doc.doc_ix},
+            {"doc_len", doc.doc_len},
+            {"disp_len", doc.disp_len},
+            {"needle_offset", doc.needle_offset},
+            {"metadata", doc.metadata},
+            {"text", doc.text},
+            {"dup_cnt", doc.dup_cnt},
+        };
+
+        json spans = json::array();
+        for (const auto& [span, label] : _replace(doc.text, query, "0")) {
+            spans.push_back(json::array({span, label.empty() ? json(nullptr) : json(label)}));
+        }
+        result["spans"] = spans;
+
+        return result;
+    }
+
+    vector<pair<string, string>> _replace(const string& haystack, const string& needle, const string& label) const {
+        vector<pair<string, string>> spans;
+        if (needle.empty()) {
+            spans.emplace_back(haystack, "");
+            return spans;
+        }
+        size_t start = 0;
+        while (true) {
+            size_t pos = haystack.find(needle, start);
+            if (pos == string::npos) {
+                break;
+            }
+            if (pos > start) {
+                spans.emplace_back(haystack.substr(start, pos - start), "");
+            }
+            spans.emplace_back(needle, label);
+            start = pos + needle.length();
+        }
+        if (start < haystack.length()) {
+            spans.emplace_back(haystack.substr(start), "");
+        }
+        return spans;
+    }
+
+    void _check_kwargs(const string& query_type, const json& kwargs, const vector<string>& required) const {
+        for (const auto& [key, _] : kwargs.items()) {
+            if (find_if(required.begin(), required.end(), [&](const string& k) { return k == key; }) == required.end()) {
+                throw invalid_argument(query_type + "() got an unexpected keyword argument '" + key + "'");
+            }
+        }
+        for (const auto& key : required) {
+            if (!kwargs.contains(key)) {
+                throw invalid_argument(query_type + "() missing required argument: '" + key + "'");
+            }
+        }
+    }
+
+    void _persist_loop(const size_t interval_seconds) {
+        unique_lock<mutex> lock(_persist_mutex);
+        while (!_stop) {
+            _persist_cv.wait_for(lock, seconds(interval_seconds), [this] { return _stop; });
+            // write to a temporary file first, so that a crash mid-write never leaves a truncated cache behind
+            _engine->save_cache(_cache_path + ".tmp");
+            fs::rename(_cache_path + ".tmp", _cache_path);
+        }
+    }
+
+private:
+
+    unique_ptr<Engine> _engine;
+    string _cache_path;
+    thread _persist_thread;
+    mutex _persist_mutex;
+    condition_variable _persist_cv;
+    bool _stop = false;
+};
+
+// Appends one JSON line per request to the log file from a background thread, so request handling never blocks on disk
+class RequestLogger {
+
+public:
+
+    RequestLogger (const string& path) : _fout(path, ios::app), _stop(false) {
+        assert (_fout.is_open());
+        _thread = thread(&RequestLogger::_run, this);
+    }
+
+    ~RequestLogger() {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    void log(string line) {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _lines.push_back(move(line));
+        }
+        _cv.notify_one();
+    }
+
+private:
+
+    void _run() {
+        deque<string> lines;
+        while (true) {
+            {
+                unique_lock<mutex> lock(_mutex);
+                _cv.wait(lock, [&] { return _stop || !_lines.empty(); });
+                if (_stop && _lines.empty()) {
+                    break;
+                }
+                lines.swap(_lines);
+            }
+            for (const auto& line : lines) {
+                _fout << line << '\n';
+            }
+            _fout.flush();
+            lines.clear();
+        }
+    }
+
+    ofstream _fout;
+    bool _stop;
+    deque<string> _lines;
+    mutex _mutex;
+    condition_variable _cv;
+    thread _thread;
+};
+
+struct HttpRequest {
+    string method;
+    string target;
+    string body;
+    bool keep_alive;
+};
+
+struct Connection {
+    int fd;
+    string buffer;
+};
+
+class Server {
+
+public:
+
+    Server (const map<string, unique_ptr<Processor>>& processors, RequestLogger& logger, const int port, const size_t num_threads)
+            : _processors(processors), _logger(logger), _num_threads(num_threads) {
+
+        _listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        assert (_listen_fd >= 0);
+        int one = 1;
+        setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (::bind(_listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(_listen_fd, SOMAXCONN) < 0) {
+            cerr << "Failed to listen on port " << port << ": " << strerror(errno) << endl;
+            exit(1);
+        }
+
+        _epoll_fd = epoll_create1(0);
+        assert (_epoll_fd >= 0);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = _listen_fd;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &ev);
+    }
+
+    void run() {
+
+        vector<thread> workers;
+        for (size_t t = 0; t < _num_threads; t++) {
+            workers.emplace_back(&Server::_worker_thread, this);
+        }
+
+        vector<epoll_event> events(1024);
+        while (true) {
+            int n = epoll_wait(_epoll_fd, events.data(), events.size(), -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == _listen_fd) {
+                    _accept();
+                } else {
+                    {
+                        lock_guard<mutex> lock(_queue_mutex);
+                        _ready_fds.push_back(fd);
+                    }
+                    _queue_cv.notify_one();
+                }
+            }
+        }
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+
+    void _accept() {
+        while (true) {
+            int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) {
+                break;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            {
+                lock_guard<mutex> lock(_conn_mutex);
+                _connections[fd] = make_unique<Connection>(Connection{fd, ""});
+            }
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            ev.data.fd = fd;
+            epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+
+    void _worker_thread() {
+        while (true) {
+            int fd;
+            {
+                unique_lock<mutex> lock(_queue_mutex);
+                _queue_cv.wait(lock, [&] { return !_ready_fds.empty(); });
+                fd = _ready_fds.front();
+                _ready_fds.pop_front();
+            }
+            Connection* conn;
+            {
+                lock_guard<mutex> lock(_conn_mutex);
+                auto it = _connections.find(fd);
+                if (it == _connections.end()) continue;
+                conn = it->second.get();
+            }
+            // EPOLLONESHOT guarantees that no other worker touches this connection until it is re-armed
+            if (_serve(conn)) {
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+                ev.data.fd = fd;
+                epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+            } else {
+                epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                // erase before closing: once closed, accept4 may hand out the same fd to a new connection
+                {
+                    lock_guard<mutex> lock(_conn_mutex);
+                    _connections.erase(fd);
+                }
+                close(fd);
+            }
+        }
+    }
+
+    // Returns false if the connection should be closed
+    bool _serve(Connection* conn) {
+        char buf[65536];
+        bool eof = false;
+        while (true) {
+            ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                conn->buffer.append(buf, n);
+            } else if (n == 0) {
+                eof = true;
+                break;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                return false;
+            }
+        }
+
+        while (true) {
+            HttpRequest request;
+            int status = _parse_request(conn->buffer, request);
+            if (status == 0) {
+                break; // incomplete
+            }
+            if (status < 0) {
+                _send(conn->fd, 400, json{{"error", "[Server] Malformed HTTP request"}}.dump(), false);
+                return false;
+            }
+            auto [code, body] = _handle(request);
+            if (!_send(conn->fd, code, body, request.keep_alive) || !request.keep_alive) {
+                return false;
+            }
+        }
+        return !eof;
+    }
+
+    static constexpr size_t MAX_BODY_BYTES = 64 << 20;
+
+    // Returns 1 and consumes the request from the buffer if a full request is available, 0 if more bytes are needed, -1 on error
+    int _parse_request(string& buffer, HttpRequest& request) const {
+        size_t header_end = buffer.find("\r\n\r\n");
+        if (header_end == string::npos) {
+            return buffer.size() > (1 << 20) ? -1 : 0;
+        }
+        istringstream header(buffer.substr(0, header_end));
+        string line, version;
+        getline(header, line);
+        istringstream request_line(line);
+        if (!(request_line >> request.method >> request.target >> version)) {
+            return -1;
+        }
+        request.keep_alive = (version == "HTTP/1.1");
+        size_t content_length = 0;
+        while (getline(header, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t colon = line.find(':');
+            if (colon == string::npos) continue;
+            string key = line.substr(0, colon);
+            string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t") + 1);
+            transform(key.begin(), key.end(), key.begin(), ::tolower);
+            transform(value.begin(), value.end(), value.begin(), ::tolower);
+            if (key == "content-length") {
+                auto [end, ec] = from_chars(value.data(), value.data() + value.size(), content_length);
+                if (ec != errc() || end != value.data() + value.size() || content_length > MAX_BODY_BYTES) {
+                    return -1;
+                }
+            } else if (key == "connection") {
+                request.keep_alive = (value == "keep-alive") || (request.keep_alive && value != "close");
+            }
+        }
+        size_t body_start = header_end + 4;
+        if (buffer.size() < body_start + content_length) {
+            return 0;
+        }
+        request.body = buffer.substr(body_start, content_length);
+        buffer.erase(0, body_start + content_length);
+        return 1;
+    }
+
+    pair<int, string> _handle(const HttpRequest& request) const {
+
+        if (request.method != "POST" || request.target != "/") {
+            return {405, json{{"error", "[Server] Only POST / is supported"}}.dump()};
+        }
+
+        json data = json::parse(request.body, nullptr, false);
+        if (data.is_discarded() || !data.is_object()) {
+            return {400, json{{"error", "[Server] Request body must be a JSON object"}}.dump()};
+        }
+        _logger.log(data.dump(-1, ' ', false, json::error_handler_t::replace));
+
+        string query_type, index;
+        json query;
+        for (const auto& key : {"query_type", "index", "query"}) {
+            if (!data.contains(key)) {
+                return {400, json{{"error", string("[Server] Missing required field: '") + key + "'"}}.dump()};
+            }
+        }
+        if (!data["query_type"].is_string() || !data["index"].is_string()) {
+            return {400, json{{"error", "[Server] query_type and index must be strings"}}.dump()};
+        }
+        query_type = data["query_type"].get<string>();
+        index = data["index"].get<string>();
+        query = data["query"];
+        for (const auto& key : {"query_type", "index", "query", "source", "timestamp"}) {
+            data.erase(key);
+        }
+
+        auto it = _processors.find(index);
+        if (it == _processors.end()) {
+            return {400, json{{"error", "[Server] Invalid index: " + index}}.dump()};
+        }
+        const auto& processor = *it->second;
+        if (!processor.has_query_type(query_type)) {
+            return {400, json{{"error", "[Server] Invalid query_type: " + query_type}}.dump()};
+        }
+
+        try {
+            json result = processor.process(query_type, query, data);
+            return {200, result.dump()};
+        } catch (const exception& e) {
+            cerr << "Error processing " << query_type << ": " << e.what() << endl;
+            return {500, json{{"error", string("[Server] Internal server error: ") + e.what()}}.dump()};
+        }
+    }
+
+    bool _send(const int fd, const int code, const string& body, const bool keep_alive) const {
+        static const map<int, string> reasons = {{200, "OK"}, {400, "Bad Request"}, {405, "Method Not Allowed"}, {500, "Internal Server Error"}};
+        ostringstream out;
+        out << "HTTP/1.1 " << code << " " << reasons.at(code) << "\r\n"
+            << "Content-Type: application/json\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n\r\n"
+            << body;
+        string response = out.str();
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                pollfd pfd{fd, POLLOUT, 0};
+                poll(&pfd, 1, 1000);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+
+    const map<string, unique_ptr<Processor>>& _processors;
+    RequestLogger& _logger;
+    size_t _num_threads;
+    int _listen_fd;
+    int _epoll_fd;
+
+    mutex _conn_mutex;
+    unordered_map<int, unique_ptr<Connection>> _connections;
+
+    mutex _queue_mutex;
+    condition_variable _queue_cv;
+    deque<int> _ready_fds;
+};
+
+int main(int argc, char** argv) {
+
+    int port = 5000;
+    string config_file = "api_config.json";
+    string log_path = "";
+    size_t num_threads = max(thread::hardware_concurrency(), 1u);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--PORT") port = stoi(argv[i + 1]);
+        else if (flag == "--CONFIG_FILE") config_file = argv[i + 1];
+        else if (flag == "--LOG_PATH") log_path = argv[i + 1];
+        else if (flag == "--NUM_THREADS") num_threads = stoull(argv[i + 1]);
+        else {
+            cerr << "Usage: " << argv[0] << " [--PORT 5000] [--CONFIG_FILE api_config.json] [--LOG_PATH path] [--NUM_THREADS n]" << endl;
+            return 1;
+        }
+    }
+    if (log_path.empty()) {
+        log_path = "/home/ubuntu/logs/cpp_api.log";
+    }
+
+    map<string, unique_ptr<Processor>> processors;
+    {
+        ifstream fin(config_file);
+        assert (fin.is_open());
+        json configs = json::parse(fin);
+        for (const auto& config : configs) {
+            processors[config["name"].get<string>()] = make_unique<Processor>(config);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    RequestLogger logger(log_path);
+    Server server(processors, logger, port, num_threads);
+    cout << "Serving on port " << port << " with " << num_threads << " worker threads" << endl;
+    server.run();
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+import argparse
+import http.client
+import json
+import random
+import threading
+import time
+import urllib.parse
+from concurrent.futures import ThreadPoolExecutor
+
+# Replays a fixed query workload against one or more API servers (e.g. the Flask api_server.py and the native cpp_api_server)
+# and reports QPS and latency percentiles for each of them.
+#
+# python load_test.py --index v2_pileval --targets flask=http://localhost:5000 cpp=http://localhost:5001 --concurrency 32
+
+DEFAULT_QUERIES = [
+    'natural language processing',
+    'University of Washington',
+    'the',
+    'of the',
+    'in the United States',
+    'machine learning',
+    'language model',
+    'This is a test',
+    'xqzjv kwpfl',
+]
+
+def build_workload(args):
+    if args.queries_file is not None:
+        with open(args.queries_file) as f:
+            queries = [line.rstrip('\n') for line in f if line.strip() != '']
+    else:
+        queries = DEFAULT_QUERIES
+
+    rng = random.Random(args.seed)
+    payloads = []
+    for _ in range(args.num_requests):
+        query = rng.choice(queries)
+        query_type = rng.choices(['count', 'find', 'get_doc_by_rank'], weights=[args.count_weight, args.find_weight, args.doc_weight])[0]
+        payloads.append({'index': args.index, 'query_type': query_type, 'query': query})
+    return payloads
+
+class Client:
+    def __init__(self, url):
+        parsed = urllib.parse.urlparse(url)
+        self.host = parsed.hostname
+        self.port = parsed.port or 80
+        self.local = threading.local()
+
+    def post(self, payload):
+        if not hasattr(self.local, 'conn'):
+            self.local.conn = http.client.HTTPConnection(self.host, self.port, timeout=60)
+        body = json.dumps(payload)
+        try:
+            self.local.conn.request('POST', '/', body=body, headers={'Content-Type': 'application/json'})
+            response = self.local.conn.getresponse()
+            result = json.loads(response.read())
+        except (http.client.HTTPException, ConnectionError):
+            self.local.conn.close()
+            del self.local.conn
+            raise
+        return response.status, result
+
+def resolve_doc_payload(client, payload):
+    # get_doc_by_rank needs a valid (s, rank); take the first occurrence of the query, like the web interface does
+    _, found = client.post({'index': payload['index'], 'query_type': 'find', 'query': payload['query']})
+    for s, (start, end) in enumerate(found.get('segment_by_shard', [])):
+        if start < end:
+            return {**payload, 's': s, 'rank': start, 'max_ctx_len': 100}
+    return {**payload, 'query_type': 'count'}
+
+def run_target(name, url, payloads, args):
+    client = Client(url)
+    payloads = [resolve_doc_payload(client, p) if p['query_type'] == 'get_doc_by_rank' else p for p in payloads]
+
+    for payload in payloads[:args.warmup]:
+        client.post(payload)
+
+    latencies = [None] * len(payloads)
+    errors = [0]
+    lock = threading.Lock()
+
+    def task(i):
+        start_time = time.perf_counter()
+        try:
+            status, result = client.post(payloads[i])
+            ok = status == 200 and 'error' not in result
+        except Exception:
+            ok = False
+        latencies[i] = (time.perf_counter() - start_time) * 1000
+        if not ok:
+            with lock:
+                errors[0] += 1
+
+    start_time = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=args.concurrency) as executor:
+        list(executor.map(task, range(len(payloads))))
+    elapsed = time.perf_counter() - start_time
+
+    latencies.sort()
+    def percentile(p):
+        return latencies[min(len(latencies) - 1, int(p / 100 * len(latencies)))]
+    return {
+        'target': name,
+        'url': url,
+        'requests': len(payloads),
+        'errors': errors[0],
+        'concurrency': args.concurrency,
+        'seconds': elapsed,
+        'qps': len(payloads) / elapsed,
+        'p50_ms': percentile(50),
+        'p90_ms': percentile(90),
+        'p99_ms': percentile(99),
+        'max_ms': latencies[-1],
+    }
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--index', type=str, required=True, help='Name of the index, as in the server config file.')
+    parser.add_argument('--targets', type=str, nargs='+', required=True, help='Servers to compare, each as name=url.')
+    parser.add_argument('--queries_file', type=str, default=None, help='Text file with one query per line.')
+    parser.add_argument('--num_requests', type=int, default=2000)
+    parser.add_argument('--concurrency', type=int, default=32)
+    parser.add_argument('--warmup', type=int, default=50)
+    parser.add_argument('--count_weight', type=float, default=0.6)
+    parser.add_argument('--find_weight', type=float, default=0.2)
+    parser.add_argument('--doc_weight', type=float, default=0.2)
+    parser.add_argument('--seed', type=int, default=19260817)
+    parser.add_argument('--output', type=str, default=None, help='Write the report as JSON to this path.')
+    args = parser.parse_args()
+
+    payloads = build_workload(args)
+    reports = []
+    for target in args.targets:
+        name, url = target.split('=', 1)
+        report = run_target(name, url, payloads, args)
+        print(f'{name:>10}: {report["qps"]:9.1f} QPS | p50 {report["p50_ms"]:8.2f} ms | p99 {report["p99_ms"]:8.2f} ms | errors {report["errors"]}', flush=True)
+        reports.append(report)
+
+    if args.output is not None:
+        with open(args.output, 'w') as f:
+            json.dump(reports, f, indent=4)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,254 @@
+// g++ -std=c++17 -O3 engine_bench.cpp -o engine_bench -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread
+
+// Runs fixed query workloads against an index and reports throughput and latency percentiles as JSON.
+// Workload files are produced by run_bench.py; each workload is a list of queries.
+
+#include "../engine/src/cpp_engine.h"
+#include "../nlohmann/json.hpp"
+#include <functional>
+
+using json = nlohmann::json;
+
+struct WorkloadReport {
+    size_t n;
+    size_t hits; // queries that occur in the index
+    double seconds;
+    vector<double> latencies_ms;
+
+    json to_json() const {
+        vector<double> sorted = latencies_ms;
+        sort(sorted.begin(), sorted.end());
+        auto percentile = [&](const double p) {
+            return sorted.empty() ? 0.0 : sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+        };
+        double total = accumulate(sorted.begin(), sorted.end(), 0.0);
+        return json{
+            {"n", n},
+            {"hits", hits},
+            {"seconds", seconds},
+            {"qps", seconds > 0 ? n / seconds : 0.0},
+            {"mean_ms", sorted.empty() ? 0.0 : total / sorted.size()},
+            {"p50_ms", percentile(0.50)},
+            {"p99_ms", percentile(0.99)},
+            {"max_ms", sorted.empty() ? 0.0 : sorted.back()},
+        };
+    }
+};
+
+// Rank of a deterministic occurrence of the query, so that get_doc_by_rank workloads are reproducible
+bool pick_occurrence(const FindResult& find_result, const size_t k, size_t& s, size_t& rank) {
+    if (find_result.cnt == 0) return false;
+    size_t target = k % find_result.cnt;
+    for (s = 0; s < find_result.segment_by_shard.size(); s++) {
+        auto [start, end] = find_result.segment_by_shard[s];
+        if (target < end - start) {
+            rank = start + target;
+            return true;
+        }
+        target -= end - start;
+    }
+    return false;
+}
+
+// Each workload runs one query and returns whether it occurs in the index
+template <class engine_t>
+using workload_t = function<bool(const engine_t&, const string&)>;
+
+template <class engine_t>
+map<string, workload_t<engine_t>> make_workloads() {
+    map<string, workload_t<engine_t>> workloads;
+    auto count = [](const engine_t& engine, const string& query) { return engine.count(query).count > 0; };
+    workloads["count_short"] = count;
+    workloads["count_long"] = count;
+    workloads["count_long_tokens"] = [](const engine_t& engine, const string& query) {
+        vector<uint32_t> token_ids;
+        istringstream in(query);
+        for (uint32_t id; in >> id; ) token_ids.push_back(id);
+        return engine.count_tokens(token_ids).count > 0;
+    };
+    workloads["count_miss"] = count;
+    auto matching_statistics = [](const engine_t& engine, const string& text) {
+        auto result = engine.matching_statistics(text);
+        return !result.len.empty() && *max_element(result.len.begin(), result.len.end()) > 0;
+    };
+    workloads["ms_1k"] = matching_statistics;
+    workloads["ms_10k"] = matching_statistics;
+    workloads["ms_100k"] = matching_statistics;
+    workloads["approx_k1"] = [](const engine_t& engine, const string& query) {
+        return engine.count_approx(query, 1, 100000).count > 0;
+    };
+    workloads["approx_k2"] = [](const engine_t& engine, const string& query) {
+        return engine.count_approx(query, 2, 100000).count > 0;
+    };
+    workloads["folded"] = [](const engine_t& engine, const string& query) {
+        return engine.count_folded(query, true, " \t\r\n", 100000).count > 0;
+    };
+    workloads["regex"] = [](const engine_t& engine, const string& pattern) {
+        return engine.find_regex(pattern, 100000).cnt > 0;
+    };
+    workloads["sample_occurrences"] = [](const engine_t& engine, const string& query) {
+        return !engine.sample_occurrences(query, 100, 0, 20).empty();
+    };
+    // the same number of uniformly drawn ranks, each retrieved on its own
+    workloads["sample_get_doc"] = [](const engine_t& engine, const string& query) {
+        auto find_result = engine.find(query);
+        mt19937_64 rng(0);
+        for (size_t i = 0; i < 100 && find_result.cnt > 0; i++) {
+            size_t s, rank;
+            if (pick_occurrence(find_result, uniform_int_distribution<size_t>(0, find_result.cnt - 1)(rng), s, rank)) {
+                engine.get_doc_by_rank(s, rank, query.length(), 20);
+            }
+        }
+        return find_result.cnt > 0;
+    };
+    workloads["list_docs"] = [](const engine_t& engine, const string& query) {
+        return !engine.list_docs(query, 10, 10000).doc_ixs.empty();
+    };
+    workloads["count_docs"] = [](const engine_t& engine, const string& query) {
+        return engine.count_docs(query, 10000, 1000).count > 0;
+    };
+    workloads["topk_docs"] = [](const engine_t& engine, const string& query) {
+        return !engine.topk_docs(query, 10, 10000, 1000).doc_ixs.empty();
+    };
+    // "a b" means documents containing both a and b
+    workloads["find_cnf"] = [](const engine_t& engine, const string& query) {
+        size_t space = query.find(' ');
+        return engine.find_cnf({{query.substr(0, space)}, {query.substr(space + 1)}}, 10, 10000).cnt > 0;
+    };
+    // the same queries with every occurrence located, which is what topk_docs replaces
+    workloads["topk_docs_brute"] = [](const engine_t& engine, const string& query) {
+        return !engine.topk_docs(query, 10, SIZE_MAX, 0).doc_ixs.empty();
+    };
+    // per-source breakdown (run_bench.py indexes with --doc_attrs metadata.meta.pile_set_name), sampled and exact
+    workloads["count_by_attribute"] = [](const engine_t& engine, const string& query) {
+        return engine.count_by_attribute(query, "metadata.meta.pile_set_name", 10000, 1000).cnt > 0;
+    };
+    workloads["count_by_attribute_exact"] = [](const engine_t& engine, const string& query) {
+        return engine.count_by_attribute(query, "metadata.meta.pile_set_name", SIZE_MAX, 2).cnt > 0;
+    };
+    workloads["find_get_doc"] = [](const engine_t& engine, const string& query) {
+        auto find_result = engine.find(query);
+        size_t s, rank;
+        if (pick_occurrence(find_result, 0, s, rank)) {
+            engine.get_doc_by_rank(s, rank, query.length(), 100);
+        }
+        return find_result.cnt > 0;
+    };
+    workloads["metadata_heavy"] = [](const engine_t& engine, const string& query) {
+        auto find_result = engine.find(query);
+        for (size_t k = 0; k < 10; k++) {
+            size_t s, rank;
+            if (pick_occurrence(find_result, k * 7919, s, rank)) {
+                engine.get_doc_by_rank(s, rank, query.length(), 0);
+            }
+        }
+        return find_result.cnt > 0;
+    };
+    return workloads;
+}
+
+template <class engine_t>
+int run(const vector<string>& index_dirs, const string& mode, const json& workload_spec, const string& output_path, const size_t repeat, const bool use_kgram_table, const bool interleaved_search, const bool numa_aware, const size_t load_threads) {
+    auto load_start = steady_clock::now();
+    engine_t engine(index_dirs, mode == "ram", true, numa_aware, load_threads);
+    double load_seconds = duration<double>(steady_clock::now() - load_start).count();
+    engine.set_use_kgram_table(use_kgram_table);
+    engine.set_interleaved_search(interleaved_search);
+
+    auto workloads = make_workloads<engine_t>();
+    json report = {
+        {"mode", mode},
+        {"kgram", use_kgram_table},
+        {"search", interleaved_search ? "interleaved" : "threads"},
+        {"numa", numa_aware},
+        {"shard_nodes", engine.shard_nodes()},
+        {"index_dirs", index_dirs},
+        {"load_seconds", load_seconds},
+        {"load_threads", load_threads},
+        {"shard_load_seconds", engine.shard_load_seconds()},
+        {"workloads", json::object()},
+    };
+    for (const auto& [name, queries] : workload_spec.items()) {
+        auto it = workloads.find(name);
+        if (it == workloads.end()) {
+            cerr << "Skipping unknown workload: " << name << endl;
+            continue;
+        }
+        WorkloadReport workload_report{0, 0, 0.0, {}};
+        auto workload_start = steady_clock::now();
+        for (size_t r = 0; r < repeat; r++) {
+            for (const auto& query : queries) {
+                auto start_time = steady_clock::now();
+                workload_report.hits += it->second(engine, query.template get<string>());
+                workload_report.latencies_ms.push_back(duration<double, milli>(steady_clock::now() - start_time).count());
+                workload_report.n++;
+            }
+        }
+        workload_report.seconds = duration<double>(steady_clock::now() - workload_start).count();
+        report["workloads"][name] = workload_report.to_json();
+        cerr << mode << " " << name << ": " << report["workloads"][name].dump() << endl;
+    }
+
+    if (output_path.empty()) {
+        cout << report.dump(4) << endl;
+    } else {
+        ofstream fout(output_path);
+        fout << report.dump(4) << endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    vector<string> index_dirs;
+    string mode = "mmap";
+    string workload_path = "";
+    string output_path = "";
+    size_t repeat = 1;
+    bool use_kgram_table = true;
+    string search = "threads";
+    bool numa_aware = false;
+    size_t load_threads = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--index_dir") index_dirs.push_back(argv[i + 1]);
+        else if (flag == "--mode") mode = argv[i + 1];
+        else if (flag == "--workload") workload_path = argv[i + 1];
+        else if (flag == "--output") output_path = argv[i + 1];
+        else if (flag == "--repeat") repeat = stoull(argv[i + 1]);
+        else if (flag == "--kgram") use_kgram_table = string(argv[i + 1]) == "on";
+        else if (flag == "--search") search = argv[i + 1];
+        else if (flag == "--numa") numa_aware = string(argv[i + 1]) == "on";
+        else if (flag == "--load_threads") load_threads = stoull(argv[i + 1]);
+        else {
+            cerr << "Unknown flag: " << flag << endl;
+            return 1;
+        }
+    }
+    if (index_dirs.empty() || workload_path.empty() || (mode != "ram" && mode != "mmap") || (search != "threads" && search != "interleaved")) {
+        cerr << "Usage: " << argv[0] << " --index_dir DIR [--index_dir DIR ...] --workload FILE [--mode ram|mmap] [--repeat N] [--kgram on|off] [--search threads|interleaved] [--numa on|off] [--load_threads N] [--output FILE]" << endl;
+        return 1;
+    }
+
+    json workload_spec;
+    {
+        ifstream fin(workload_path);
+        assert (fin.is_open());
+        workload_spec = json::parse(fin);
+    }
+
+    // an index file may also be there only as its page-aligned container (src/convert_paged.cpp)
+    auto exists = [&](const string& name) {
+        return ifstream(index_dirs[0] + "/" + name).good() || ifstream(index_dirs[0] + "/" + name + "p").good();
+    };
+    // indexes built with --index_type rlmn have data.rl.fm9 instead of data.fm9
+    if (exists("data.rl.fm9")) {
+        return run<RLEngine>(index_dirs, mode, workload_spec, output_path, repeat, use_kgram_table, search == "interleaved", numa_aware, load_threads);
+    }
+    // src/convert_rrr_il.cpp adds data.il.fm9 next to data.fm9
+    if (exists("data.il.fm9")) {
+        return run<ILEngine>(index_dirs, mode, workload_spec, output_path, repeat, use_kgram_table, search == "interleaved", numa_aware, load_threads);
+    }
+    return run<Engine>(index_dirs, mode, workload_spec, output_path, repeat, use_kgram_table, search == "interleaved", numa_aware, load_threads);
+}
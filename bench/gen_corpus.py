@@ -0,0 +1,101 @@
+import argparse
+import json
+import numpy as np
+import os
+
+# Generates a deterministic synthetic jsonl corpus whose word frequencies follow a Zipfian distribution.
+# The same (--seed, --size_mb, --vocab_size, --zipf_s, --dup_rate) always produces byte-identical files.
+
+SOURCES = ['Pile-CC', 'ArXiv', 'Github', 'PubMed Central', 'Wikipedia (en)', 'StackExchange', 'FreeLaw', 'USPTO Backgrounds']
+LETTERS = np.array(list('etaoinshrdlcumwfgypbvkjxqz'))
+
+def make_vocab(rng, vocab_size):
+    vocab = set()
+    while len(vocab) < vocab_size:
+        length = int(rng.integers(1, 11))
+        vocab.add(''.join(rng.choice(LETTERS, size=length)))
+    vocab = sorted(vocab)
+    rng.shuffle(vocab)
+    return vocab
+
+def zipf_cdf(vocab_size, s):
+    probs = 1.0 / np.arange(1, vocab_size + 1) ** s
+    cdf = np.cumsum(probs)
+    return cdf / cdf[-1]
+
+def make_doc(rng, vocab, cdf, mean_words):
+    num_words = max(1, int(rng.lognormal(np.log(mean_words), 0.8)))
+    ranks = np.minimum(np.searchsorted(cdf, rng.random(num_words)), len(vocab) - 1)
+    words = [vocab[i] for i in ranks]
+    # break into sentences and paragraphs, so that the corpus has punctuation, capitals and newlines
+    out = []
+    sentence_len = 0
+    for w in words:
+        if sentence_len == 0:
+            w = w.capitalize()
+        out.append(w)
+        sentence_len += 1
+        if sentence_len >= 5 and rng.random() < 0.12:
+            out[-1] += '.' if rng.random() < 0.9 else '?'
+            if rng.random() < 0.2:
+                out[-1] += '\n'
+            sentence_len = 0
+    return ' '.join(out).replace('\n ', '\n')
+
+def make_near_dup(rng, doc, vocab, cdf, edit_rate):
+    # a copy of an earlier document with a few words replaced, like boilerplate or a re-crawled page
+    words = doc.split(' ')
+    for i in np.flatnonzero(rng.random(len(words)) < edit_rate):
+        words[i] = vocab[min(int(np.searchsorted(cdf, rng.random())), len(vocab) - 1)]
+    return ' '.join(words)
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--output_dir', type=str, required=True)
+    parser.add_argument('--size_mb', type=float, default=64, help='Approximate total size of document text, in MiB.')
+    parser.add_argument('--vocab_size', type=int, default=50000)
+    parser.add_argument('--zipf_s', type=float, default=1.1, help='Zipf exponent of word frequencies.')
+    parser.add_argument('--mean_words', type=int, default=300, help='Median number of words per document.')
+    parser.add_argument('--docs_per_file', type=int, default=20000)
+    parser.add_argument('--dup_rate', type=float, default=0.0, help='Fraction of documents that are near-duplicates of an earlier one.')
+    parser.add_argument('--dup_edit_rate', type=float, default=0.01, help='Fraction of words replaced in a near-duplicate.')
+    parser.add_argument('--seed', type=int, default=19260817)
+    args = parser.parse_args()
+    assert 0.0 <= args.dup_rate < 1.0
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    rng = np.random.default_rng(args.seed)
+    vocab = make_vocab(rng, args.vocab_size)
+    cdf = zipf_cdf(args.vocab_size, args.zipf_s)
+
+    # not *.json*, so that indexing.py does not pick it up as part of the corpus
+    with open(os.path.join(args.output_dir, 'vocab.txt'), 'w') as f:
+        f.write('\n'.join(vocab) + '\n')
+
+    target_bytes = int(args.size_mb * 1024**2)
+    total_bytes = 0
+    filenum = 0
+    doc_ix = 0
+    texts = []
+    while total_bytes < target_bytes:
+        with open(os.path.join(args.output_dir, f'{filenum:04d}.jsonl'), 'w') as f:
+            for _ in range(args.docs_per_file):
+                # only draw from rng when duplicating, so that corpora without duplicates stay the same
+                if args.dup_rate > 0 and texts and rng.random() < args.dup_rate:
+                    text = make_near_dup(rng, texts[int(rng.integers(len(texts)))], vocab, cdf, args.dup_edit_rate)
+                else:
+                    text = make_doc(rng, vocab, cdf, args.mean_words)
+                    if args.dup_rate > 0:
+                        texts.append(text)
+                meta = {'pile_set_name': SOURCES[int(rng.integers(len(SOURCES)))], 'doc_id': doc_ix}
+                f.write(json.dumps({'text': text, 'meta': meta}) + '\n')
+                total_bytes += len(text.encode('utf-8'))
+                doc_ix += 1
+                if total_bytes >= target_bytes:
+                    break
+        filenum += 1
+
+    print(f'Generated {doc_ix} documents ({total_bytes / 1024**2:.1f} MiB of text) in {filenum} files', flush=True)
+
+if __name__ == '__main__':
+    main()
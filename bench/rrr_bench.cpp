@@ -0,0 +1,106 @@
+// g++ -std=c++17 -O3 rrr_bench.cpp -o rrr_bench -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64
+
+// Rank microbenchmark of the two rrr layouts on a real index: data.fm9, whose wavelet tree uses rrr_vector<127>, and
+// data.il.fm9 (src/convert_rrr_il.cpp), whose wavelet tree uses rrr_vector_il<127> over the same bits. It times rank_1
+// at uniformly random positions of the wavelet tree bit vector, and backward search (count) of patterns extracted
+// from the index, each in RAM and mmap mode. Every measurement runs twice and the second, warm, run is reported.
+
+#include <sdsl/suffix_arrays.hpp>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+typedef csa_wt<wt_huff<rrr_vector<127> >, 32, 64> index_t;
+typedef csa_wt<wt_huff<rrr_vector_il<127> >, 32, 64> il_index_t;
+
+// the indexes are not freed: the vectors of an mmapped index cannot be
+template <class t_index>
+const t_index* load(const string& index_file, const string& mode) {
+    auto index = new t_index();
+    if (mode == "ram" ? !load_from_file(*index, index_file) : !load_from_file_(*index, index_file)) {
+        cerr << "Failed to load " << index_file << endl;
+        exit(1);
+    }
+    return index;
+}
+
+template <class t_index>
+void bench(const string& name, const string& index_file, const string& mode,
+           const vector<uint64_t>& positions, const vector<string>& patterns) {
+    const t_index* index = load<t_index>(index_file, mode);
+    typedef typename t_index::wavelet_tree_type::bit_vector_type bit_vector_type;
+    const bit_vector_type& bv = index->wavelet_tree.bv;
+    typename bit_vector_type::rank_1_type rank(&bv);
+
+    double rank_ns = 0, search_ns = 0;
+    uint64_t checksum = 0, chars = 0;
+    for (int run = 0; run < 2; run++) {
+        checksum = 0;
+        auto start_time = steady_clock::now();
+        for (auto i : positions) {
+            checksum += rank(i % (bv.size() + 1));
+        }
+        rank_ns = duration<double, nano>(steady_clock::now() - start_time).count() / positions.size();
+
+        chars = 0;
+        start_time = steady_clock::now();
+        for (auto& pattern : patterns) {
+            checksum += sdsl::count(*index, pattern.begin(), pattern.end());
+            chars += pattern.size();
+        }
+        search_ns = duration<double, nano>(steady_clock::now() - start_time).count() / chars;
+    }
+    cout << left << setw(6) << mode << setw(26) << name << right << fixed << setprecision(2)
+         << setw(12) << size_in_bytes(bv) / (double)(1 << 20) << setw(12) << rank_ns << setw(16) << search_ns
+         << setw(22) << checksum << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " [index directory] [ranks = 1000000] [patterns = 10000] [pattern length = 32]" << endl;
+        return 1;
+    }
+    string index_dir = argv[1];
+    uint64_t num_ranks = argc > 2 ? stoull(argv[2]) : 1000000;
+    uint64_t num_patterns = argc > 3 ? stoull(argv[3]) : 10000;
+    uint64_t pattern_len = argc > 4 ? stoull(argv[4]) : 32;
+    string index_file = index_dir + "/data.fm9", il_index_file = index_dir + "/data.il.fm9";
+    if (!ifstream(il_index_file).good()) {
+        cerr << il_index_file << " does not exist; run src/convert_rrr_il on " << index_dir << " first" << endl;
+        return 1;
+    }
+
+    mt19937_64 rng(19);
+    vector<uint64_t> positions(num_ranks);
+    for (auto& i : positions) {
+        i = rng();
+    }
+    vector<string> patterns;
+    {
+        index_t index;
+        load_from_file(index, index_file);
+        if (index.size() <= pattern_len + 1) {
+            cerr << "The index is shorter than a pattern" << endl;
+            return 1;
+        }
+        for (uint64_t p = 0; p < num_patterns; p++) {
+            uint64_t start = rng() % (index.size() - 1 - pattern_len);
+            patterns.push_back(sdsl::extract(index, start, start + pattern_len - 1));
+        }
+    }
+
+    // the checksums (ranks plus counts) of both layouts have to agree
+    cout << left << setw(6) << "mode" << setw(26) << "bit vector" << right << setw(12) << "bv MiB"
+         << setw(12) << "rank ns" << setw(16) << "count ns/char" << setw(22) << "checksum" << endl;
+    for (string mode : {"ram", "mmap"}) {
+        bench<index_t>("rrr_vector<127>", index_file, mode, positions, patterns);
+        bench<il_index_t>("rrr_vector_il<127>", il_index_file, mode, positions, patterns);
+    }
+    return 0;
+}
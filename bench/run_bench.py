@@ -0,0 +1,267 @@
+import argparse
+import glob
+import json
+import multiprocessing as mp
+import numpy as np
+import os
+import resource
+import subprocess
+import sys
+import time
+
+# End-to-end reproducible benchmark:
+#   1. generate a deterministic synthetic corpus (gen_corpus.py)
+#   2. index it with the regular pipeline (src/indexing.py)
+#   3. derive fixed query workloads from the corpus
+#   4. run engine_bench in RAM and mmap modes and write a JSON report that can be compared across commits
+#   5. optionally, build a k-gram table (data.kgram) for each --kgram_ks and rerun, to weigh table size against latency
+#   6. optionally (--meta_store), index the corpus again with a block-compressed metadata store instead of meta.fm9 and rerun
+#   7. optionally (--rlmn), index the corpus again with a run-length encoded BWT (data.rl.fm9) and rerun
+#   8. optionally (--shard_counts), rerun the count workloads with the index loaded as several shards, searched by one
+#      thread per shard and by the single-threaded interleaved kernel
+#   9. optionally (--numa), rerun the count and find + get_doc_by_rank workloads with two shards per NUMA node, placed by
+#      the OS and NUMA-aware (each shard's memory and threads on one node), to measure the cost of crossing sockets
+# With --tokenizer, every index also gets a token index (data.tok.fm9), and count_long is also run on token ids.
+#
+# python run_bench.py --work_dir /tmp/infini-gram-mini-bench --size_mb 64 --mem 16 --output bench.json
+
+BENCH_DIR = os.path.dirname(os.path.realpath(__file__))
+REPO_DIR = os.path.dirname(BENCH_DIR)
+COMPILE_CMD = 'g++ -std=c++17 -O3 engine_bench.cpp -o engine_bench -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread'
+KGRAM_COMPILE_CMD = 'g++ -std=c++17 -O3 -I../sdsl/include -L../sdsl/lib kgram_table.cpp -o kgram_table -lsdsl -ldivsufsort -ldivsufsort64'
+
+def generate_corpus(args, corpus_dir):
+    params = {'size_mb': args.size_mb, 'vocab_size': args.vocab_size, 'zipf_s': args.zipf_s, 'seed': args.seed}
+    if args.dup_rate > 0:
+        params['dup_rate'] = args.dup_rate
+    params_path = os.path.join(args.work_dir, 'corpus_params.json')
+    if os.path.exists(params_path):
+        with open(params_path) as f:
+            if json.load(f) == params:
+                print('Corpus: Skipped. Already generated with the same parameters.', flush=True)
+                return params
+        raise RuntimeError(f'{corpus_dir} holds a corpus generated with different parameters; use a fresh --work_dir')
+
+    print('Corpus: Generating ...', flush=True)
+    subprocess.run([sys.executable, os.path.join(BENCH_DIR, 'gen_corpus.py'), '--output_dir', corpus_dir,
+                    '--size_mb', str(args.size_mb), '--vocab_size', str(args.vocab_size), '--zipf_s', str(args.zipf_s), '--seed', str(args.seed),
+                    '--dup_rate', str(args.dup_rate)], check=True)
+    with open(params_path, 'w') as f:
+        json.dump(params, f)
+    return params
+
+def build_index(args, corpus_dir, index_dir, extra_args=[], data_file='data.fm9'):
+    if os.path.exists(os.path.join(index_dir, data_file)):
+        print(f'Index: Skipped. {data_file} already exists.', flush=True)
+        return None
+
+    print('Index: Building ...', flush=True)
+    start_time = time.time()
+    subprocess.run([sys.executable, os.path.join(REPO_DIR, 'src', 'indexing.py'), '--data_dir', corpus_dir, '--save_dir', index_dir,
+                    '--mem', str(args.mem), '--cpus', str(args.cpus), '--ulimit', str(args.ulimit), '--doc_attrs', 'metadata.meta.pile_set_name'] + (['--tokenizer', args.tokenizer] if args.tokenizer else []) + extra_args, check=True)
+    if not os.path.exists(os.path.join(index_dir, data_file)):
+        raise RuntimeError(f'Indexing finished without producing {data_file}; check that src/cpp_indexing runs on this machine')
+    return time.time() - start_time
+
+def make_workloads(args, corpus_dir):
+    rng = np.random.default_rng(args.seed)
+    docs = []
+    for path in sorted(glob.glob(os.path.join(corpus_dir, '*.jsonl'))):
+        with open(path) as f:
+            docs += [json.loads(line)['text'] for line in f]
+    with open(os.path.join(corpus_dir, 'vocab.txt')) as f:
+        vocab = f.read().split()
+
+    def span(min_words, max_words):
+        while True:
+            words = docs[int(rng.integers(len(docs)))].split(' ')
+            n = int(rng.integers(min_words, max_words + 1))
+            if len(words) >= n:
+                start = int(rng.integers(len(words) - n + 1))
+                return ' '.join(words[start:start+n])
+
+    def miss():
+        # vocab words only contain lowercase letters, so a digit guarantees the query never occurs
+        words = span(3, 8).split(' ')
+        words[int(rng.integers(len(words)))] = f'{vocab[int(rng.integers(len(vocab)))]}{int(rng.integers(10))}'
+        return ' '.join(words)
+
+    def regex():
+        # a corpus span with one word replaced by a class run and another by wildcards, ending in a literal word
+        words = span(3, 5).split(' ')
+        i, j = rng.choice(len(words) - 1, size=2, replace=False)
+        words[i] = '[a-z]+'
+        words[j] = '.' * len(words[j])
+        return ' '.join(words)
+
+    def contaminated_text(num_bytes):
+        # alternate copied corpus spans with unrelated vocab words, like a benchmark item that is partially leaked
+        parts, size = [], 0
+        while size < num_bytes:
+            if rng.random() < 0.5:
+                part = span(5, 40)
+            else:
+                part = ' '.join(vocab[i] for i in rng.integers(0, len(vocab), size=int(rng.integers(5, 40))))
+            parts.append(part)
+            size += len(part) + 1
+        return ' '.join(parts)[:num_bytes]
+
+    n = args.queries_per_workload
+    topk_queries = [span(1, 2) for _ in range(max(1, n // 10))]
+    approx_queries = [span(2, 4) for _ in range(max(1, n // 10))]
+    sample_queries = [span(1, 1) for _ in range(max(1, n // 10))]
+    attribute_queries = [span(1, 2) for _ in range(max(1, n // 10))]
+    workloads = {
+        'count_short': [span(1, 2) for _ in range(n)],
+        'count_long': [span(12, 30) for _ in range(n)],
+        'count_miss': [miss() for _ in range(n)],
+        'find_get_doc': [span(2, 4) for _ in range(n)],
+        'approx_k1': approx_queries,
+        'approx_k2': approx_queries,
+        'folded': [span(2, 4).title() for _ in range(n)],
+        'regex': [regex() for _ in range(max(1, n // 10))],
+        'sample_occurrences': sample_queries,
+        'sample_get_doc': sample_queries,
+        'list_docs': [span(1, 3) for _ in range(n)],
+        'count_docs': [span(1, 3) for _ in range(max(1, n // 10))],
+        'find_cnf': [vocab[int(rng.integers(1000))] + ' ' + vocab[int(rng.integers(1000))] for _ in range(max(1, n // 10))],
+        'topk_docs': topk_queries,
+        'topk_docs_brute': topk_queries,
+        'count_by_attribute': attribute_queries,
+        'count_by_attribute_exact': attribute_queries,
+        'metadata_heavy': [vocab[i] for i in rng.integers(0, 100, size=max(1, n // 10))],
+        'ms_1k': [contaminated_text(1 << 10) for _ in range(max(1, n // 50))],
+        'ms_10k': [contaminated_text(10 << 10) for _ in range(max(1, n // 200))],
+        'ms_100k': [contaminated_text(100 << 10) for _ in range(max(1, n // 1000))],
+    }
+    if args.tokenizer:
+        # the same spans as count_long, as space-separated token ids. Tokenized on their own, the first and last tokens
+        # usually differ from those in the corpus (e.g. without the leading space), so they are dropped
+        from transformers import AutoTokenizer
+        tokenizer = AutoTokenizer.from_pretrained(args.tokenizer)
+        workloads['count_long_tokens'] = [' '.join(map(str, tokenizer(query, add_special_tokens=False)['input_ids'][1:-1])) for query in workloads['count_long']]
+    return workloads
+
+def git_commit():
+    try:
+        return subprocess.run(['git', 'rev-parse', 'HEAD'], cwd=REPO_DIR, capture_output=True, text=True, check=True).stdout.strip()
+    except (subprocess.CalledProcessError, FileNotFoundError):
+        return None
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--work_dir', type=str, required=True, help='Directory for the corpus, index and workloads. Must be absolute path.')
+    parser.add_argument('--output', type=str, default=None, help='Where to write the JSON report. Defaults to <work_dir>/report.json.')
+    parser.add_argument('--size_mb', type=float, default=64)
+    parser.add_argument('--vocab_size', type=int, default=50000)
+    parser.add_argument('--zipf_s', type=float, default=1.1)
+    parser.add_argument('--seed', type=int, default=19260817)
+    parser.add_argument('--dup_rate', type=float, default=0.0, help='Fraction of near-duplicate documents in the corpus.')
+    parser.add_argument('--queries_per_workload', type=int, default=1000)
+    parser.add_argument('--repeat', type=int, default=1)
+    parser.add_argument('--modes', type=str, nargs='+', default=['ram', 'mmap'], choices=['ram', 'mmap'])
+    parser.add_argument('--kgram_ks', type=int, nargs='*', default=[], help='Also benchmark with a k-gram table for each of these k.')
+    parser.add_argument('--meta_store', default=False, action='store_true', help='Also benchmark an index whose metadata is in meta.store rather than meta.fm9.')
+    parser.add_argument('--rlmn', default=False, action='store_true', help='Also benchmark an index with a run-length encoded BWT (data.rl.fm9).')
+    parser.add_argument('--shard_counts', type=int, nargs='*', default=[], help='Also run the count workloads with the index loaded as each of these numbers of shards, with threaded and interleaved search.')
+    parser.add_argument('--numa', default=False, action='store_true', help='Also run the count and find_get_doc workloads with two shards per NUMA node, with and without NUMA-aware placement.')
+    parser.add_argument('--tokenizer', type=str, default=None, help='Also build token indexes with this Hugging Face tokenizer and benchmark counting token ids.')
+    parser.add_argument('--cpus', type=int, default=mp.cpu_count())
+    parser.add_argument('--mem', type=int, required=True, help='Amount of memory in GiB available to the indexing program.')
+    parser.add_argument('--ulimit', type=int, default=resource.getrlimit(resource.RLIMIT_NOFILE)[1])
+    args = parser.parse_args()
+
+    corpus_dir = os.path.join(args.work_dir, 'corpus')
+    index_dir = os.path.join(args.work_dir, 'index')
+    workload_path = os.path.join(args.work_dir, 'workloads.json')
+    os.makedirs(args.work_dir, exist_ok=True)
+
+    corpus_params = generate_corpus(args, corpus_dir)
+    index_seconds = build_index(args, corpus_dir, index_dir)
+    with open(workload_path, 'w') as f:
+        json.dump(make_workloads(args, corpus_dir), f)
+
+    if not os.path.exists(os.path.join(BENCH_DIR, 'engine_bench')):
+        print('Compiling engine_bench ...', flush=True)
+        subprocess.run(COMPILE_CMD, shell=True, cwd=BENCH_DIR, check=True)
+
+    report = {
+        'commit': git_commit(),
+        'corpus': corpus_params,
+        'index_seconds': index_seconds,
+        'index_bytes': sum(os.path.getsize(p) for p in glob.glob(os.path.join(index_dir, '*')) if not p.endswith('.html')),
+        'runs': [],
+    }
+
+    def meta_bytes(index_dir):
+        return sum(os.path.getsize(os.path.join(index_dir, name)) for name in ['meta.fm9', 'meta_offset', 'meta.store'] if os.path.exists(os.path.join(index_dir, name)))
+
+    def data_bytes(index_dir):
+        return sum(os.path.getsize(os.path.join(index_dir, name)) for name in ['data.fm9', 'data.rl.fm9'] if os.path.exists(os.path.join(index_dir, name)))
+
+    def run_modes(kgram_k, index_dir=index_dir, meta_store=False, index_type='huff', shards=1, search='threads', workload_path=workload_path, numa=False):
+        for mode in args.modes:
+            proc = subprocess.run([os.path.join(BENCH_DIR, 'engine_bench'), *(['--index_dir', index_dir] * shards), '--mode', mode, '--workload', workload_path,
+                                   '--repeat', str(args.repeat), '--kgram', 'on' if kgram_k else 'off', '--search', search, '--numa', 'on' if numa else 'off'], capture_output=True, text=True, check=True)
+            result = json.loads(proc.stdout)
+            result['kgram_k'] = kgram_k
+            result['kgram_bytes'] = os.path.getsize(os.path.join(index_dir, 'data.kgram')) if kgram_k else 0
+            result['meta_store'] = meta_store
+            result['meta_bytes'] = meta_bytes(index_dir)
+            result['index_type'] = index_type
+            result['data_bytes'] = data_bytes(index_dir)
+            result['shards'] = shards
+            result['numa'] = numa
+            report['runs'].append(result)
+
+    run_modes(0)
+    if args.kgram_ks:
+        src_dir = os.path.join(REPO_DIR, 'src')
+        if not os.path.exists(os.path.join(src_dir, 'kgram_table')):
+            print('Compiling kgram_table ...', flush=True)
+            subprocess.run(KGRAM_COMPILE_CMD, shell=True, cwd=src_dir, check=True)
+        for k in args.kgram_ks:
+            subprocess.run([os.path.join(src_dir, 'kgram_table'), index_dir, str(k)], check=True)
+            run_modes(k)
+    if args.meta_store:
+        meta_store_index_dir = os.path.join(args.work_dir, 'index_meta_store')
+        build_index(args, corpus_dir, meta_store_index_dir, ['--meta_store'])
+        run_modes(0, meta_store_index_dir, True)
+    if args.rlmn:
+        rlmn_index_dir = os.path.join(args.work_dir, 'index_rlmn')
+        build_index(args, corpus_dir, rlmn_index_dir, ['--index_type', 'rlmn'], 'data.rl.fm9')
+        run_modes(0, rlmn_index_dir, index_type='rlmn')
+    def subset_workloads(name, names):
+        subset_workload_path = os.path.join(args.work_dir, name)
+        with open(workload_path) as f:
+            workloads = json.load(f)
+        with open(subset_workload_path, 'w') as f:
+            json.dump({name: queries for name, queries in workloads.items() if name in names}, f)
+        return subset_workload_path
+
+    if args.shard_counts:
+        # the same index directory is loaded once per shard
+        count_workload_path = subset_workloads('count_workloads.json', ['count_short', 'count_long', 'count_miss'])
+        for shards in args.shard_counts:
+            for search in ['threads', 'interleaved']:
+                run_modes(0, shards=shards, search=search, workload_path=count_workload_path)
+    if args.numa:
+        num_nodes = len(glob.glob('/sys/devices/system/node/node[0-9]*'))
+        if num_nodes < 2:
+            print(f'Only {max(num_nodes, 1)} NUMA node: NUMA-aware placement changes nothing on this machine', flush=True)
+        numa_workload_path = subset_workloads('numa_workloads.json', ['count_short', 'count_long', 'count_miss', 'find_get_doc'])
+        for numa in [False, True]:
+            run_modes(0, shards=2 * max(num_nodes, 1), workload_path=numa_workload_path, numa=numa)
+
+    output = args.output or os.path.join(args.work_dir, 'report.json')
+    with open(output, 'w') as f:
+        json.dump(report, f, indent=4)
+
+    for run in report['runs']:
+        for name, w in run['workloads'].items():
+            meta = 'meta.store' if run['meta_store'] else 'meta.fm9'
+            print(f'{run["mode"]:>5} {run["index_type"]} ({run["data_bytes"] / 1048576:.1f} MiB) x{run["shards"]} {run["search"]:>11}{" numa" if run["numa"] else ""} k={run["kgram_k"]} ({run["kgram_bytes"] / 1048576:.1f} MiB) {meta} ({run["meta_bytes"] / 1048576:.2f} MiB) {name:>15}: {w["qps"]:10.1f} QPS | p50 {w["p50_ms"]:8.3f} ms | p99 {w["p99_ms"]:8.3f} ms', flush=True)
+    print(f'Report written to {output}', flush=True)
+
+if __name__ == '__main__':
+    main()
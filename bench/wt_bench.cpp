@@ -0,0 +1,126 @@
+// g++ -std=c++17 -O3 wt_bench.cpp -o wt_bench -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64
+
+// Compares wavelet trees as the BWT of a byte FM-index (csa_wt<t_wt, 32, 64>, as in data.fm9) on one text file:
+// the size of the wavelet tree and of the whole index, backward search time per pattern character (count of
+// patterns sampled from the text), and extract throughput (random 4 KiB substrings).
+//
+// wt_huff<rrr_vector<127>> is what data.fm9 uses; wt_kary<4> and wt_kary<2> resolve 4 and 2 bits of the symbol per
+// level, so each backward search step takes 2 or 4 dependent ranks instead of one per Huffman level.
+
+#include <sdsl/suffix_arrays.hpp>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+struct Report {
+    string name;
+    uint64_t wt_bytes;
+    uint64_t index_bytes;
+    double construct_seconds;
+    double search_ns_per_char;
+    double extract_mb_per_second;
+    uint64_t total_count; // sum of the pattern counts, to check that all indexes agree
+};
+
+template <class t_wt>
+Report run(const string& name, cache_config& config, const string& text_file, const string& text,
+           const vector<pair<uint64_t, uint64_t>>& patterns, const vector<uint64_t>& extract_starts,
+           const uint64_t extract_len) {
+    typedef csa_wt<t_wt, 32, 64> index_t;
+    Report report;
+    report.name = name;
+
+    index_t index;
+    auto start_time = steady_clock::now();
+    construct(index, text_file, config, 1); // the SA and BWT are cached in config after the first index
+    report.construct_seconds = duration<double>(steady_clock::now() - start_time).count();
+    report.wt_bytes = size_in_bytes(index.wavelet_tree);
+    report.index_bytes = size_in_bytes(index);
+
+    uint64_t chars = 0, total_count = 0;
+    start_time = steady_clock::now();
+    for (auto [start, len] : patterns) {
+        total_count += sdsl::count(index, text.begin() + start, text.begin() + start + len);
+        chars += len;
+    }
+    report.search_ns_per_char = duration<double, nano>(steady_clock::now() - start_time).count() / chars;
+    report.total_count = total_count;
+
+    uint64_t extracted = 0;
+    start_time = steady_clock::now();
+    for (auto start : extract_starts) {
+        extracted += sdsl::extract(index, start, start + extract_len - 1).size();
+    }
+    report.extract_mb_per_second = extracted / duration<double>(steady_clock::now() - start_time).count() / (1 << 20);
+    return report;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " [text file] [work directory] [pattern length = 32] [patterns = 100000] [extracts = 1000]" << endl;
+        return 1;
+    }
+    string text_file = argv[1], work_dir = argv[2];
+    uint64_t pattern_len = argc > 3 ? stoull(argv[3]) : 32;
+    uint64_t num_patterns = argc > 4 ? stoull(argv[4]) : 100000;
+    uint64_t num_extracts = argc > 5 ? stoull(argv[5]) : 1000;
+    const uint64_t extract_len = 4096;
+
+    ifstream fin(text_file, ios::binary);
+    if (!fin) {
+        cerr << "Failed to open " << text_file << endl;
+        return 1;
+    }
+    string text((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+    // '\xfa' is the terminator of this sdsl's byte indexes (see append_zero_symbol), so it may not occur in the text
+    replace(text.begin(), text.end(), '\xfa', ' ');
+    if (text.size() < max(pattern_len, extract_len)) {
+        cerr << "The text is shorter than a pattern or an extract" << endl;
+        return 1;
+    }
+    string bench_file = work_dir + "/wt_bench.txt";
+    ofstream(bench_file, ios::binary).write(text.data(), text.size());
+
+    mt19937_64 rng(19);
+    vector<pair<uint64_t, uint64_t>> patterns(num_patterns);
+    for (auto& pattern : patterns) {
+        pattern = {rng() % (text.size() - pattern_len + 1), pattern_len};
+    }
+    vector<uint64_t> extract_starts(num_extracts);
+    for (auto& start : extract_starts) {
+        start = rng() % (text.size() - extract_len + 1);
+    }
+
+    cache_config config(false, work_dir, "wt_bench");
+    vector<Report> reports;
+    reports.push_back(run<wt_huff<rrr_vector<127> > >("wt_huff<rrr_vector<127>>", config, bench_file, text, patterns, extract_starts, extract_len));
+    reports.push_back(run<wt_kary<4> >("wt_kary<4>", config, bench_file, text, patterns, extract_starts, extract_len));
+    reports.push_back(run<wt_kary<2> >("wt_kary<2>", config, bench_file, text, patterns, extract_starts, extract_len));
+    util::delete_all_files(config.file_map);
+    sdsl::remove(bench_file);
+
+    cout << "n = " << text.size() << ", " << num_patterns << " patterns of length " << pattern_len
+         << ", " << num_extracts << " extracts of " << extract_len << " bytes" << endl;
+    cout << left << setw(26) << "wavelet tree" << right << setw(12) << "wt MiB" << setw(12) << "index MiB"
+         << setw(14) << "construct s" << setw(16) << "search ns/char" << setw(16) << "extract MB/s" << endl;
+    for (auto& report : reports) {
+        cout << left << setw(26) << report.name << right << fixed << setprecision(2)
+             << setw(12) << report.wt_bytes / (double)(1 << 20) << setw(12) << report.index_bytes / (double)(1 << 20)
+             << setw(14) << report.construct_seconds << setw(16) << report.search_ns_per_char
+             << setw(16) << report.extract_mb_per_second << endl;
+    }
+    for (auto& report : reports) {
+        if (report.total_count != reports[0].total_count) {
+            cerr << report.name << " counts " << report.total_count << " occurrences, "
+                 << reports[0].name << " counts " << reports[0].total_count << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
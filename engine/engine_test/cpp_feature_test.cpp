@@ -0,0 +1,821 @@
+// g++ -std=c++17 -O2 engine_test/cpp_feature_test.cpp -o engine_test/cpp_feature_test -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread
+
+// Checks the engine's features against brute force over the raw text of a small synthetic corpus, which is indexed
+// into a temporary directory as two shards. Exits with the number of failed checks.
+
+#include "../src/cpp_engine.h"
+#include <iostream>
+#include <random>
+#include <regex>
+
+static size_t failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { failures++; cerr << __LINE__ << ": check failed: " #cond << endl; } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    auto _a = (a); auto _b = (b); \
+    if (!(_a == _b)) { failures++; cerr << __LINE__ << ": check failed: " #a " == " #b " (" << _a << " vs " << _b << ")" << endl; } \
+} while (0)
+
+// sdsl/io.hpp prints vectors of integers
+ostream& operator<<(ostream& out, const vector<string>& v) {
+    out << "[";
+    for (size_t i = 0; i < v.size(); i++) out << (i ? ", " : "") << v[i];
+    return out << "]";
+}
+
+const size_t UNLIMITED = SIZE_MAX / 2;
+
+// Docs of lowercase, capitalized and uppercase words from a small vocabulary, so that most short strings repeat
+vector<string> make_docs(const size_t doc_cnt, const uint64_t seed) {
+    const vector<string> words = {"the", "cat", "sat", "on", "a", "mat", "data", "dat", "at", "abc", "ab", "x1", "42", "2024", "tea", "eat"};
+    const vector<string> seps = {" ", " ", " ", " ", "  ", "\t", ", "};
+    mt19937_64 rng(seed);
+    vector<string> docs;
+    for (size_t d = 0; d < doc_cnt; d++) {
+        size_t len = 1 + rng() % (d % 7 == 0 ? 200 : 40);
+        string doc;
+        for (size_t i = 0; i < len; i++) {
+            if (i > 0) doc += seps[rng() % seps.size()];
+            string word = words[rng() % words.size()];
+            if (rng() % 5 == 0) word[0] = toupper(word[0]);
+            if (rng() % 11 == 0) transform(word.begin(), word.end(), word.begin(), ::toupper);
+            doc += word;
+        }
+        docs.push_back(doc);
+    }
+    return docs;
+}
+
+// The text of a shard as src/indexing.py lays it out: each doc preceded by the \xff separator
+string shard_text(const vector<string>& docs) {
+    string text;
+    for (const auto& doc : docs) text += "\xff" + doc;
+    return text;
+}
+
+// Writes data.fm9 and data_offset for docs, as src/indexing.py and cpp_indexing would
+void build_shard(const string& dir, const vector<string>& docs) {
+    fs::create_directories(dir);
+    vector<uint64_t> offsets;
+    string text;
+    for (const auto& doc : docs) {
+        offsets.push_back(text.size());
+        text += "\xff" + doc;
+    }
+    index_t index;
+    construct_im(index, text, 1);
+    store_to_file(index, dir + "/data.fm9");
+    ofstream(dir + "/data_offset", ios::binary).write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+}
+
+// The corpus, split into two shards of consecutive docs. The sdsl in this repo ends the text with \xfa rather than \0, so
+// the smallest byte of a shard takes the place of \0 and backward search never matches it; each shard's last doc ends
+// with a \x01 for that, which no query uses.
+struct Corpus {
+    string dir;
+    vector<string> docs;
+    vector<vector<string>> shard_docs;
+    vector<string> shard_dirs;
+
+    Corpus(const string& dir, const size_t doc_cnt, const uint64_t seed) : dir(dir), docs(make_docs(doc_cnt, seed)) {
+        docs[doc_cnt / 2 - 1] += "\x01";
+        docs[doc_cnt - 1] += "\x01";
+        shard_docs = {vector<string>(docs.begin(), docs.begin() + doc_cnt / 2), vector<string>(docs.begin() + doc_cnt / 2, docs.end())};
+        for (size_t s = 0; s < shard_docs.size(); s++) {
+            shard_dirs.push_back(dir + "/" + to_string(s));
+            build_shard(shard_dirs[s], shard_docs[s]);
+        }
+    }
+};
+
+size_t count_occurrences(const string& text, const string& query) {
+    size_t cnt = 0;
+    for (size_t pos = text.find(query); pos != string::npos; pos = text.find(query, pos + 1)) cnt++;
+    return cnt;
+}
+
+vector<size_t> sorted(vector<size_t> v) {
+    sort(v.begin(), v.end());
+    return v;
+}
+
+// Global ixs of the docs containing query, in increasing order
+vector<size_t> docs_containing(const Corpus& corpus, const string& query) {
+    vector<size_t> doc_ixs;
+    for (size_t d = 0; d < corpus.docs.size(); d++) {
+        if (corpus.docs[d].find(query) != string::npos) doc_ixs.push_back(d);
+    }
+    return doc_ixs;
+}
+
+// Queries that occur, built from the corpus text, and a few that do not
+vector<string> sample_queries(const Corpus& corpus, const size_t n, const size_t max_len, const uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<string> queries = {"zzz", "the cat sat", "DATA", "Data", "2024", "t", "  "};
+    while (queries.size() < n) {
+        const string& doc = corpus.docs[rng() % corpus.docs.size()];
+        size_t len = 1 + rng() % max_len;
+        if (doc.size() < len) continue;
+        string query = doc.substr(rng() % (doc.size() - len + 1), len);
+        if (query.find('\x01') == string::npos) queries.push_back(query);
+    }
+    return queries;
+}
+
+// The suffix array of text followed by the \xfa that sdsl appends
+vector<size_t> suffix_array(const string& text) {
+    const string terminated = text + "\xfa";
+    const string_view t(terminated);
+    vector<size_t> sa(t.size());
+    iota(sa.begin(), sa.end(), 0);
+    sort(sa.begin(), sa.end(), [&](size_t a, size_t b) { return t.substr(a) < t.substr(b); });
+    return sa;
+}
+
+// The SA range of the suffixes starting with query; left inclusive, right exclusive
+pair<size_t, size_t> sa_range(const string& text, const vector<size_t>& sa, const string& query) {
+    auto prefix = [&](size_t pos) { return string_view(text).substr(pos, query.size()); };
+    auto lo = partition_point(sa.begin(), sa.end(), [&](size_t pos) { return prefix(pos) < query; });
+    auto hi = partition_point(lo, sa.end(), [&](size_t pos) { return prefix(pos) == query; });
+    return {lo - sa.begin(), hi - sa.begin()};
+}
+
+// The SA ranks of the text positions with match set, as sorted disjoint segments; left inclusive, right exclusive
+vector<pair<size_t, size_t>> rank_segments(const vector<size_t>& sa, const vector<char>& match) {
+    vector<pair<size_t, size_t>> segments;
+    for (size_t rank = 0; rank < sa.size(); rank++) {
+        if (sa[rank] >= match.size() || !match[sa[rank]]) continue;
+        if (!segments.empty() && segments.back().second == rank) {
+            segments.back().second++;
+        } else {
+            segments.push_back({rank, rank + 1});
+        }
+    }
+    return segments;
+}
+
+// ------------------------------------------------------------------------------------------------------------------ //
+
+void test_cache(const Corpus& corpus) {
+    cout << "result cache" << endl;
+
+    // LRU eviction within a partition: make every key land in partition 0, whose budget holds three entries
+    {
+        vector<string> keys;
+        for (size_t i = 0; keys.size() < 4; i++) {
+            char query[8];
+            snprintf(query, sizeof(query), "q%03zu", i);
+            string key = ResultCache::find_key(0, query);
+            if (hash<string>()(key) % ResultCache::NUM_PARTITIONS == 0) keys.push_back(key);
+        }
+        const size_t entry_bytes = ResultCache::ENTRY_OVERHEAD + keys[0].size() + sizeof(pair<size_t, size_t>);
+        ResultCache cache(ResultCache::NUM_PARTITIONS * (3 * entry_bytes + entry_bytes / 2), 0);
+        auto result = [](size_t i) { return FindResult{ .cnt = i, .segment_by_shard = {{i, 2 * i}}, .profile = {}, }; };
+        for (size_t i = 0; i < 3; i++) cache.put_find(keys[i], result(i + 1));
+        FindResult out;
+        CHECK(cache.get_find(keys[0], out)); // keys[1] is now the least recently used
+        cache.put_find(keys[3], result(4));
+        CHECK(!cache.get_find(keys[1], out));
+        for (size_t i : {0, 2, 3}) {
+            CHECK(cache.get_find(keys[i], out));
+            CHECK_EQ(out.cnt, i + 1);
+            CHECK(out.segment_by_shard == result(i + 1).segment_by_shard);
+        }
+        auto stats = cache.stats();
+        CHECK_EQ(stats.evictions, (size_t)1);
+        CHECK_EQ(stats.entries, (size_t)3);
+        CHECK(stats.bytes <= stats.max_bytes / ResultCache::NUM_PARTITIONS);
+    }
+
+    // cached results are the uncached ones, and survive a save/load round trip while the shards are unchanged
+    const string cache_path = corpus.dir + "/cache.bin";
+    const vector<string> queries = {"the", "cat sat", "zzz", "42"};
+    {
+        Engine plain(corpus.shard_dirs, false, false);
+        Engine engine(corpus.shard_dirs, false, false);
+        engine.enable_cache(1 << 20, 1 << 12);
+        for (int pass = 0; pass < 2; pass++) {
+            for (const auto& query : queries) {
+                CHECK(engine.find(query).segment_by_shard == plain.find(query).segment_by_shard);
+            }
+            auto a = engine.get_doc_by_rank(1, 3, 2, 10), b = plain.get_doc_by_rank(1, 3, 2, 10);
+            CHECK_EQ(a.doc_ix, b.doc_ix);
+            CHECK_EQ(a.text, b.text);
+            CHECK_EQ(a.needle_offset, b.needle_offset);
+        }
+        auto stats = engine.cache_stats();
+        CHECK_EQ(stats.hits, queries.size() + 1);
+        CHECK_EQ(stats.entries, queries.size() + 1);
+        CHECK_EQ(engine.save_cache(cache_path), queries.size() + 1);
+    }
+    {
+        Engine engine(corpus.shard_dirs, false, false);
+        engine.enable_cache(1 << 20, 1 << 12);
+        CHECK_EQ(engine.load_cache(cache_path), queries.size() + 1);
+        for (const auto& query : queries) engine.find(query);
+        CHECK_EQ(engine.cache_stats().hits, queries.size());
+    }
+
+    // rewriting shard 1 invalidates the find results, which depend on every shard, and shard 1's docs, but not shard 0's
+    {
+        const string offset_path = corpus.shard_dirs[1] + "/data_offset";
+        fs::last_write_time(offset_path, fs::last_write_time(offset_path) + chrono::seconds(1));
+        Engine engine(corpus.shard_dirs, false, false);
+        engine.enable_cache(1 << 20, 1 << 12);
+        CHECK_EQ(engine.load_cache(cache_path), (size_t)0);
+    }
+    {
+        Engine engine(corpus.shard_dirs, false, false);
+        engine.enable_cache(1 << 20, 1 << 12);
+        engine.get_doc_by_rank(0, 5, 2, 10);
+        engine.find("the");
+        engine.save_cache(cache_path);
+        const string offset_path = corpus.shard_dirs[1] + "/data_offset";
+        fs::last_write_time(offset_path, fs::last_write_time(offset_path) + chrono::seconds(1));
+        Engine reopened(corpus.shard_dirs, false, false);
+        reopened.enable_cache(1 << 20, 1 << 12);
+        CHECK_EQ(reopened.load_cache(cache_path), (size_t)1);
+        reopened.get_doc_by_rank(0, 5, 2, 10);
+        CHECK_EQ(reopened.cache_stats().hits, (size_t)1);
+    }
+}
+
+void test_kgram_table(const Corpus& corpus) {
+    cout << "k-gram table" << endl;
+
+    // data.kgram as src/kgram_table.cpp lays it out, but from the brute-force SA of each shard
+    const size_t k = 3;
+    vector<vector<size_t>> sas;
+    for (size_t s = 0; s < corpus.shard_dirs.size(); s++) {
+        const string text = shard_text(corpus.shard_docs[s]);
+        sas.push_back(suffix_array(text));
+        map<size_t, pair<size_t, size_t>> intervals; // inclusive, by key
+        for (size_t rank = 0; rank < sas[s].size(); rank++) {
+            for (size_t len = 1; len <= k && sas[s][rank] + len <= text.size() && text[sas[s][rank] + len - 1] != '\x01'; len++) {
+                auto [it, inserted] = intervals.try_emplace(KGramTable::key(text.c_str() + sas[s][rank], len), rank, rank);
+                it->second.second = rank;
+            }
+        }
+        vector<size_t> table = {k, intervals.size()};
+        for (auto [key, interval] : intervals) table.insert(table.end(), {key, interval.first, interval.second});
+        ofstream(corpus.shard_dirs[s] + "/data.kgram", ios::binary).write((const char*)table.data(), table.size() * sizeof(size_t));
+    }
+
+    Engine engine(corpus.shard_dirs, false, false);
+    for (const auto& query : sample_queries(corpus, 300, 2 * k, 1)) {
+        for (bool use_table : {true, false}) {
+            engine.set_use_kgram_table(use_table);
+            auto result = engine.find(query);
+            size_t cnt = 0;
+            for (size_t s = 0; s < corpus.shard_dirs.size(); s++) {
+                auto [lo, hi] = sa_range(shard_text(corpus.shard_docs[s]), sas[s], query);
+                cnt += hi - lo;
+                if (lo < hi) CHECK(result.segment_by_shard[s] == make_pair(lo, hi));
+            }
+            CHECK_EQ(result.cnt, cnt);
+        }
+    }
+}
+
+void test_count_docs(const Corpus& corpus) {
+    cout << "count_docs" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    for (const auto& query : sample_queries(corpus, 60, 8, 2)) {
+        auto doc_ixs = docs_containing(corpus, query);
+        const size_t cnt = count_occurrences(shard_text(corpus.docs), query);
+
+        auto listed = engine.list_docs(query, UNLIMITED, UNLIMITED);
+        CHECK_EQ(listed.cnt, cnt);
+        CHECK(listed.complete);
+        CHECK_EQ(sorted(listed.doc_ixs), doc_ixs);
+        auto few = engine.list_docs(query, 2, UNLIMITED);
+        CHECK_EQ(few.complete, doc_ixs.size() <= 2);
+        for (auto doc : few.doc_ixs) CHECK(binary_search(doc_ixs.begin(), doc_ixs.end(), doc));
+
+        auto exact = engine.count_docs(query, UNLIMITED, 100);
+        CHECK_EQ(exact.cnt, cnt);
+        CHECK(exact.exact);
+        CHECK_EQ(exact.count, (double)doc_ixs.size());
+        CHECK_EQ(exact.ci_low, exact.count);
+        CHECK_EQ(exact.ci_high, exact.count);
+
+        // too little work to sample MIN_DOC_SAMPLE occurrences: the interval is a hard bound
+        auto bounded = engine.count_docs(query, 5, 100);
+        CHECK(bounded.ci_low <= (double)doc_ixs.size() && (double)doc_ixs.size() <= bounded.ci_high);
+        CHECK(bounded.ci_low <= bounded.count && bounded.count <= bounded.ci_high);
+
+        // enough work to sample: an estimate, but still within the counts that are possible at all
+        auto estimated = engine.count_docs(query, 200, 100);
+        CHECK(estimated.ci_low <= estimated.count && estimated.count <= estimated.ci_high);
+        CHECK(estimated.ci_low >= (cnt > 0 ? 1.0 : 0.0));
+        CHECK(estimated.ci_high <= (double)min(cnt, corpus.docs.size()));
+    }
+
+    bool thrown = false;
+    try { engine.count_docs("", UNLIMITED, 100); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+    thrown = false;
+    try { engine.count_docs("the", UNLIMITED, 1); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+}
+
+void test_topk_docs(const Corpus& corpus) {
+    cout << "topk_docs" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    const size_t k = 5;
+    for (const auto& query : sample_queries(corpus, 60, 6, 3)) {
+        vector<pair<size_t, size_t>> doc_counts; // (count, doc ix), by decreasing count, then by doc ix
+        for (size_t d = 0; d < corpus.docs.size(); d++) {
+            size_t count = count_occurrences(corpus.docs[d], query);
+            if (count > 0) doc_counts.push_back({count, d});
+        }
+        sort(doc_counts.begin(), doc_counts.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        vector<size_t> doc_ixs, counts;
+        for (size_t i = 0; i < min(k, doc_counts.size()); i++) {
+            counts.push_back(doc_counts[i].first);
+            doc_ixs.push_back(doc_counts[i].second);
+        }
+
+        auto exact = engine.topk_docs(query, k, UNLIMITED, 100);
+        CHECK(exact.exact);
+        CHECK_EQ(exact.cnt, count_occurrences(shard_text(corpus.docs), query));
+        CHECK_EQ(exact.doc_ixs, doc_ixs);
+        CHECK_EQ(exact.counts, counts);
+
+        // from a sample, the top k may miss documents, but whatever is returned is counted exactly and ranked
+        auto sampled = engine.topk_docs(query, k, 0, 20);
+        CHECK(sampled.doc_ixs.size() <= k);
+        CHECK_EQ(sampled.doc_ixs.size(), sampled.counts.size());
+        for (size_t i = 0; i < sampled.doc_ixs.size(); i++) {
+            CHECK_EQ(sampled.counts[i], count_occurrences(corpus.docs[sampled.doc_ixs[i]], query));
+            if (i > 0) CHECK(sampled.counts[i - 1] > sampled.counts[i] || (sampled.counts[i - 1] == sampled.counts[i] && sampled.doc_ixs[i - 1] < sampled.doc_ixs[i]));
+        }
+        if (!sampled.doc_ixs.empty()) CHECK(sampled.counts[0] <= counts[0]);
+    }
+
+    bool thrown = false;
+    try { engine.topk_docs("", k, UNLIMITED, 100); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+}
+
+void test_find_cnf(const Corpus& corpus) {
+    cout << "find_cnf" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    const auto terms = sample_queries(corpus, 100, 5, 4);
+    mt19937_64 rng(4);
+    for (size_t i = 0; i < 30; i++) {
+        vector<vector<string>> cnf(1 + rng() % 3);
+        for (auto& clause : cnf) {
+            for (size_t t = 0, n = 1 + rng() % 2; t < n; t++) clause.push_back(terms[rng() % terms.size()]);
+        }
+        vector<size_t> doc_ixs;
+        for (size_t d = 0; d < corpus.docs.size(); d++) {
+            bool match = all_of(cnf.begin(), cnf.end(), [&](const vector<string>& clause) {
+                return any_of(clause.begin(), clause.end(), [&](const string& term) { return corpus.docs[d].find(term) != string::npos; });
+            });
+            if (match) doc_ixs.push_back(d);
+        }
+
+        auto exact = engine.find_cnf(cnf, UNLIMITED, UNLIMITED);
+        CHECK(!exact.approx);
+        CHECK_EQ(exact.cnt, (double)doc_ixs.size());
+        CHECK_EQ(exact.doc_ixs, doc_ixs);
+        auto few = engine.find_cnf(cnf, 3, UNLIMITED);
+        CHECK_EQ(few.cnt, (double)doc_ixs.size());
+        CHECK_EQ(few.doc_ixs, vector<size_t>(doc_ixs.begin(), doc_ixs.begin() + min(doc_ixs.size(), (size_t)3)));
+
+        // beyond max_work the count is estimated, but the documents returned still match
+        auto limited = engine.find_cnf(cnf, UNLIMITED, 2);
+        if (!limited.approx) CHECK_EQ(limited.cnt, (double)doc_ixs.size());
+        for (auto doc : limited.doc_ixs) CHECK(binary_search(doc_ixs.begin(), doc_ixs.end(), doc));
+    }
+
+    for (const vector<vector<string>>& cnf : vector<vector<vector<string>>>{{}, {{"the"}, {}}, {{"the", ""}}}) {
+        bool thrown = false;
+        try { engine.find_cnf(cnf, UNLIMITED, UNLIMITED); } catch (const invalid_argument&) { thrown = true; }
+        CHECK(thrown);
+    }
+}
+
+// Whether a string starting at text[pos] is within max_edits of the query, with neither its first nor its last byte
+// inserted, and without running into a separator or the \x01 that backward search never matches
+bool approx_match_at(const string& text, const size_t pos, const string& query, const size_t max_edits) {
+    const size_t m = query.length(), INF = SIZE_MAX / 4;
+    size_t n = 0;
+    while (n < m + max_edits && pos + n < text.size() && text[pos + n] != '\xff' && text[pos + n] != '\x01') n++;
+    if (n == 0) return false;
+    // d[i][j]: edits aligning query[0:i] with text[pos:pos + j]
+    vector<size_t> prev(n + 1, INF), cur(n + 1);
+    prev[0] = 0;
+    for (size_t i = 1; i <= m; i++) {
+        for (size_t j = 0; j <= n; j++) {
+            cur[j] = prev[j] + 1;
+            if (j > 0) cur[j] = min(cur[j], prev[j - 1] + (query[i - 1] != text[pos + j - 1]));
+            if (j > 0 && i < m) cur[j] = min(cur[j], cur[j - 1] + 1);
+        }
+        swap(prev, cur);
+    }
+    return *min_element(prev.begin() + 1, prev.end()) <= max_edits;
+}
+
+void test_find_approx(const Corpus& corpus) {
+    cout << "find_approx" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    vector<string> texts;
+    vector<vector<size_t>> sas;
+    for (const auto& docs : corpus.shard_docs) {
+        texts.push_back(shard_text(docs));
+        sas.push_back(suffix_array(texts.back()));
+    }
+    mt19937_64 rng(5);
+    for (auto query : sample_queries(corpus, 40, 6, 5)) {
+        if (query.length() < 2) continue;
+        query[rng() % query.length()] = "aeiou x"[rng() % 7]; // often no longer an exact occurrence
+        for (size_t max_edits = 1; max_edits <= 2 && max_edits < query.length(); max_edits++) {
+            auto result = engine.find_approx(query, max_edits, UNLIMITED);
+            CHECK(result.complete);
+            size_t cnt = 0;
+            for (size_t s = 0; s < texts.size(); s++) {
+                vector<char> match(texts[s].size());
+                for (size_t pos = 0; pos < texts[s].size(); pos++) match[pos] = approx_match_at(texts[s], pos, query, max_edits);
+                auto segments = rank_segments(sas[s], match);
+                for (auto [lo, hi] : segments) cnt += hi - lo;
+                CHECK(result.segments_by_shard[s] == segments);
+            }
+            CHECK_EQ(result.cnt, cnt);
+
+            auto limited = engine.find_approx(query, max_edits, 3);
+            CHECK(limited.cnt <= cnt);
+            if (limited.complete) CHECK_EQ(limited.cnt, cnt);
+        }
+    }
+
+    bool thrown = false;
+    try { engine.find_approx("ab", 2, UNLIMITED); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+}
+
+// Whether text[pos:] starts with the query up to ASCII case (if fold_case), with each whitespace run of the query
+// matching any non-empty run of the bytes in whitespace
+bool folded_match_at(const string& text, size_t pos, const string& query, size_t i, const bool fold_case, const string& whitespace) {
+    auto is_space = [&](char c) { return whitespace.find(c) != string::npos; };
+    for (; i < query.length(); i++, pos++) {
+        if (is_space(query[i])) {
+            size_t j = i;
+            while (j < query.length() && is_space(query[j])) j++;
+            for (size_t end = pos; end < text.size() && is_space(text[end]); end++) {
+                if (folded_match_at(text, end + 1, query, j, fold_case, whitespace)) return true;
+            }
+            return false;
+        }
+        if (pos == text.size()) return false;
+        bool same = fold_case && isalpha((unsigned char)query[i]) ? tolower(query[i]) == tolower(text[pos]) : query[i] == text[pos];
+        if (!same) return false;
+    }
+    return true;
+}
+
+void test_find_folded(const Corpus& corpus) {
+    cout << "find_folded" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    vector<string> texts;
+    vector<vector<size_t>> sas;
+    for (const auto& docs : corpus.shard_docs) {
+        texts.push_back(shard_text(docs));
+        sas.push_back(suffix_array(texts.back()));
+    }
+    mt19937_64 rng(6);
+    for (auto query : sample_queries(corpus, 60, 10, 6)) {
+        for (auto& c : query) {
+            if (rng() % 3 == 0) c = rng() % 2 ? toupper(c) : tolower(c);
+            if (c == ' ' && rng() % 3 == 0) c = '\t';
+        }
+        for (bool fold_case : {false, true}) {
+            for (const string whitespace : {"", " ", " \t"}) {
+                auto result = engine.find_folded(query, fold_case, whitespace, UNLIMITED);
+                CHECK(result.complete);
+                size_t cnt = 0;
+                for (size_t s = 0; s < texts.size(); s++) {
+                    vector<char> match(texts[s].size());
+                    for (size_t pos = 0; pos < texts[s].size(); pos++) match[pos] = folded_match_at(texts[s], pos, query, 0, fold_case, whitespace);
+                    auto segments = rank_segments(sas[s], match);
+                    for (auto [lo, hi] : segments) cnt += hi - lo;
+                    CHECK(result.segments_by_shard[s] == segments);
+                }
+                CHECK_EQ(result.cnt, cnt);
+                if (!fold_case && whitespace.empty()) CHECK_EQ(result.cnt, engine.find(query).cnt);
+            }
+        }
+    }
+
+    bool thrown = false;
+    try { engine.find_folded("", true, " ", UNLIMITED); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+}
+
+void test_find_regex(const Corpus& corpus) {
+    cout << "find_regex" << endl;
+
+    Engine engine(corpus.shard_dirs, false, false);
+    vector<string> texts;
+    vector<vector<size_t>> sas;
+    for (const auto& docs : corpus.shard_docs) {
+        texts.push_back(shard_text(docs));
+        sas.push_back(suffix_array(texts.back()));
+    }
+    const vector<string> patterns = {
+        "cat", "c.t", "[Tt]he", "\\d+", "\\d{2,3}", "(ab|at)c?", "a\\w*t", "[^ ]at", "\\s\\s+", "(the|a) (cat|mat)",
+        "[a-c]+", "x1|42", "D[A-Z]*", "\\S+,", "e?a[td]", "t{2}", "\\w+\\t", ".", "\\W", "[^a-z]",
+    };
+    for (const auto& pattern : patterns) {
+        const regex re(pattern, regex::ECMAScript);
+        auto result = engine.find_regex(pattern, UNLIMITED);
+        CHECK(result.complete);
+        size_t cnt = 0;
+        for (size_t s = 0; s < texts.size(); s++) {
+            // . and negated classes never match a separator, and backward search never matches the \x01
+            vector<char> match(texts[s].size());
+            for (size_t pos = 0, end = 0; pos < texts[s].size(); pos++) {
+                if (end <= pos) end = min(texts[s].find_first_of("\xff\x01", pos + 1), texts[s].size());
+                if (texts[s][pos] == '\xff' || texts[s][pos] == '\x01') continue;
+                match[pos] = regex_search(texts[s].cbegin() + pos, texts[s].cbegin() + end, re, regex_constants::match_continuous);
+            }
+            auto segments = rank_segments(sas[s], match);
+            for (auto [lo, hi] : segments) cnt += hi - lo;
+            CHECK(result.segments_by_shard[s] == segments);
+        }
+        CHECK_EQ(result.cnt, cnt);
+    }
+
+    for (const string pattern : {"(ab", "ab)", "*a", "a{3,1}", "[ab", "a\\", "a*", "(|a)"}) {
+        bool thrown = false;
+        try { engine.find_regex(pattern, UNLIMITED); } catch (const invalid_argument&) { thrown = true; }
+        CHECK(thrown);
+    }
+}
+
+// The metadata line of a doc, and its "source" field; a fifth of the docs have none
+string meta_line(const size_t doc_ix) {
+    return "{\"id\": " + to_string(doc_ix) + (doc_ix % 5 ? ", \"source\": \"src" + to_string(doc_ix % 3) + "\"}" : "}");
+}
+
+string meta_source(const size_t doc_ix) {
+    return doc_ix % 5 ? "src" + to_string(doc_ix % 3) : "";
+}
+
+// Writes meta.store as src/indexing.py --meta_store --meta_dict_fields source would, with block_docs docs per block
+void write_meta_store(const string& dir, const size_t first_doc_ix, const size_t doc_cnt, const size_t block_docs) {
+    auto pad = [](string& bytes) { bytes.resize((bytes.size() + 7) / 8 * 8, '\0'); };
+    auto put = [](string& bytes, const uint64_t x) { bytes.append((const char*)&x, sizeof(x)); };
+    const size_t block_cnt = (doc_cnt + block_docs - 1) / block_docs;
+    vector<uint64_t> block_offsets, doc_locs;
+    string frames;
+    size_t offset = (5 + block_cnt + 1 + doc_cnt) * sizeof(uint64_t);
+    for (size_t b = 0; b < block_cnt; b++) {
+        string block;
+        for (size_t d = b * block_docs; d < min((b + 1) * block_docs, doc_cnt); d++) {
+            doc_locs.push_back((b << 32) | block.size());
+            block += meta_line(first_doc_ix + d) + "\n";
+        }
+        string frame(ZSTD_compressBound(block.size()), '\0');
+        frame.resize(ZSTD_compress(frame.data(), frame.size(), block.data(), block.size(), 3));
+        block_offsets.push_back(offset + frames.size());
+        frames += frame;
+    }
+    block_offsets.push_back(offset + frames.size());
+    pad(frames);
+
+    vector<string> values;
+    vector<uint32_t> codes;
+    for (size_t d = 0; d < doc_cnt; d++) {
+        const string value = meta_source(first_doc_ix + d);
+        auto it = find(values.begin(), values.end(), value);
+        codes.push_back(value.empty() ? UINT32_MAX : it - values.begin());
+        if (!value.empty() && it == values.end()) values.push_back(value);
+    }
+    string fields;
+    put(fields, strlen("source"));
+    fields += "source";
+    pad(fields);
+    put(fields, values.size());
+    uint64_t value_offset = 0;
+    put(fields, value_offset);
+    for (const auto& value : values) put(fields, value_offset += value.size());
+    for (const auto& value : values) fields += value;
+    pad(fields);
+    fields.append((const char*)codes.data(), codes.size() * sizeof(uint32_t));
+    pad(fields);
+
+    string header = "IGMSTOR1";
+    for (uint64_t x : {(uint64_t)doc_cnt, (uint64_t)block_cnt, (uint64_t)1, (uint64_t)(offset + frames.size())}) put(header, x);
+    for (auto x : block_offsets) put(header, x);
+    for (auto x : doc_locs) put(header, x);
+    ofstream(dir + "/meta.store", ios::binary) << header << frames << fields;
+}
+
+void test_meta_store(const Corpus& corpus) {
+    cout << "meta.store" << endl;
+
+    for (size_t s = 0, first_doc_ix = 0; s < corpus.shard_dirs.size(); first_doc_ix += corpus.shard_docs[s++].size()) {
+        write_meta_store(corpus.shard_dirs[s], first_doc_ix, corpus.shard_docs[s].size(), 4);
+    }
+    Engine engine(corpus.shard_dirs, false, true);
+    for (size_t d = 0; d < corpus.docs.size(); d++) {
+        CHECK_EQ(engine.get_doc_field(d, "source"), meta_source(d));
+        CHECK_EQ(engine.get_doc_field(d, "lang"), string());
+    }
+    // every doc, through the occurrences of its separator
+    auto result = engine.find("\xff");
+    CHECK_EQ(result.cnt, corpus.docs.size());
+    for (size_t s = 0; s < corpus.shard_dirs.size(); s++) {
+        for (size_t rank = result.segment_by_shard[s].first; rank < result.segment_by_shard[s].second; rank++) {
+            auto doc = engine.get_doc_by_rank(s, rank, 1, 1000);
+            CHECK_EQ(doc.metadata, meta_line(doc.doc_ix));
+            CHECK_EQ(doc.text, corpus.docs[doc.doc_ix]);
+        }
+    }
+
+    for (const auto& dir : corpus.shard_dirs) fs::remove(dir + "/meta.store");
+}
+
+// Writes doc_attr.source and its .dict as src/indexing.py --doc_attrs source would, for the values of meta_source
+void write_doc_attr(const string& dir, const size_t first_doc_ix, const size_t doc_cnt) {
+    vector<string> values;
+    vector<uint8_t> codes;
+    for (size_t d = 0; d < doc_cnt; d++) {
+        const string value = meta_source(first_doc_ix + d);
+        auto it = find(values.begin(), values.end(), value);
+        codes.push_back(it - values.begin());
+        if (it == values.end()) values.push_back(value);
+    }
+    ofstream fout(dir + "/doc_attr.source", ios::binary);
+    const uint64_t bits = doc_cnt * 8;
+    const uint8_t width = 8;
+    fout.write((const char*)&bits, sizeof(bits)).write((const char*)&width, sizeof(width));
+    codes.resize((codes.size() + 7) / 8 * 8, 0);
+    fout.write((const char*)codes.data(), codes.size());
+
+    ofstream dict(dir + "/doc_attr.source.dict", ios::binary);
+    vector<uint64_t> header = {values.size(), 0};
+    for (const auto& value : values) header.push_back(header.back() + value.size());
+    dict.write((const char*)header.data(), header.size() * sizeof(uint64_t));
+    for (const auto& value : values) dict << value;
+}
+
+void test_doc_attr(const Corpus& corpus) {
+    cout << "doc_attr" << endl;
+
+    for (size_t s = 0, first_doc_ix = 0; s < corpus.shard_dirs.size(); first_doc_ix += corpus.shard_docs[s++].size()) {
+        write_doc_attr(corpus.shard_dirs[s], first_doc_ix, corpus.shard_docs[s].size());
+    }
+    Engine engine(corpus.shard_dirs, false, false);
+    for (const auto& query : sample_queries(corpus, 40, 6, 7)) {
+        map<string, size_t> counts_by_value;
+        for (size_t d = 0; d < corpus.docs.size(); d++) {
+            size_t count = count_occurrences(corpus.docs[d], query);
+            if (count > 0) counts_by_value[meta_source(d)] += count;
+        }
+        vector<pair<string, size_t>> expected(counts_by_value.begin(), counts_by_value.end());
+        stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        vector<string> values;
+        vector<double> counts;
+        for (auto [value, count] : expected) {
+            values.push_back(value);
+            counts.push_back(count);
+        }
+
+        auto exact = engine.count_by_attribute(query, "source", UNLIMITED, 100);
+        CHECK(exact.exact);
+        CHECK_EQ(exact.values, values);
+        CHECK(exact.counts == counts);
+        CHECK(exact.ci_low == counts && exact.ci_high == counts);
+
+        // stratified over the SA interval, the estimates of a shard add up to its occurrences
+        auto sampled = engine.count_by_attribute(query, "source", 0, 16);
+        double total = 0.0;
+        for (size_t i = 0; i < sampled.values.size(); i++) {
+            total += sampled.counts[i];
+            CHECK(counts_by_value.count(sampled.values[i]));
+            CHECK(sampled.ci_low[i] <= sampled.counts[i] && sampled.counts[i] <= sampled.ci_high[i]);
+        }
+        CHECK(abs(total - sampled.cnt) < 1e-6 * max(sampled.cnt, (size_t)1));
+    }
+
+    bool thrown = false;
+    try { engine.count_by_attribute("the", "lang", UNLIMITED, 100); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+    thrown = false;
+    try { engine.count_by_attribute("the", "source", UNLIMITED, 1); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+
+    for (const auto& dir : corpus.shard_dirs) {
+        fs::remove(dir + "/doc_attr.source");
+        fs::remove(dir + "/doc_attr.source.dict");
+    }
+}
+
+// The metadata lines of the docs that src/indexing.py --dedup would have collapsed into a doc; docs get 0 to 3 of them
+vector<string> dup_lines(const size_t doc_ix) {
+    vector<string> lines;
+    for (size_t i = 0; i < doc_ix % 4; i++) lines.push_back("{\"id\": " + to_string(doc_ix) + ", \"dup\": " + to_string(i) + "}");
+    return lines;
+}
+
+// Writes doc_dups for dup_lines as src/indexing.py --dedup would
+void write_doc_dups(const string& dir, const size_t first_doc_ix, const size_t doc_cnt) {
+    vector<uint64_t> dup_starts = {0}, meta_offsets = {0};
+    string lines;
+    for (size_t d = 0; d < doc_cnt; d++) {
+        for (const auto& line : dup_lines(first_doc_ix + d)) {
+            lines += line + "\n";
+            meta_offsets.push_back(lines.size());
+        }
+        dup_starts.push_back(meta_offsets.size() - 1);
+    }
+    vector<uint64_t> header = {doc_cnt, meta_offsets.size() - 1};
+    ofstream fout(dir + "/doc_dups", ios::binary);
+    fout << "IGMDUPS1";
+    for (const auto* v : {&header, &dup_starts, &meta_offsets}) fout.write((const char*)v->data(), v->size() * sizeof(uint64_t));
+    fout << lines;
+}
+
+void test_doc_dups(const Corpus& corpus) {
+    cout << "doc_dups" << endl;
+
+    // only shard 0 has doc_dups; the docs of shard 1 have no dups
+    write_doc_dups(corpus.shard_dirs[0], 0, corpus.shard_docs[0].size());
+    auto expected_dups = [&](const size_t doc_ix) { return doc_ix < corpus.shard_docs[0].size() ? dup_lines(doc_ix) : vector<string>(); };
+    Engine engine(corpus.shard_dirs, false, false);
+    for (size_t d = 0; d < corpus.docs.size(); d++) {
+        const auto dups = expected_dups(d);
+        CHECK_EQ(engine.get_doc_dups(d, UNLIMITED), dups);
+        CHECK_EQ(engine.get_doc_dups(d, 1), vector<string>(dups.begin(), dups.begin() + min(dups.size(), (size_t)1)));
+    }
+    auto result = engine.find("\xff");
+    for (size_t s = 0; s < corpus.shard_dirs.size(); s++) {
+        for (size_t rank = result.segment_by_shard[s].first; rank < result.segment_by_shard[s].second; rank++) {
+            auto doc = engine.get_doc_by_rank(s, rank, 1, 10);
+            CHECK_EQ(doc.dup_cnt, expected_dups(doc.doc_ix).size());
+        }
+    }
+
+    for (const auto& query : sample_queries(corpus, 40, 6, 8)) {
+        size_t cnt = 0, count = 0;
+        for (size_t d = 0; d < corpus.docs.size(); d++) {
+            size_t occurrences = count_occurrences(corpus.docs[d], query);
+            cnt += occurrences;
+            count += occurrences * (1 + expected_dups(d).size());
+        }
+        auto exact = engine.count_with_dups(query, UNLIMITED, 100);
+        CHECK(exact.exact);
+        CHECK_EQ(exact.cnt, cnt);
+        CHECK_EQ(exact.count, (double)count);
+        CHECK(exact.ci_low == exact.count && exact.ci_high == exact.count);
+
+        auto sampled = engine.count_with_dups(query, 0, 20);
+        CHECK(sampled.ci_low <= sampled.count && sampled.count <= sampled.ci_high);
+        CHECK(sampled.ci_low >= (double)cnt);
+    }
+
+    bool thrown = false;
+    try { engine.get_doc_dups(corpus.docs.size(), UNLIMITED); } catch (const out_of_range&) { thrown = true; }
+    CHECK(thrown);
+    thrown = false;
+    try { engine.count_with_dups("the", UNLIMITED, 1); } catch (const invalid_argument&) { thrown = true; }
+    CHECK(thrown);
+
+    fs::remove(corpus.shard_dirs[0] + "/doc_dups");
+}
+
+int main() {
+    char dir_template[] = "/tmp/cpp_feature_test.XXXXXX";
+    const string dir = mkdtemp(dir_template);
+    {
+        Corpus corpus(dir, 60, 19260817);
+        test_cache(corpus);
+        test_kgram_table(corpus);
+        test_count_docs(corpus);
+        test_topk_docs(corpus);
+        test_find_cnf(corpus);
+        test_find_approx(corpus);
+        test_find_folded(corpus);
+        test_find_regex(corpus);
+        test_meta_store(corpus);
+        test_doc_attr(corpus);
+        test_doc_dups(corpus);
+    }
+    fs::remove_all(dir);
+
+    cout << (failures ? to_string(failures) + " checks failed" : "all checks passed") << endl;
+    return failures;
+}
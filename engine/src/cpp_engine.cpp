@@ -1,4 +1,4 @@
-// c++ -std=c++17 -O3 -shared -fPIC $(python3 -m pybind11 --includes) src/cpp_engine.cpp -o src/cpp_engine$(python3-config --extension-suffix) -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -pthread
+// c++ -std=c++17 -O3 -shared -fPIC $(python3 -m pybind11 --includes) src/cpp_engine.cpp -o src/cpp_engine$(python3-config --extension-suffix) -I../sdsl/include -L../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread
 
 #include "cpp_engine.h"
 #include <pybind11/pybind11.h>
@@ -7,14 +7,90 @@
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+// Engine, RLEngine and ILEngine differ only in their index type, so they share one interface
+template <class engine_t>
+void bind_engine(py::module_& m, const char* name) {
+    py::class_<engine_t>(m, name)
+        .def(py::init<const vector<string>, const bool, const bool, const bool, const size_t>(), py::call_guard<py::gil_scoped_release>(), "index_dirs"_a, "load_to_ram"_a, "get_metadata"_a, "numa_aware"_a = false, "load_threads"_a = 0)
+        .def("find", &engine_t::find, py::call_guard<py::gil_scoped_release>(), "query"_a)
+        .def("count", &engine_t::count, py::call_guard<py::gil_scoped_release>(), "query"_a)
+        .def("find_tokens", &engine_t::find_tokens, py::call_guard<py::gil_scoped_release>(), "token_ids"_a)
+        .def("count_tokens", &engine_t::count_tokens, py::call_guard<py::gil_scoped_release>(), "token_ids"_a)
+        .def("find_approx", &engine_t::find_approx, py::call_guard<py::gil_scoped_release>(), "query"_a, "max_edits"_a, "max_work"_a)
+        .def("count_approx", &engine_t::count_approx, py::call_guard<py::gil_scoped_release>(), "query"_a, "max_edits"_a, "max_work"_a)
+        .def("find_folded", &engine_t::find_folded, py::call_guard<py::gil_scoped_release>(), "query"_a, "fold_case"_a, "whitespace"_a, "max_work"_a)
+        .def("count_folded", &engine_t::count_folded, py::call_guard<py::gil_scoped_release>(), "query"_a, "fold_case"_a, "whitespace"_a, "max_work"_a)
+        .def("find_regex", &engine_t::find_regex, py::call_guard<py::gil_scoped_release>(), "pattern"_a, "max_work"_a)
+        .def("sample_occurrences", &engine_t::sample_occurrences, py::call_guard<py::gil_scoped_release>(), "query"_a, "n"_a, "seed"_a, "max_ctx_len"_a)
+        .def("matching_statistics", &engine_t::matching_statistics, py::call_guard<py::gil_scoped_release>(), "text"_a)
+        .def("contamination", &engine_t::contamination, py::call_guard<py::gil_scoped_release>(), "text"_a, "window"_a, "by_words"_a)
+        .def("contamination_batch", &engine_t::contamination_batch, py::call_guard<py::gil_scoped_release>(), "texts"_a, "window"_a, "by_words"_a, "num_threads"_a)
+        .def("count_docs", &engine_t::count_docs, py::call_guard<py::gil_scoped_release>(), "query"_a, "max_work"_a, "sample_size"_a)
+        .def("count_with_dups", &engine_t::count_with_dups, py::call_guard<py::gil_scoped_release>(), "query"_a, "max_work"_a, "sample_size"_a)
+        .def("list_docs", &engine_t::list_docs, py::call_guard<py::gil_scoped_release>(), "query"_a, "max_docs"_a, "max_work"_a)
+        .def("topk_docs", &engine_t::topk_docs, py::call_guard<py::gil_scoped_release>(), "query"_a, "k"_a, "max_work"_a, "sample_size"_a)
+        .def("find_cnf", &engine_t::find_cnf, py::call_guard<py::gil_scoped_release>(), "cnf"_a, "max_docs"_a, "max_work"_a)
+        .def("count_by_attribute", &engine_t::count_by_attribute, py::call_guard<py::gil_scoped_release>(), "query"_a, "attr"_a, "max_work"_a, "sample_size"_a)
+        .def("get_doc_by_rank", &engine_t::get_doc_by_rank, py::call_guard<py::gil_scoped_release>(), "s"_a, "rank"_a, "needle_len"_a, "max_ctx_len"_a)
+        .def("get_doc_by_token_rank", &engine_t::get_doc_by_token_rank, py::call_guard<py::gil_scoped_release>(), "s"_a, "rank"_a, "needle_len"_a, "max_ctx_len"_a)
+        .def("get_doc_field", &engine_t::get_doc_field, "doc_ix"_a, "field"_a)
+        .def("get_doc_dups", &engine_t::get_doc_dups, "doc_ix"_a, "max_cnt"_a)
+        .def("set_profiling", &engine_t::set_profiling, "enabled"_a)
+        .def("set_use_kgram_table", &engine_t::set_use_kgram_table, "enabled"_a)
+        .def("set_interleaved_search", &engine_t::set_interleaved_search, "enabled"_a)
+        .def("shard_nodes", &engine_t::shard_nodes)
+        .def("shard_load_seconds", &engine_t::shard_load_seconds)
+        .def("stats", &engine_t::stats)
+        .def("enable_cache", &engine_t::enable_cache, "max_bytes"_a, "max_doc_bytes"_a)
+        .def("disable_cache", &engine_t::disable_cache)
+        .def("clear_cache", &engine_t::clear_cache)
+        .def("cache_stats", &engine_t::cache_stats)
+        .def("save_cache", &engine_t::save_cache, py::call_guard<py::gil_scoped_release>(), "path"_a)
+        .def("load_cache", &engine_t::load_cache, py::call_guard<py::gil_scoped_release>(), "path"_a);
+}
+
 PYBIND11_MODULE(cpp_engine, m) {
 
+    py::class_<QueryProfile>(m, "QueryProfile")
+        .def_readwrite("search_us_by_shard", &QueryProfile::search_us_by_shard)
+        .def_readwrite("locate_us", &QueryProfile::locate_us)
+        .def_readwrite("doc_search_us", &QueryProfile::doc_search_us)
+        .def_readwrite("extract_us", &QueryProfile::extract_us)
+        .def_readwrite("metadata_us", &QueryProfile::metadata_us)
+        .def_readwrite("lf_steps", &QueryProfile::lf_steps)
+        .def_readwrite("rank_calls", &QueryProfile::rank_calls)
+        .def_readwrite("minor_faults", &QueryProfile::minor_faults)
+        .def_readwrite("major_faults", &QueryProfile::major_faults);
+
+    py::class_<HistogramSummary>(m, "HistogramSummary")
+        .def_readwrite("count", &HistogramSummary::count)
+        .def_readwrite("mean_us", &HistogramSummary::mean_us)
+        .def_readwrite("p50_us", &HistogramSummary::p50_us)
+        .def_readwrite("p90_us", &HistogramSummary::p90_us)
+        .def_readwrite("p99_us", &HistogramSummary::p99_us)
+        .def_readwrite("max_us", &HistogramSummary::max_us);
+
+    py::class_<EngineStats>(m, "EngineStats")
+        .def_readwrite("latency", &EngineStats::latency)
+        .def_readwrite("counters", &EngineStats::counters);
+
+    py::class_<CacheStats>(m, "CacheStats")
+        .def_readwrite("hits", &CacheStats::hits)
+        .def_readwrite("misses", &CacheStats::misses)
+        .def_readwrite("insertions", &CacheStats::insertions)
+        .def_readwrite("evictions", &CacheStats::evictions)
+        .def_readwrite("entries", &CacheStats::entries)
+        .def_readwrite("bytes", &CacheStats::bytes)
+        .def_readwrite("max_bytes", &CacheStats::max_bytes);
+
     py::class_<FindResult>(m, "FindResult")
         .def_readwrite("cnt", &FindResult::cnt)
-        .def_readwrite("segment_by_shard", &FindResult::segment_by_shard);
+        .def_readwrite("segment_by_shard", &FindResult::segment_by_shard)
+        .def_readwrite("profile", &FindResult::profile);
 
     py::class_<CountResult>(m, "CountResult")
-        .def_readwrite("count", &CountResult::count);
+        .def_readwrite("count", &CountResult::count)
+        .def_readwrite("profile", &CountResult::profile);
 
     py::class_<DocResult>(m, "DocResult")
         .def_readwrite("doc_ix", &DocResult::doc_ix)
@@ -22,11 +98,77 @@ PYBIND11_MODULE(cpp_engine, m) {
         .def_readwrite("disp_len", &DocResult::disp_len)
         .def_readwrite("needle_offset", &DocResult::needle_offset)
         .def_readwrite("metadata", &DocResult::metadata)
-        .def_readwrite("text", &DocResult::text);
+        .def_readwrite("text", &DocResult::text)
+        .def_readwrite("dup_cnt", &DocResult::dup_cnt)
+        .def_readwrite("profile", &DocResult::profile);
+
+    py::class_<TokenDocResult>(m, "TokenDocResult")
+        .def_readwrite("doc_ix", &TokenDocResult::doc_ix)
+        .def_readwrite("doc_len", &TokenDocResult::doc_len)
+        .def_readwrite("disp_len", &TokenDocResult::disp_len)
+        .def_readwrite("needle_offset", &TokenDocResult::needle_offset)
+        .def_readwrite("metadata", &TokenDocResult::metadata)
+        .def_readwrite("token_ids", &TokenDocResult::token_ids);
+
+    py::class_<MatchingStatisticsResult>(m, "MatchingStatisticsResult")
+        .def_readwrite("len", &MatchingStatisticsResult::len)
+        .def_readwrite("len_by_shard", &MatchingStatisticsResult::len_by_shard)
+        .def_readwrite("segment_by_shard", &MatchingStatisticsResult::segment_by_shard);
+
+    py::class_<ContaminationResult>(m, "ContaminationResult")
+        .def_readwrite("num_windows", &ContaminationResult::num_windows)
+        .def_readwrite("num_contaminated", &ContaminationResult::num_contaminated)
+        .def_readwrite("ratio", &ContaminationResult::ratio)
+        .def_readwrite("spans", &ContaminationResult::spans);
+
+    py::class_<ApproxFindResult>(m, "ApproxFindResult")
+        .def_readwrite("cnt", &ApproxFindResult::cnt)
+        .def_readwrite("segments_by_shard", &ApproxFindResult::segments_by_shard)
+        .def_readwrite("complete", &ApproxFindResult::complete);
+
+    py::class_<ApproxCountResult>(m, "ApproxCountResult")
+        .def_readwrite("count", &ApproxCountResult::count)
+        .def_readwrite("complete", &ApproxCountResult::complete);
+
+    py::class_<DocCountResult>(m, "DocCountResult")
+        .def_readwrite("cnt", &DocCountResult::cnt)
+        .def_readwrite("count", &DocCountResult::count)
+        .def_readwrite("exact", &DocCountResult::exact)
+        .def_readwrite("ci_low", &DocCountResult::ci_low)
+        .def_readwrite("ci_high", &DocCountResult::ci_high);
+
+    py::class_<DupCountResult>(m, "DupCountResult")
+        .def_readwrite("cnt", &DupCountResult::cnt)
+        .def_readwrite("count", &DupCountResult::count)
+        .def_readwrite("exact", &DupCountResult::exact)
+        .def_readwrite("ci_low", &DupCountResult::ci_low)
+        .def_readwrite("ci_high", &DupCountResult::ci_high);
+
+    py::class_<DocListResult>(m, "DocListResult")
+        .def_readwrite("cnt", &DocListResult::cnt)
+        .def_readwrite("doc_ixs", &DocListResult::doc_ixs)
+        .def_readwrite("complete", &DocListResult::complete);
+
+    py::class_<TopKDocsResult>(m, "TopKDocsResult")
+        .def_readwrite("cnt", &TopKDocsResult::cnt)
+        .def_readwrite("doc_ixs", &TopKDocsResult::doc_ixs)
+        .def_readwrite("counts", &TopKDocsResult::counts)
+        .def_readwrite("exact", &TopKDocsResult::exact);
+
+    py::class_<AttributeCountResult>(m, "AttributeCountResult")
+        .def_readwrite("cnt", &AttributeCountResult::cnt)
+        .def_readwrite("values", &AttributeCountResult::values)
+        .def_readwrite("counts", &AttributeCountResult::counts)
+        .def_readwrite("ci_low", &AttributeCountResult::ci_low)
+        .def_readwrite("ci_high", &AttributeCountResult::ci_high)
+        .def_readwrite("exact", &AttributeCountResult::exact);
+
+    py::class_<CNFResult>(m, "CNFResult")
+        .def_readwrite("cnt", &CNFResult::cnt)
+        .def_readwrite("approx", &CNFResult::approx)
+        .def_readwrite("doc_ixs", &CNFResult::doc_ixs);
 
-    py::class_<Engine>(m, "Engine")
-        .def(py::init<const vector<string>, const bool, const bool>())
-        .def("find", &Engine::find, py::call_guard<py::gil_scoped_release>(), "query"_a)
-        .def("count", &Engine::count, py::call_guard<py::gil_scoped_release>(), "query"_a)
-        .def("get_doc_by_rank", &Engine::get_doc_by_rank, py::call_guard<py::gil_scoped_release>(), "s"_a, "rank"_a, "needle_len"_a, "max_ctx_len"_a);
+    bind_engine<Engine>(m, "Engine");
+    bind_engine<RLEngine>(m, "RLEngine");
+    bind_engine<ILEngine>(m, "ILEngine");
 }
@@ -1,4 +1,5 @@
 #include <sdsl/suffix_arrays.hpp>
+#include <sdsl/rmq_support.hpp>
 #include <string>
 #include <iostream>
 #include <vector>
@@ -7,10 +8,24 @@
 #include <mutex>
 #include <numeric>
 #include <chrono>
+#include <atomic>
+#include <array>
+#include <random>
+#include <unordered_set>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <cstring>
+#include <bitset>
+#include <stdexcept>
+#include <zstd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
 #include <typeinfo>
 #include <iostream>
 #include <fstream>
@@ -27,166 +42,2836 @@ typedef unsigned long char_t;
 
 typedef csa_wt<wt_huff<rrr_vector<127>>, 32, 64> index_t;
 typedef csa_wt<wt_huff<rrr_vector<127>>, 32, 64> meta_index_t;
+// run-length compressed BWT, for corpora with many near-duplicates (see src/bwt_runs.cpp)
+typedef csa_wt<wt_rlmn<>, 32, 64> rl_index_t;
+// data.fm9 converted by src/convert_rrr_il.cpp: the rrr rank samples of each superblock are in one cache line
+typedef csa_wt<wt_huff<rrr_vector_il<127>>, 32, 64> il_index_t;
 
+// Over the token ids of the docs (src/indexing.py --tokenizer): each doc is TOKEN_DOC_SEP followed by its token ids plus
+// TOKEN_ID_SHIFT, with doc ids shared with the byte index
+typedef csa_wt<wt_int<>, 32, 64, sa_order_sa_sampling<>, isa_sampling<>, int_alphabet<>> tok_index_t;
+const uint64_t TOKEN_DOC_SEP = 1;
+const uint64_t TOKEN_ID_SHIFT = 2;
+
+// The data index file of each index type in an index directory
+template <class t_index> const char* const data_index_file = "data.fm9";
+template <> const char* const data_index_file<rl_index_t> = "data.rl.fm9";
+template <> const char* const data_index_file<il_index_t> = "data.il.fm9";
+
+// SA intervals of all strings of length 1..k in a shard, built by src/kgram_table.cpp (see there for the file layout)
+struct KGramTable {
+    size_t k;
+    size_t cnt;
+    size_t* entries; // (key, lo, hi) triples sorted by key
+    vector<size_t> bucket_start; // first entry whose key starts with each 2-byte prefix, plus a sentinel
+
+    static size_t key(const char* begin, const size_t len) {
+        size_t bytes = 0;
+        for (size_t i = 0; i < len; i++) {
+            bytes |= (size_t)(uint8_t)begin[i] << (48 - 8 * i);
+        }
+        return (bytes << 8) | len;
+    }
+
+    // Returns false if the string does not occur in the shard
+    bool lookup(const char* begin, const size_t len, size_t& lo, size_t& hi) const {
+        size_t target = key(begin, len);
+        size_t l = bucket_start[target >> 48], r = bucket_start[(target >> 48) + 1];
+        while (l < r) {
+            size_t m = (l + r) >> 1;
+            if (entries[3 * m] < target) {
+                l = m + 1;
+            } else {
+                r = m;
+            }
+        }
+        if (l == bucket_start[(target >> 48) + 1] || entries[3 * l] != target) {
+            return false;
+        }
+        lo = entries[3 * l + 1];
+        hi = entries[3 * l + 2];
+        return true;
+    }
+};
+
+// Metadata of a shard as zstd-compressed blocks of JSON lines, written by src/indexing.py --meta_store (see there for the
+// file layout). A doc's metadata takes one block decode, rather than one LF step per byte as in meta.fm9.
+struct MetaStore {
+    struct Field {
+        string name;
+        size_t value_cnt;
+        const size_t* value_offsets;
+        const char* values;
+        const uint32_t* codes; // one per doc, UINT32_MAX if the doc has no value
+    };
+
+    const char* base;
+    size_t size; // of the mapping at base
+    size_t doc_cnt;
+    size_t block_cnt;
+    const size_t* block_offsets;
+    const size_t* doc_locs; // (block << 32) | offset within the decompressed block
+    vector<Field> fields;
+
+    MetaStore(const char* base, const size_t size) : base(base), size(size) {
+        assert (size >= 5 * sizeof(size_t) && memcmp(base, "IGMSTOR1", 8) == 0);
+        const size_t* header = (const size_t*)base;
+        doc_cnt = header[1];
+        block_cnt = header[2];
+        block_offsets = header + 5;
+        doc_locs = block_offsets + block_cnt + 1;
+        const size_t* p = (const size_t*)(base + header[4]);
+        for (size_t f = 0; f < header[3]; f++) {
+            Field field;
+            field.name = string((const char*)(p + 1), *p);
+            p += 1 + (*p + 7) / 8;
+            field.value_cnt = *p++;
+            field.value_offsets = p;
+            p += field.value_cnt + 1;
+            field.values = (const char*)p;
+            p += (field.value_offsets[field.value_cnt] + 7) / 8;
+            field.codes = (const uint32_t*)p;
+            p += (doc_cnt * sizeof(uint32_t) + 7) / 8;
+            fields.push_back(field);
+        }
+        assert ((const char*)p == base + size);
+    }
+
+    // The metadata line of a doc, without the trailing \n
+    string get(const size_t doc_ix) const {
+        assert (doc_ix < doc_cnt);
+        const size_t block = doc_locs[doc_ix] >> 32, offset = doc_locs[doc_ix] & 0xffffffff;
+        const char* frame = base + block_offsets[block];
+        const size_t frame_size = block_offsets[block + 1] - block_offsets[block];
+        const auto block_size = ZSTD_getFrameContentSize(frame, frame_size);
+        assert (block_size != ZSTD_CONTENTSIZE_UNKNOWN && block_size != ZSTD_CONTENTSIZE_ERROR);
+        // one decompression context per thread, as creating one costs about as much as decoding a small block
+        thread_local unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        string buf(block_size, '\0');
+        const size_t ret = ZSTD_decompressDCtx(dctx.get(), buf.data(), block_size, frame, frame_size);
+        assert (!ZSTD_isError(ret) && ret == block_size);
+        const size_t end = buf.find('\n', offset);
+        assert (end != string::npos);
+        return buf.substr(offset, end - offset);
+    }
+
+    // Index of the dictionary-encoded field with the given name, or -1
+    int field_index(const string& name) const {
+        for (size_t f = 0; f < fields.size(); f++) {
+            if (fields[f].name == name) return f;
+        }
+        return -1;
+    }
+
+    // Returns false if the doc has no value for the field
+    bool get_field(const size_t f, const size_t doc_ix, string& value) const {
+        assert (f < fields.size() && doc_ix < doc_cnt);
+        const auto& field = fields[f];
+        const uint32_t code = field.codes[doc_ix];
+        if (code == UINT32_MAX) return false;
+        value.assign(field.values + field.value_offsets[code], field.value_offsets[code + 1] - field.value_offsets[code]);
+        return true;
+    }
+};
+
+// A dictionary-encoded metadata field of every doc in a shard, built by src/indexing.py --doc_attrs (see there for the
+// file layout); loaded into memory, as it takes a few bits per doc
+struct DocAttribute {
+    int_vector<> codes; // by doc ix
+    vector<string> values; // by code; "" for docs without the field
+
+    DocAttribute(const string& path) {
+        load_from_file(codes, path);
+        ifstream fin(path + ".dict", ios::binary);
+        assert (fin.is_open());
+        size_t value_cnt;
+        fin.read((char*)&value_cnt, sizeof(size_t));
+        vector<size_t> value_offsets(value_cnt + 1);
+        fin.read((char*)value_offsets.data(), value_offsets.size() * sizeof(size_t));
+        string bytes(value_offsets.back(), '\0');
+        fin.read(bytes.data(), bytes.size());
+        assert (fin.good());
+        for (size_t v = 0; v < value_cnt; v++) {
+            values.push_back(bytes.substr(value_offsets[v], value_offsets[v + 1] - value_offsets[v]));
+        }
+    }
+};
+
+// The docs of a shard's corpus that src/indexing.py --dedup collapsed into a doc with the same text (see there for the
+// file layout): the metadata lines of each doc's duplicates, which are not in the index themselves
+struct DocDups {
+    const char* base;
+    size_t size; // of the mapping at base
+    size_t doc_cnt;
+    size_t dup_cnt;
+    const size_t* dup_starts; // the dups of doc d are [dup_starts[d], dup_starts[d + 1])
+    const size_t* meta_offsets;
+    const char* lines;
+
+    DocDups(const char* base, const size_t size) : base(base), size(size) {
+        assert (size >= 3 * sizeof(size_t) && memcmp(base, "IGMDUPS1", 8) == 0);
+        const size_t* header = (const size_t*)base;
+        doc_cnt = header[1];
+        dup_cnt = header[2];
+        dup_starts = header + 3;
+        meta_offsets = dup_starts + doc_cnt + 1;
+        lines = (const char*)(meta_offsets + dup_cnt + 1);
+        assert (lines + meta_offsets[dup_cnt] == base + size);
+    }
+
+    size_t count(const size_t doc_ix) const {
+        assert (doc_ix < doc_cnt);
+        return dup_starts[doc_ix + 1] - dup_starts[doc_ix];
+    }
+
+    // The metadata line of the i-th dup of a doc, without the trailing \n
+    string get(const size_t doc_ix, const size_t i) const {
+        assert (i < count(doc_ix));
+        const size_t dup = dup_starts[doc_ix] + i;
+        return string(lines + meta_offsets[dup], meta_offsets[dup + 1] - meta_offsets[dup] - 1);
+    }
+};
+
+// A restricted regex over bytes, compiled into a Thompson NFA that reads the text right to left (see Engine::find_regex).
+// Supports literals, ., [...] and [^...] classes, \d \w \s \D \W \S, groups, |, and the quantifiers ? * + {m} {m,} {m,n}.
+// . and negated classes never match the document separator \xff. Throws invalid_argument on a malformed pattern.
+class ByteRegex {
+public:
+    struct State {
+        bitset<256> bytes; // if any, consuming one of them moves to next
+        int next = -1;
+        vector<int> eps;
+    };
+    vector<State> states;
+    int start, match;
+
+    static const size_t MAX_REPEAT = 1000;
+
+    explicit ByteRegex(const string& pattern) : _p(pattern), _pos(0) {
+        auto node = _parse_alt();
+        if (_pos != _p.size()) _fail("unmatched )");
+        auto [s, e] = _compile(node);
+        start = s;
+        match = e;
+        auto init = closure({start});
+        if (binary_search(init.begin(), init.end(), match)) {
+            throw invalid_argument("regex must not match the empty string");
+        }
+    }
+
+    // The sorted set of states reachable from the given ones by epsilon moves
+    vector<int> closure(const vector<int>& from) const {
+        vector<char> seen(states.size(), 0);
+        vector<int> stack = from, result;
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            if (seen[u]) continue;
+            seen[u] = 1;
+            result.push_back(u);
+            for (int v : states[u].eps) stack.push_back(v);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+private:
+    struct Node {
+        enum { BYTES, CONCAT, ALT, REPEAT } type = BYTES;
+        bitset<256> bytes{};
+        vector<Node> children{};
+        size_t min = 0, max = 0; // max == SIZE_MAX for unbounded
+    };
+
+    string _p;
+    size_t _pos;
+
+    [[noreturn]] void _fail(const string& message) const {
+        throw invalid_argument("invalid regex at position " + to_string(_pos) + ": " + message);
+    }
+
+    static bitset<256> _any() {
+        bitset<256> bytes;
+        bytes.set();
+        bytes.reset(0xff);
+        return bytes;
+    }
+
+    Node _parse_alt() {
+        Node node{Node::ALT};
+        node.children.push_back(_parse_concat());
+        while (_pos < _p.size() && _p[_pos] == '|') {
+            _pos++;
+            node.children.push_back(_parse_concat());
+        }
+        return node.children.size() == 1 ? node.children[0] : node;
+    }
+
+    Node _parse_concat() {
+        Node node{Node::CONCAT};
+        while (_pos < _p.size() && _p[_pos] != '|' && _p[_pos] != ')') {
+            node.children.push_back(_parse_repeat());
+        }
+        return node;
+    }
+
+    Node _parse_repeat() {
+        Node node = _parse_atom();
+        while (_pos < _p.size()) {
+            char c = _p[_pos];
+            size_t min, max;
+            if (c == '?') { min = 0; max = 1; }
+            else if (c == '*') { min = 0; max = SIZE_MAX; }
+            else if (c == '+') { min = 1; max = SIZE_MAX; }
+            else if (c == '{') {
+                _pos++;
+                min = max = _parse_number();
+                if (_pos < _p.size() && _p[_pos] == ',') {
+                    _pos++;
+                    max = _pos < _p.size() && _p[_pos] == '}' ? SIZE_MAX : _parse_number();
+                }
+                if (_pos >= _p.size() || _p[_pos] != '}') _fail("expected }");
+                if (min > max || (max != SIZE_MAX && max > MAX_REPEAT)) _fail("bad repetition bounds");
+            } else {
+                break;
+            }
+            _pos++;
+            Node repeat{Node::REPEAT};
+            repeat.children.push_back(node);
+            repeat.min = min;
+            repeat.max = max;
+            node = repeat;
+        }
+        return node;
+    }
+
+    size_t _parse_number() {
+        size_t begin = _pos, value = 0;
+        while (_pos < _p.size() && isdigit((uint8_t)_p[_pos]) && value <= MAX_REPEAT) {
+            value = value * 10 + (_p[_pos++] - '0');
+        }
+        if (_pos == begin || value > MAX_REPEAT) _fail("bad repetition count");
+        return value;
+    }
+
+    Node _parse_atom() {
+        Node node{Node::BYTES};
+        char c = _p[_pos++];
+        if (c == '(') {
+            node = _parse_alt();
+            if (_pos >= _p.size() || _p[_pos] != ')') _fail("expected )");
+            _pos++;
+        } else if (c == '[') {
+            node.bytes = _parse_class();
+        } else if (c == '.') {
+            node.bytes = _any();
+        } else if (c == '\\') {
+            node.bytes = _parse_escape();
+        } else if (c == '*' || c == '+' || c == '?' || c == '{') {
+            _pos--;
+            _fail("nothing to repeat");
+        } else {
+            node.bytes.set((uint8_t)c);
+        }
+        return node;
+    }
+
+    bitset<256> _parse_escape() {
+        if (_pos >= _p.size()) _fail("trailing \\");
+        char c = _p[_pos++];
+        bitset<256> bytes;
+        switch (c) {
+            case 'd': case 'D':
+                for (int b = '0'; b <= '9'; b++) bytes.set(b);
+                break;
+            case 'w': case 'W':
+                for (int b = 0; b < 256; b++) if (isalnum(b) || b == '_') bytes.set(b);
+                break;
+            case 's': case 'S':
+                for (char b : string(" \t\n\r\f\v")) bytes.set((uint8_t)b);
+                break;
+            case 'n': bytes.set('\n'); return bytes;
+            case 't': bytes.set('\t'); return bytes;
+            case 'r': bytes.set('\r'); return bytes;
+            case 'x': {
+                if (_pos + 2 > _p.size() || !isxdigit((uint8_t)_p[_pos]) || !isxdigit((uint8_t)_p[_pos + 1])) _fail("bad \\x escape");
+                bytes.set(stoi(_p.substr(_pos, 2), nullptr, 16));
+                _pos += 2;
+                return bytes;
+            }
+            default: bytes.set((uint8_t)c); return bytes;
+        }
+        return isupper(c) ? ~bytes & _any() : bytes;
+    }
+
+    bitset<256> _parse_class() {
+        bool negate = _pos < _p.size() && _p[_pos] == '^';
+        if (negate) _pos++;
+        bitset<256> bytes;
+        bool first = true;
+        while (true) {
+            if (_pos >= _p.size()) _fail("expected ]");
+            char c = _p[_pos];
+            if (c == ']' && !first) break;
+            first = false;
+            _pos++;
+            if (c == '\\') {
+                bytes |= _parse_escape();
+                continue;
+            }
+            if (_pos + 1 < _p.size() && _p[_pos] == '-' && _p[_pos + 1] != ']') {
+                uint8_t lo = c, hi = _p[_pos + 1];
+                if (lo > hi) _fail("bad class range");
+                for (int b = lo; b <= hi; b++) bytes.set(b);
+                _pos += 2;
+            } else {
+                bytes.set((uint8_t)c);
+            }
+        }
+        _pos++;
+        return negate ? ~bytes & _any() : bytes;
+    }
+
+    int _new_state() {
+        states.emplace_back();
+        return states.size() - 1;
+    }
+
+    // Returns the (entry, exit) states of a fragment; concatenations are compiled back to front so that the NFA reads
+    // the text right to left
+    pair<int, int> _compile(const Node& node) {
+        switch (node.type) {
+            case Node::BYTES: {
+                int s = _new_state(), e = _new_state();
+                states[s].bytes = node.bytes;
+                states[s].next = e;
+                return {s, e};
+            }
+            case Node::CONCAT: {
+                int s = _new_state(), e = s;
+                for (auto it = node.children.rbegin(); it != node.children.rend(); it++) {
+                    auto [cs, ce] = _compile(*it);
+                    states[e].eps.push_back(cs);
+                    e = ce;
+                }
+                return {s, e};
+            }
+            case Node::ALT: {
+                int s = _new_state(), e = _new_state();
+                for (const auto &child : node.children) {
+                    auto [cs, ce] = _compile(child);
+                    states[s].eps.push_back(cs);
+                    states[ce].eps.push_back(e);
+                }
+                return {s, e};
+            }
+            case Node::REPEAT: {
+                // min required copies, then max - min optional ones (nested, so that skipping one skips the rest), or a loop
+                int s = _new_state(), e = s;
+                for (size_t i = 0; i < node.min; i++) {
+                    auto [cs, ce] = _compile(node.children[0]);
+                    states[e].eps.push_back(cs);
+                    e = ce;
+                }
+                if (node.max == SIZE_MAX) {
+                    auto [cs, ce] = _compile(node.children[0]);
+                    int end = _new_state();
+                    states[e].eps.push_back(cs);
+                    states[e].eps.push_back(end);
+                    states[ce].eps.push_back(cs);
+                    states[ce].eps.push_back(end);
+                    return {s, end};
+                }
+                int end = _new_state();
+                for (size_t i = node.min; i < node.max; i++) {
+                    auto [cs, ce] = _compile(node.children[0]);
+                    states[e].eps.push_back(cs);
+                    states[e].eps.push_back(end);
+                    e = ce;
+                }
+                states[e].eps.push_back(end);
+                return {s, end};
+            }
+        }
+        return {-1, -1};
+    }
+};
+
+template <class index_t>
 struct FMIndexShard {
     index_t* data_index;
     size_t* data_offset;
     meta_index_t* meta_index;
     size_t* meta_offset;
     size_t doc_cnt;
+    KGramTable* kgram_table; // nullptr if the shard has no data.kgram
+    rmq_succinct_sct<true>* doc_rmq; // nullptr if the shard has no data.doc_rmq; see src/doc_rmq.cpp
+    MetaStore* meta_store; // nullptr if the shard has no meta.store, in which case metadata comes from meta.fm9
+    unordered_map<string, DocAttribute*> doc_attrs; // by field, from the doc_attr.<field> files
+    tok_index_t* tok_index; // nullptr if the shard has no data.tok.fm9
+    size_t* tok_offset; // position of each doc's TOKEN_DOC_SEP in the token index
+    DocDups* doc_dups; // nullptr if the shard has no doc_dups
+};
+
+// Per-query breakdown, only filled in when profiling is enabled (see Engine::set_profiling)
+struct QueryProfile {
+    vector<double> search_us_by_shard; // backward search
+    double locate_us = 0; // SA lookup of a rank
+    double doc_search_us = 0; // binary search over data_offset
+    double extract_us = 0; // text extraction
+    double metadata_us = 0; // metadata extraction
+    size_t lf_steps = 0;
+    size_t rank_calls = 0; // wavelet tree rank / inverse_select operations
+    size_t minor_faults = 0;
+    size_t major_faults = 0;
+
+    void merge(const QueryProfile& other) {
+        locate_us += other.locate_us;
+        doc_search_us += other.doc_search_us;
+        extract_us += other.extract_us;
+        metadata_us += other.metadata_us;
+        lf_steps += other.lf_steps;
+        rank_calls += other.rank_calls;
+        minor_faults += other.minor_faults;
+        major_faults += other.major_faults;
+    }
 };
 
 struct FindResult {
     size_t cnt;
     vector<pair<size_t, size_t>> segment_by_shard; // left inclusive, right exclusive
+    QueryProfile profile;
+};
+
+struct CountResult {
+    size_t count;
+    QueryProfile profile;
+};
+
+// A document around an occurrence in the token index; lengths and offsets are in tokens
+struct TokenDocResult {
+    size_t doc_ix;
+    size_t doc_len;
+    size_t disp_len;
+    size_t needle_offset;
+    string metadata;
+    vector<uint32_t> token_ids;
+};
+
+struct ApproxFindResult {
+    size_t cnt; // text positions where a match starts
+    vector<vector<pair<size_t, size_t>>> segments_by_shard; // sorted and disjoint; left inclusive, right exclusive
+    bool complete; // false if max_work ran out, in which case cnt is a lower bound
+};
+
+struct ApproxCountResult {
+    size_t count;
+    bool complete;
+};
+
+struct DocResult {
+    size_t doc_ix;
+    size_t doc_len;
+    size_t disp_len;
+    size_t needle_offset;
+    string metadata;
+    string text;
+    size_t dup_cnt; // other docs of the corpus with the same text, collapsed into this one (see get_doc_dups)
+    QueryProfile profile;
+};
+
+struct MatchingStatisticsResult {
+    vector<size_t> len; // len[i]: length of the longest prefix of text[i:] that occurs in any shard
+    vector<vector<size_t>> len_by_shard; // len_by_shard[s][i]: same, within shard s
+    vector<vector<pair<size_t, size_t>>> segment_by_shard; // segment_by_shard[s][i]: SA range of that prefix in shard s; left inclusive, right exclusive
+};
+
+struct ContaminationResult {
+    size_t num_windows;
+    size_t num_contaminated; // windows that occur verbatim in the index
+    double ratio;
+    vector<pair<size_t, size_t>> spans; // merged byte ranges covered by contaminated windows; left inclusive, right exclusive
+};
+
+struct DocCountResult {
+    size_t cnt; // occurrences of the query
+    double count; // distinct documents; an estimate unless exact
+    bool exact;
+    double ci_low; // 95% confidence interval of the estimate; equal to count if exact
+    double ci_high;
+};
+
+struct DupCountResult {
+    size_t cnt; // occurrences of the query in the index
+    double count; // occurrences in the corpus before src/indexing.py --dedup; an estimate unless exact
+    bool exact;
+    double ci_low; // 95% confidence interval of the estimate; equal to count if exact
+    double ci_high;
+};
+
+struct DocListResult {
+    size_t cnt; // occurrences of the query
+    vector<size_t> doc_ixs; // distinct documents, grouped by shard
+    bool complete; // whether doc_ixs holds every document containing the query
+};
+
+struct TopKDocsResult {
+    size_t cnt; // occurrences of the query
+    vector<size_t> doc_ixs; // by decreasing number of occurrences, then by doc ix
+    vector<size_t> counts; // occurrences in each document; always exact
+    bool exact; // whether doc_ixs is the true top k; otherwise its candidates came from a sample
+};
+
+struct AttributeCountResult {
+    size_t cnt; // occurrences of the query
+    vector<string> values; // attribute values seen among the (sampled) occurrences, by decreasing count, then by value
+    vector<double> counts; // occurrences with each value; estimates unless exact
+    vector<double> ci_low; // 95% confidence intervals of the estimates; equal to counts if exact
+    vector<double> ci_high;
+    bool exact;
+};
+
+struct CNFResult {
+    double cnt; // documents matching the query; an estimate if approx
+    bool approx;
+    vector<size_t> doc_ixs; // up to max_docs matching documents, grouped by shard
+};
+
+struct HistogramSummary {
+    size_t count;
+    double mean_us;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+};
+
+struct EngineStats {
+    map<string, HistogramSummary> latency;
+    map<string, size_t> counters;
+};
+
+// Lock-free latency histogram with 4 sub-buckets per power of two, covering 1us to ~1 hour
+class LatencyHistogram {
+
+public:
+
+    static constexpr size_t NUM_BUCKETS = 4 * 32;
+
+    LatencyHistogram () : _count(0), _sum_ns(0), _max_ns(0) {
+        for (auto &b : _buckets) b = 0;
+    }
+
+    void record(const double us) {
+        _buckets[_bucket(us)].fetch_add(1, memory_order_relaxed);
+        _count.fetch_add(1, memory_order_relaxed);
+        size_t ns = (size_t)(us * 1000);
+        _sum_ns.fetch_add(ns, memory_order_relaxed);
+        size_t prev = _max_ns.load(memory_order_relaxed);
+        while (prev < ns && !_max_ns.compare_exchange_weak(prev, ns, memory_order_relaxed)) {}
+    }
+
+    HistogramSummary summary() const {
+        array<size_t, NUM_BUCKETS> buckets;
+        size_t count = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; b++) {
+            buckets[b] = _buckets[b].load(memory_order_relaxed);
+            count += buckets[b];
+        }
+        double max_us = _max_ns.load(memory_order_relaxed) / 1000.0;
+        auto percentile = [&](const double p) {
+            if (count == 0) return 0.0;
+            size_t target = (size_t)ceil(p * count), seen = 0;
+            for (size_t b = 0; b < NUM_BUCKETS; b++) {
+                seen += buckets[b];
+                if (seen >= max(target, (size_t)1)) return min(_upper_bound(b), max_us);
+            }
+            return max_us;
+        };
+        return HistogramSummary{
+            .count = count,
+            .mean_us = count ? _sum_ns.load(memory_order_relaxed) / 1000.0 / count : 0.0,
+            .p50_us = percentile(0.50),
+            .p90_us = percentile(0.90),
+            .p99_us = percentile(0.99),
+            .max_us = max_us,
+        };
+    }
+
+private:
+
+    static size_t _bucket(const double us) {
+        if (us < 1.0) return 0;
+        int e;
+        double m = frexp(us, &e); // us = m * 2^e, m in [0.5, 1)
+        size_t b = (size_t)(e - 1) * 4 + (size_t)((m - 0.5) * 8);
+        return min(b, NUM_BUCKETS - 1);
+    }
+
+    static double _upper_bound(const size_t b) {
+        return ldexp(0.5 + (b % 4 + 1) / 8.0, (int)(b / 4) + 1);
+    }
+
+    array<atomic<size_t>, NUM_BUCKETS> _buckets;
+    atomic<size_t> _count;
+    atomic<size_t> _sum_ns;
+    atomic<size_t> _max_ns;
+};
+
+class PhaseTimer {
+
+public:
+
+    PhaseTimer () : _start(steady_clock::now()) {}
+
+    double elapsed_us() const {
+        return duration<double, micro>(steady_clock::now() - _start).count();
+    }
+
+private:
+
+    steady_clock::time_point _start;
+};
+
+// Page faults incurred by the calling thread so far
+inline pair<size_t, size_t> thread_page_faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return {usage.ru_minflt, usage.ru_majflt};
+}
+
+// The CPUs of each NUMA node that has any this process may run on, from /sys/devices/system/node, in node order.
+// Empty if the machine does not report its nodes (non-Linux, or no sysfs).
+inline vector<cpu_set_t> numa_node_cpus() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return {};
+    vector<pair<size_t, cpu_set_t>> nodes;
+    error_code ec;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        const string name = entry.path().filename();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !all_of(name.begin() + 4, name.end(), ::isdigit)) continue;
+        ifstream fin(entry.path() / "cpulist");
+        string list;
+        if (!getline(fin, list)) continue;
+        // e.g. "0-15,32-47"
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        istringstream ranges(list);
+        for (string range; getline(ranges, range, ','); ) {
+            if (range.empty()) continue;
+            size_t dash = range.find('-');
+            size_t first = stoull(range.substr(0, dash)), last = dash == string::npos ? first : stoull(range.substr(dash + 1));
+            for (size_t cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) CPU_SET(cpu, &cpus);
+            }
+        }
+        if (CPU_COUNT(&cpus) > 0) {
+            nodes.emplace_back(stoull(name.substr(4)), cpus);
+        }
+    }
+    sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    vector<cpu_set_t> result;
+    for (const auto& [_, cpus] : nodes) result.push_back(cpus);
+    return result;
+}
+
+struct EngineProfiler {
+    LatencyHistogram find;
+    LatencyHistogram search; // per shard
+    LatencyHistogram get_doc_by_rank;
+    LatencyHistogram locate;
+    LatencyHistogram doc_search;
+    LatencyHistogram extract;
+    LatencyHistogram metadata;
+    atomic<size_t> lf_steps{0};
+    atomic<size_t> rank_calls{0};
+    atomic<size_t> minor_faults{0};
+    atomic<size_t> major_faults{0};
+
+    void add_counters(const QueryProfile& profile) {
+        lf_steps.fetch_add(profile.lf_steps, memory_order_relaxed);
+        rank_calls.fetch_add(profile.rank_calls, memory_order_relaxed);
+        minor_faults.fetch_add(profile.minor_faults, memory_order_relaxed);
+        major_faults.fetch_add(profile.major_faults, memory_order_relaxed);
+    }
+
+    EngineStats stats() const {
+        return EngineStats{
+            .latency = {
+                {"find", find.summary()},
+                {"search", search.summary()},
+                {"get_doc_by_rank", get_doc_by_rank.summary()},
+                {"locate", locate.summary()},
+                {"doc_search", doc_search.summary()},
+                {"extract", extract.summary()},
+                {"metadata", metadata.summary()},
+            },
+            .counters = {
+                {"lf_steps", lf_steps.load(memory_order_relaxed)},
+                {"rank_calls", rank_calls.load(memory_order_relaxed)},
+                {"minor_faults", minor_faults.load(memory_order_relaxed)},
+                {"major_faults", major_faults.load(memory_order_relaxed)},
+            },
+        };
+    }
 };
 
-struct CountResult {
-    size_t count;
-};
+// Byte-bounded, partitioned LRU cache of FindResults and small DocResults (see Engine::enable_cache).
+// Each partition has its own lock, so concurrent queries from GIL-released Python threads rarely contend.
+// Keys embed the epoch of the shards they depend on, so results computed against another version of a shard never hit.
+struct CacheStats {
+    size_t hits;
+    size_t misses;
+    size_t insertions;
+    size_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+class ResultCache {
+
+public:
+
+    static constexpr size_t NUM_PARTITIONS = 64;
+    static constexpr size_t ENTRY_OVERHEAD = 96; // list node, hash node and bookkeeping, roughly
+    static constexpr uint64_t FILE_MAGIC = 0x32454843414d4749ULL; // "IGMACHE2" in little-endian
+
+    ResultCache (const size_t max_bytes, const size_t max_doc_bytes)
+            : _max_bytes(max_bytes), _max_doc_bytes(max_doc_bytes), _partitions(NUM_PARTITIONS),
+              _hits(0), _misses(0), _insertions(0), _evictions(0) {}
+
+    static string find_key(const uint64_t index_epoch, const string& query) {
+        string key(1, 'F');
+        _append(key, index_epoch);
+        key += query;
+        return key;
+    }
+
+    static string doc_key(const uint64_t shard_epoch, const size_t s, const size_t rank, const size_t needle_len, const size_t max_ctx_len) {
+        string key(1, 'D');
+        _append(key, shard_epoch);
+        _append(key, s);
+        _append(key, rank);
+        _append(key, needle_len);
+        _append(key, max_ctx_len);
+        return key;
+    }
+
+    bool get_find(const string& key, FindResult& out) {
+        return _get(key, [&](const Entry& e) { out = e.find_result; });
+    }
+
+    void put_find(const string& key, const FindResult& result) {
+        Entry entry;
+        entry.key = key;
+        entry.is_doc = false;
+        entry.find_result = FindResult{ .cnt = result.cnt, .segment_by_shard = result.segment_by_shard, .profile = {}, };
+        entry.bytes = ENTRY_OVERHEAD + key.size() + result.segment_by_shard.size() * sizeof(pair<size_t, size_t>);
+        _put(move(entry));
+    }
+
+    bool get_doc(const string& key, DocResult& out) {
+        return _get(key, [&](const Entry& e) { out = e.doc_result; });
+    }
+
+    void put_doc(const string& key, const DocResult& result) {
+        size_t payload = result.text.size() + result.metadata.size();
+        if (payload > _max_doc_bytes) {
+            return;
+        }
+        Entry entry;
+        entry.key = key;
+        entry.is_doc = true;
+        entry.doc_result = result;
+        entry.doc_result.profile = {};
+        entry.bytes = ENTRY_OVERHEAD + key.size() + sizeof(DocResult) + payload;
+        _put(move(entry));
+    }
+
+    void clear() {
+        for (auto &p : _partitions) {
+            lock_guard<mutex> lock(p.mtx);
+            p.lru.clear();
+            p.map.clear();
+            p.bytes = 0;
+        }
+    }
+
+    CacheStats stats() const {
+        size_t entries = 0, bytes = 0;
+        for (auto &p : _partitions) {
+            lock_guard<mutex> lock(p.mtx);
+            entries += p.map.size();
+            bytes += p.bytes;
+        }
+        return CacheStats{
+            .hits = _hits.load(memory_order_relaxed),
+            .misses = _misses.load(memory_order_relaxed),
+            .insertions = _insertions.load(memory_order_relaxed),
+            .evictions = _evictions.load(memory_order_relaxed),
+            .entries = entries,
+            .bytes = bytes,
+            .max_bytes = _max_bytes,
+        };
+    }
+
+    // Writes entries from most to least recently used, so that a later load() of a smaller cache keeps the hottest ones.
+    // The epochs are stored alongside, and load() drops entries of shards whose epoch has changed.
+    size_t save(const string& path, const vector<uint64_t>& shard_epochs) const {
+        ofstream fout(path, ios::binary | ios::trunc);
+        assert (fout.is_open());
+        _write(fout, FILE_MAGIC);
+        _write(fout, (uint64_t)shard_epochs.size());
+        for (auto epoch : shard_epochs) _write(fout, epoch);
+
+        size_t cnt = 0;
+        // interleave partitions by recency rank, so that the file order approximates global recency
+        vector<vector<Entry>> snapshot(NUM_PARTITIONS);
+        for (size_t i = 0; i < NUM_PARTITIONS; i++) {
+            lock_guard<mutex> lock(_partitions[i].mtx);
+            snapshot[i].assign(_partitions[i].lru.begin(), _partitions[i].lru.end());
+        }
+        for (size_t r = 0; ; r++) {
+            bool any = false;
+            for (auto &entries : snapshot) {
+                if (r >= entries.size()) continue;
+                any = true;
+                _write_entry(fout, entries[r]);
+                cnt++;
+            }
+            if (!any) break;
+        }
+        return cnt;
+    }
+
+    size_t load(const string& path, const vector<uint64_t>& shard_epochs) {
+        ifstream fin(path, ios::binary);
+        if (!fin.is_open() || _read<uint64_t>(fin) != FILE_MAGIC) {
+            return 0;
+        }
+        uint64_t num_shards = _read<uint64_t>(fin);
+        vector<uint64_t> saved_epochs(num_shards);
+        for (auto &epoch : saved_epochs) epoch = _read<uint64_t>(fin);
+        bool index_unchanged = (saved_epochs == shard_epochs);
+
+        vector<Entry> entries;
+        Entry entry;
+        while (_read_entry(fin, entry)) {
+            if (entry.is_doc) {
+                size_t s = entry.doc_shard;
+                if (s >= shard_epochs.size() || s >= saved_epochs.size() || saved_epochs[s] != shard_epochs[s]) continue;
+            } else if (!index_unchanged) {
+                continue;
+            }
+            entries.push_back(move(entry));
+            entry = Entry();
+        }
+        // insert coldest first, so that the hottest entries end up most recently used
+        size_t cnt = 0;
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+            _put(move(*it), false);
+            cnt++;
+        }
+        return cnt;
+    }
+
+private:
+
+    struct Entry {
+        string key;
+        bool is_doc = false;
+        size_t doc_shard = 0;
+        size_t bytes = 0;
+        FindResult find_result;
+        DocResult doc_result;
+    };
+
+    struct Partition {
+        mutable mutex mtx;
+        list<Entry> lru; // front is most recently used
+        unordered_map<string, list<Entry>::iterator> map;
+        size_t bytes = 0;
+    };
+
+    template <class F>
+    bool _get(const string& key, F&& copy_out) {
+        auto &p = _partition(key);
+        {
+            lock_guard<mutex> lock(p.mtx);
+            auto it = p.map.find(key);
+            if (it != p.map.end()) {
+                p.lru.splice(p.lru.begin(), p.lru, it->second);
+                copy_out(*it->second);
+                _hits.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+        }
+        _misses.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    void _put(Entry entry, const bool count_insertion = true) {
+        if (entry.is_doc) {
+            memcpy(&entry.doc_shard, entry.key.data() + 1 + sizeof(uint64_t), sizeof(size_t));
+        }
+        size_t budget = _max_bytes / NUM_PARTITIONS;
+        if (entry.bytes > budget) {
+            return;
+        }
+        auto &p = _partition(entry.key);
+        lock_guard<mutex> lock(p.mtx);
+        auto it = p.map.find(entry.key);
+        if (it != p.map.end()) {
+            p.bytes -= it->second->bytes;
+            p.lru.erase(it->second);
+            p.map.erase(it);
+        }
+        p.bytes += entry.bytes;
+        p.lru.push_front(move(entry));
+        p.map[p.lru.front().key] = p.lru.begin();
+        if (count_insertion) {
+            _insertions.fetch_add(1, memory_order_relaxed);
+        }
+        while (p.bytes > budget) {
+            auto &victim = p.lru.back();
+            p.bytes -= victim.bytes;
+            p.map.erase(victim.key);
+            p.lru.pop_back();
+            _evictions.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    Partition& _partition(const string& key) {
+        return _partitions[hash<string>()(key) % NUM_PARTITIONS];
+    }
+
+    static void _append(string& key, const uint64_t v) {
+        key.append((const char*)&v, sizeof(v));
+    }
+
+    template <class T>
+    static void _write(ostream& out, const T& v) {
+        out.write((const char*)&v, sizeof(T));
+    }
+
+    static void _write(ostream& out, const string& v) {
+        _write(out, (uint64_t)v.size());
+        out.write(v.data(), v.size());
+    }
+
+    template <class T>
+    static T _read(istream& in) {
+        T v{};
+        in.read((char*)&v, sizeof(T));
+        return v;
+    }
+
+    static bool _read_string(istream& in, string& v) {
+        uint64_t len = _read<uint64_t>(in);
+        if (!in || len > (1ULL << 32)) return false;
+        v.resize(len);
+        in.read(v.data(), len);
+        return (bool)in;
+    }
+
+    static void _write_entry(ostream& out, const Entry& e) {
+        _write(out, e.key);
+        _write(out, (uint8_t)e.is_doc);
+        _write(out, (uint64_t)e.bytes);
+        if (e.is_doc) {
+            const auto &d = e.doc_result;
+            for (auto v : {d.doc_ix, d.doc_len, d.disp_len, d.needle_offset}) _write(out, (uint64_t)v);
+            _write(out, d.metadata);
+            _write(out, d.text);
+            _write(out, (uint64_t)d.dup_cnt);
+        } else {
+            const auto &f = e.find_result;
+            _write(out, (uint64_t)f.cnt);
+            _write(out, (uint64_t)f.segment_by_shard.size());
+            for (auto [lo, hi] : f.segment_by_shard) {
+                _write(out, (uint64_t)lo);
+                _write(out, (uint64_t)hi);
+            }
+        }
+    }
+
+    static bool _read_entry(istream& in, Entry& e) {
+        if (!_read_string(in, e.key) || e.key.empty()) return false;
+        e.is_doc = _read<uint8_t>(in);
+        e.bytes = _read<uint64_t>(in);
+        if (e.is_doc) {
+            if (e.key.size() < 1 + sizeof(uint64_t) + sizeof(size_t)) return false;
+            memcpy(&e.doc_shard, e.key.data() + 1 + sizeof(uint64_t), sizeof(size_t)); // for load() to check its epoch
+            auto &d = e.doc_result;
+            d.doc_ix = _read<uint64_t>(in);
+            d.doc_len = _read<uint64_t>(in);
+            d.disp_len = _read<uint64_t>(in);
+            d.needle_offset = _read<uint64_t>(in);
+            if (!_read_string(in, d.metadata) || !_read_string(in, d.text)) return false;
+            d.dup_cnt = _read<uint64_t>(in);
+        } else {
+            auto &f = e.find_result;
+            f.cnt = _read<uint64_t>(in);
+            uint64_t n = _read<uint64_t>(in);
+            if (!in || n > (1ULL << 20)) return false;
+            f.segment_by_shard.resize(n);
+            for (auto &seg : f.segment_by_shard) {
+                seg.first = _read<uint64_t>(in);
+                seg.second = _read<uint64_t>(in);
+            }
+        }
+        return (bool)in;
+    }
+
+private:
+
+    size_t _max_bytes;
+    size_t _max_doc_bytes;
+    vector<Partition> _partitions;
+    atomic<size_t> _hits;
+    atomic<size_t> _misses;
+    atomic<size_t> _insertions;
+    atomic<size_t> _evictions;
+};
+
+// The search engine over shards of one index type; see the Engine, RLEngine and ILEngine typedefs below
+template <class index_t>
+class BasicEngine {
+
+public:
+
+    // Shards are loaded concurrently by load_threads threads (0: as many as there are cores), and within a shard,
+    // meta.fm9 and data.tok.fm9 are read alongside data.fm9; shard_load_seconds() reports how long each shard took.
+    //
+    // With numa_aware, shard s is placed on NUMA node s % (number of nodes): it is loaded by a thread pinned to the
+    // node's CPUs, so that in RAM mode its pages are allocated there on first touch, and every thread later working on
+    // the shard (search, locate, extract) is pinned to the same node. In mmap mode, the page cache pages of a shard are
+    // likewise allocated on the node of the pinned thread that first faults them in.
+    BasicEngine (const vector<string> index_dirs, bool load_to_ram, bool get_metadata, bool numa_aware = false, size_t load_threads = 0)
+            : _load_to_ram(load_to_ram), _get_metadata(get_metadata) {
+
+        _num_shards = index_dirs.size();
+        assert(_num_shards > 0);
+        if (numa_aware) {
+            _node_cpus = numa_node_cpus();
+        }
+        for (size_t s = 0; s < _num_shards; s++) {
+            _shard_nodes.push_back(_node_cpus.empty() ? 0 : s % _node_cpus.size());
+        }
+
+        _shards.resize(_num_shards);
+        _shard_epochs.resize(_num_shards);
+        _shard_load_seconds.resize(_num_shards);
+        if (load_threads == 0) {
+            load_threads = max(thread::hardware_concurrency(), 1u);
+        }
+        atomic<size_t> next{0};
+        vector<thread> threads;
+        for (size_t t = 0; t < min(load_threads, _num_shards); t++) {
+            threads.emplace_back([&]() {
+                for (size_t s; (s = next.fetch_add(1)) < _num_shards; ) {
+                    _pin_to_shard_node(s);
+                    _load_shard(s, index_dirs[s]);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        _index_epoch = 0;
+        for (auto epoch : _shard_epochs) {
+            _index_epoch = _fnv1a(&epoch, sizeof(epoch), _index_epoch);
+        }
+    }
+
+    ~BasicEngine() {
+
+        for (auto& shard : _shards) {
+            if (_load_to_ram) {
+                delete shard.data_index;
+                delete shard.meta_index;
+                delete shard.tok_index;
+            } else {
+                munmap(shard.data_index, shard.data_index->size());
+                if (shard.meta_index) {
+                    munmap(shard.meta_index, shard.meta_index->size());
+                }
+                if (shard.tok_index) {
+                    munmap(shard.tok_index, shard.tok_index->size());
+                }
+            }
+            if (shard.tok_offset) {
+                munmap(shard.tok_offset, shard.doc_cnt * sizeof(size_t));
+            }
+            // TODO: munmap data_offset and meta_offset
+            if (shard.kgram_table) {
+                // entries follow the (k, cnt) header of the mapped data.kgram
+                munmap(shard.kgram_table->entries - 2, (2 + 3 * shard.kgram_table->cnt) * sizeof(size_t));
+            }
+            delete shard.kgram_table;
+            delete shard.doc_rmq;
+            if (shard.meta_store) {
+                munmap((void*)shard.meta_store->base, shard.meta_store->size);
+            }
+            delete shard.meta_store;
+            if (shard.doc_dups) {
+                munmap((void*)shard.doc_dups->base, shard.doc_dups->size);
+            }
+            delete shard.doc_dups;
+            for (auto [_, doc_attr] : shard.doc_attrs) {
+                delete doc_attr;
+            }
+        }
+    }
+
+    FindResult find(const string query) const {
+
+        string cache_key;
+        if (_cache && query.length() > 0) {
+            cache_key = ResultCache::find_key(_index_epoch, query);
+            FindResult cached;
+            if (_cache->get_find(cache_key, cached)) {
+                return cached;
+            }
+        }
+
+        PhaseTimer timer;
+        const bool profiling = _profiling.load(memory_order_relaxed);
+        vector<QueryProfile> profile_by_shard(profiling ? _num_shards : 0);
+
+        vector<pair<size_t, size_t>> segment_by_shard(_num_shards);
+        if (query.length() == 0) {
+            for (size_t s = 0; s < _num_shards; s++) {
+                segment_by_shard[s] = {0, _shards[s].data_index->size()};
+            }
+        } else if (_interleaved_search.load(memory_order_relaxed)) {
+            _find_interleaved(query, segment_by_shard, profiling ? &profile_by_shard : nullptr);
+        } else {
+            vector<thread> threads;
+            for (size_t s = 0; s < _num_shards; s++) {
+                threads.emplace_back(_on_shard_node(s, [&, s]() { _find_thread(s, &query, &segment_by_shard[s], profiling ? &profile_by_shard[s] : nullptr); }));
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        }
+
+        size_t cnt = 0;
+        for (size_t s = 0; s < _num_shards; s++) {
+            assert (segment_by_shard[s].first <= segment_by_shard[s].second);
+            cnt += segment_by_shard[s].second - segment_by_shard[s].first;
+        }
+
+        QueryProfile profile;
+        if (profiling) {
+            profile.search_us_by_shard.resize(_num_shards, 0.0);
+            for (size_t s = 0; s < profile_by_shard.size(); s++) {
+                profile.merge(profile_by_shard[s]);
+                if (!profile_by_shard[s].search_us_by_shard.empty()) {
+                    profile.search_us_by_shard[s] = profile_by_shard[s].search_us_by_shard[0];
+                    _profiler.search.record(profile.search_us_by_shard[s]);
+                }
+            }
+            _profiler.find.record(timer.elapsed_us());
+            _profiler.add_counters(profile);
+        }
+
+        auto result = FindResult{ .cnt = cnt, .segment_by_shard = segment_by_shard, .profile = profile, };
+        if (!cache_key.empty()) {
+            _cache->put_find(cache_key, result);
+        }
+        return result;
+    }
+
+    void _find_thread(const size_t s, const string* const query, pair<size_t, size_t>* const segment, QueryProfile* const profile = nullptr) const {
+
+        PhaseTimer timer;
+        auto faults = profile ? thread_page_faults() : pair<size_t, size_t>{0, 0};
+
+        size_t steps = _search(_shards[s], query->data(), query->data() + query->length(), *segment);
+
+        if (profile) {
+            auto faults_after = thread_page_faults();
+            profile->search_us_by_shard = {timer.elapsed_us()};
+            profile->rank_calls += 2 * steps; // one pair of ranks per backward step
+            profile->minor_faults += faults_after.first - faults.first;
+            profile->major_faults += faults_after.second - faults.second;
+        }
+    }
+
+    // Backward search for the query in all shards at once, in this thread: the shards take their steps in lockstep, and
+    // within a step the ranks of all shards descend the wavelet tree one level at a time, each level first prefetching
+    // the rank samples of every shard and then ranking, so that the cache misses (or page faults) of the shards overlap
+    // instead of adding up. Wavelet trees without rank cursors (wt_rlmn) take one whole backward step per shard instead.
+    void _find_interleaved(const string& query, vector<pair<size_t, size_t>>& segment_by_shard, vector<QueryProfile>* const profile_by_shard = nullptr) const {
+
+        PhaseTimer timer;
+        auto faults = profile_by_shard ? thread_page_faults() : pair<size_t, size_t>{0, 0};
+
+        const char* const begin = query.data();
+        struct Stream {
+            const index_t* index;
+            const char* end; // the query is matched in [end, query end)
+            size_t lo, hi;    // inclusive SA interval, empty once hi + 1 == lo, as in sdsl::backward_search
+            size_t steps;
+            bool found;       // false if the k-gram table does not have the last bytes of the query
+        };
+        auto searching = [begin](const Stream& stream) { return stream.end != begin && stream.hi + 1 != stream.lo; };
+        vector<Stream> streams(_num_shards);
+        for (size_t s = 0; s < _num_shards; s++) {
+            auto& stream = streams[s];
+            stream = Stream{_shards[s].data_index, query.data() + query.length(), 0, _shards[s].data_index->size() - 1, 0, true};
+            if (!_search_start(_shards[s], begin, stream.end, stream.lo, stream.hi)) {
+                stream.found = false;
+                stream.end = begin;
+            }
+        }
+
+        typedef typename index_t::wavelet_tree_type wt_t;
+        if constexpr (sdsl::has_rank_cursor<wt_t>::value) {
+            typedef typename wt_t::rank_cursor cursor_t;
+            vector<cursor_t> cursors(2 * _num_shards);
+            vector<size_t> c_begin(_num_shards);
+            vector<size_t> active;
+            while (true) {
+                // start the pair of ranks of the next step of each shard
+                active.clear();
+                for (size_t s = 0; s < _num_shards; s++) {
+                    auto& stream = streams[s];
+                    if (!searching(stream)) continue;
+                    const auto& index = *stream.index;
+                    const uint8_t c = *--stream.end;
+                    stream.steps++;
+                    const size_t cc = index.char2comp[c];
+                    if (cc == 0 && c > 0) { // as sdsl::backward_search
+                        stream.lo = 1;
+                        stream.hi = 0;
+                    } else if (stream.lo == 0 && stream.hi + 1 == index.size()) {
+                        stream.lo = index.C[cc];
+                        stream.hi = index.C[cc + 1] - 1;
+                    } else {
+                        c_begin[s] = index.C[cc];
+                        cursors[2 * s] = index.wavelet_tree.rank_begin(stream.lo, c);
+                        cursors[2 * s + 1] = index.wavelet_tree.rank_begin(stream.hi + 1, c);
+                        active.push_back(s);
+                    }
+                }
+                if (active.empty()) {
+                    if (none_of(streams.begin(), streams.end(), searching)) break;
+                    continue;
+                }
+                // descend all of them level by level
+                bool pending = true;
+                while (pending) {
+                    pending = false;
+                    for (auto s : active) {
+                        const auto& wt = streams[s].index->wavelet_tree;
+                        for (size_t k = 2 * s; k < 2 * s + 2; k++) {
+                            if (!wt.rank_done(cursors[k])) wt.rank_prefetch(cursors[k]);
+                        }
+                    }
+                    for (auto s : active) {
+                        const auto& wt = streams[s].index->wavelet_tree;
+                        for (size_t k = 2 * s; k < 2 * s + 2; k++) {
+                            if (!wt.rank_done(cursors[k])) {
+                                wt.rank_step(cursors[k]);
+                                pending |= !wt.rank_done(cursors[k]);
+                            }
+                        }
+                    }
+                }
+                for (auto s : active) {
+                    streams[s].lo = c_begin[s] + cursors[2 * s].result;
+                    streams[s].hi = c_begin[s] + cursors[2 * s + 1].result - 1;
+                }
+            }
+        } else {
+            bool done = false;
+            while (!done) {
+                done = true;
+                for (auto& stream : streams) {
+                    if (!searching(stream)) continue;
+                    sdsl::backward_search(*stream.index, stream.lo, stream.hi, (uint8_t)*--stream.end, stream.lo, stream.hi);
+                    stream.steps++;
+                    done = false;
+                }
+            }
+        }
+
+        for (size_t s = 0; s < _num_shards; s++) {
+            const auto& stream = streams[s];
+            segment_by_shard[s] = stream.found ? pair<size_t, size_t>{stream.lo, stream.hi + 1} : pair<size_t, size_t>{0, 0};
+        }
+
+        if (profile_by_shard) {
+            // the shards are searched together, so each is charged the whole search time, and the page faults go to shard 0
+            auto faults_after = thread_page_faults();
+            double us = timer.elapsed_us();
+            for (size_t s = 0; s < _num_shards; s++) {
+                auto& profile = (*profile_by_shard)[s];
+                profile.search_us_by_shard = {us};
+                profile.rank_calls += 2 * streams[s].steps;
+            }
+            (*profile_by_shard)[0].minor_faults += faults_after.first - faults.first;
+            (*profile_by_shard)[0].major_faults += faults_after.second - faults.second;
+        }
+    }
+
+    CountResult count(const string& query) const {
+
+        auto find_result = find(query);
+        return CountResult{ .count = find_result.cnt, .profile = find_result.profile, };
+    }
+
+    // Same as find, over the token index: one backward step per token rather than per byte. The segments are ranges of
+    // the token index SA, to be passed to get_doc_by_token_rank. Throws invalid_argument if a shard has no token index.
+    FindResult find_tokens(const vector<uint32_t>& token_ids) const {
+
+        for (const auto& shard : _shards) {
+            if (!shard.tok_index) {
+                throw invalid_argument("index has no token index (data.tok.fm9)");
+            }
+        }
+        vector<uint64_t> symbols;
+        for (auto id : token_ids) {
+            symbols.push_back((uint64_t)id + TOKEN_ID_SHIFT);
+        }
+
+        vector<pair<size_t, size_t>> segment_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() { _find_tokens_thread(s, &symbols, &segment_by_shard[s]); }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        size_t cnt = 0;
+        for (const auto& [lo, hi] : segment_by_shard) {
+            assert (lo <= hi);
+            cnt += hi - lo;
+        }
+        return FindResult{ .cnt = cnt, .segment_by_shard = segment_by_shard, .profile = {}, };
+    }
+
+    void _find_tokens_thread(const size_t s, const vector<uint64_t>* const symbols, pair<size_t, size_t>* const segment) const {
+
+        const auto& index = *_shards[s].tok_index;
+        if (symbols->empty()) {
+            *segment = {0, index.size()};
+            return;
+        }
+        size_t lo = 0, hi = index.size() - 1;
+        sdsl::backward_search(index, lo, hi, symbols->begin(), symbols->end(), lo, hi);
+        *segment = {lo, hi + 1};
+    }
+
+    CountResult count_tokens(const vector<uint32_t>& token_ids) const {
+
+        auto find_result = find_tokens(token_ids);
+        return CountResult{ .count = find_result.cnt, .profile = {}, };
+    }
+
+    // Finds the occurrences of strings within max_edits substitutions, insertions and deletions of the query. Backward
+    // search branches on the distinct preceding bytes of each SA interval (never into a document separator), and once
+    // the edits are used up, the rest of the query is matched exactly. Each shard stops after max_work branching steps.
+    // A text position is reported if a string starting there is within max_edits of the query without beginning or
+    // ending with an inserted text byte: an occurrence is not also reported at the positions just before it, so counts
+    // are lower than those of a per-position edit distance, which does count them.
+    // Throws invalid_argument if the query is not longer than max_edits.
+    ApproxFindResult find_approx(const string& query, const size_t max_edits, const size_t max_work) const {
+
+        if (query.length() <= max_edits) {
+            throw invalid_argument("query must be longer than max_edits"); // otherwise everything matches
+        }
+        vector<vector<pair<size_t, size_t>>> segments_by_shard(_num_shards);
+        vector<char> complete_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                complete_by_shard[s] = _find_approx_thread(s, query, max_edits, max_work, segments_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        ApproxFindResult result{ .cnt = 0, .segments_by_shard = segments_by_shard, .complete = true, };
+        for (size_t s = 0; s < _num_shards; s++) {
+            for (auto [lo, hi] : segments_by_shard[s]) {
+                result.cnt += hi - lo;
+            }
+            result.complete = result.complete && complete_by_shard[s];
+        }
+        return result;
+    }
+
+    ApproxCountResult count_approx(const string& query, const size_t max_edits, const size_t max_work) const {
+
+        auto find_result = find_approx(query, max_edits, max_work);
+        return ApproxCountResult{ .count = find_result.cnt, .complete = find_result.complete, };
+    }
+
+    bool _find_approx_thread(const size_t s, const string& query, const size_t max_edits, const size_t max_work, vector<pair<size_t, size_t>>& segments) const {
+
+        const auto &shard = _shards[s];
+        const auto &index = *shard.data_index;
+        struct State {
+            size_t i; // query[0:i] is left to match
+            size_t lo, hi; // SA interval, inclusive
+            size_t edits;
+        };
+        // different edit sequences often reach the same state; expand it only when reached with fewer edits
+        map<tuple<size_t, size_t, size_t>, size_t> min_edits;
+        vector<State> stack = {{query.length(), 0, index.size() - 1, 0}};
+        vector<pair<size_t, size_t>> found;
+        uint64_t sigma = 0;
+        vector<uint8_t> cs(index.sigma);
+        vector<uint64_t> rank_c_i(index.sigma), rank_c_j(index.sigma);
+        size_t work = 0;
+        bool complete = true;
+        while (!stack.empty()) {
+            auto [i, lo, hi, edits] = stack.back();
+            stack.pop_back();
+            if (i == 0) {
+                found.push_back({lo, hi + 1});
+                continue;
+            }
+            auto [it, inserted] = min_edits.try_emplace({i, lo, hi}, edits);
+            if (!inserted) {
+                if (it->second <= edits) continue;
+                it->second = edits;
+            }
+            if (work >= max_work) {
+                complete = false;
+                break;
+            }
+            work++;
+
+            if (edits == max_edits) {
+                size_t l, h;
+                if (sdsl::backward_search(index, lo, hi, query.begin(), query.begin() + i, l, h) > 0) {
+                    found.push_back({l, h + 1});
+                }
+                continue;
+            }
+
+            // deletion: query[i - 1] is not in the text
+            stack.push_back({i - 1, lo, hi, edits + 1});
+            _interval_symbols(index, lo, hi + 1, sigma, cs, rank_c_i, rank_c_j);
+            for (uint64_t j = 0; j < sigma; j++) {
+                uint8_t c = cs[j];
+                uint64_t cc = index.char2comp[c];
+                if (cc == 0) continue; // backward search never matches the smallest byte either
+                if (c == 0xff && (uint8_t)query[i - 1] != 0xff) continue; // do not run into the previous document
+                size_t l = index.C[cc] + rank_c_i[j], h = index.C[cc] + rank_c_j[j] - 1;
+                // match or substitution
+                stack.push_back({i - 1, l, h, edits + ((uint8_t)query[i - 1] != c)});
+                // insertion: c is in the text but not in the query; inserting at the right end only extends the match
+                if (i < query.length() && c != 0xff) {
+                    stack.push_back({i, l, h, edits + 1});
+                }
+            }
+        }
+
+        _merge_segments(found, segments);
+        return complete;
+    }
+
+    // Finds the occurrences of the query up to ASCII case (if fold_case) and with each whitespace run of the query matching
+    // any non-empty run of the bytes in whitespace (if not empty). Each step of backward search extends the current SA
+    // intervals by all alternatives of a query byte at once; each shard stops after max_work extended intervals.
+    // Throws invalid_argument if the query is empty.
+    ApproxFindResult find_folded(const string& query, const bool fold_case, const string& whitespace, const size_t max_work) const {
+
+        if (query.empty()) {
+            throw invalid_argument("query must not be empty");
+        }
+        vector<vector<pair<size_t, size_t>>> segments_by_shard(_num_shards);
+        vector<char> complete_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                complete_by_shard[s] = _find_folded_thread(s, query, fold_case, whitespace, max_work, segments_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        ApproxFindResult result{ .cnt = 0, .segments_by_shard = segments_by_shard, .complete = true, };
+        for (size_t s = 0; s < _num_shards; s++) {
+            for (auto [lo, hi] : segments_by_shard[s]) {
+                result.cnt += hi - lo;
+            }
+            result.complete = result.complete && complete_by_shard[s];
+        }
+        return result;
+    }
+
+    ApproxCountResult count_folded(const string& query, const bool fold_case, const string& whitespace, const size_t max_work) const {
+
+        auto find_result = find_folded(query, fold_case, whitespace, max_work);
+        return ApproxCountResult{ .count = find_result.cnt, .complete = find_result.complete, };
+    }
+
+    bool _find_folded_thread(const size_t s, const string& query, const bool fold_case, const string& whitespace, const size_t max_work, vector<pair<size_t, size_t>>& segments) const {
+
+        const auto &index = *_shards[s].data_index;
+        bool is_space[256] = {false};
+        for (auto c : whitespace) is_space[(uint8_t)c] = true;
+        struct State {
+            size_t i; // query[0:i] is left to match
+            size_t lo, hi; // SA interval, inclusive
+            bool in_run; // the text bytes just matched are a whitespace run, which may extend further left
+        };
+        vector<State> stack = {{query.length(), 0, index.size() - 1, false}};
+        vector<pair<size_t, size_t>> found;
+        uint64_t sigma = 0;
+        vector<uint8_t> cs(index.sigma);
+        vector<uint64_t> rank_c_i(index.sigma), rank_c_j(index.sigma);
+        // pushes the extensions of [lo, hi] by every byte c with accept[c], using one interval_symbols call if there are several
+        auto extend = [&](const size_t lo, const size_t hi, const bool* const accept, const size_t n_accept, const uint8_t only, const size_t i, const bool in_run) {
+            if (n_accept == 1) {
+                size_t l, h;
+                if (index.char2comp[only] != 0 && sdsl::backward_search(index, lo, hi, only, l, h) > 0) {
+                    stack.push_back({i, l, h, in_run});
+                }
+                return;
+            }
+            _interval_symbols(index, lo, hi + 1, sigma, cs, rank_c_i, rank_c_j);
+            for (uint64_t j = 0; j < sigma; j++) {
+                uint64_t cc = index.char2comp[cs[j]];
+                if (!accept[cs[j]] || cc == 0) continue; // backward search never matches the smallest byte either
+                stack.push_back({i, index.C[cc] + rank_c_i[j], index.C[cc] + rank_c_j[j] - 1, in_run});
+            }
+        };
+        const size_t n_space = count_if(is_space, is_space + 256, [](bool b) { return b; });
+        const uint8_t only_space = n_space == 1 ? (uint8_t)whitespace[0] : 0;
+
+        size_t work = 0;
+        bool complete = true;
+        while (!stack.empty()) {
+            auto [i, lo, hi, in_run] = stack.back();
+            stack.pop_back();
+            if (work >= max_work) {
+                complete = false;
+                break;
+            }
+            work++;
+
+            if (in_run) {
+                extend(lo, hi, is_space, n_space, only_space, i, true);
+            }
+            if (i == 0) {
+                found.push_back({lo, hi + 1});
+                continue;
+            }
+            uint8_t c = query[i - 1];
+            if (is_space[c]) {
+                size_t j = i - 1;
+                while (j > 0 && is_space[(uint8_t)query[j - 1]]) j--;
+                extend(lo, hi, is_space, n_space, only_space, j, true);
+            } else if (fold_case && isalpha(c)) {
+                bool accept[256] = {false};
+                accept[tolower(c)] = accept[toupper(c)] = true;
+                extend(lo, hi, accept, 2, 0, i - 1, false);
+            } else {
+                bool accept[256] = {false};
+                accept[c] = true;
+                extend(lo, hi, accept, 1, c, i - 1, false);
+            }
+        }
+
+        _merge_segments(found, segments);
+        return complete;
+    }
+
+    // Finds the occurrences of strings matching a restricted regex (see ByteRegex) without scanning text: the pattern's
+    // NFA is run right to left alongside backward search, branching on the distinct preceding bytes of each SA interval
+    // that some active NFA state accepts. Each shard stops after max_work extended intervals.
+    ApproxFindResult find_regex(const string& pattern, const size_t max_work) const {
+
+        const ByteRegex regex(pattern);
+        vector<vector<pair<size_t, size_t>>> segments_by_shard(_num_shards);
+        vector<char> complete_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                complete_by_shard[s] = _find_regex_thread(s, regex, max_work, segments_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        ApproxFindResult result{ .cnt = 0, .segments_by_shard = segments_by_shard, .complete = true, };
+        for (size_t s = 0; s < _num_shards; s++) {
+            for (auto [lo, hi] : segments_by_shard[s]) {
+                result.cnt += hi - lo;
+            }
+            result.complete = result.complete && complete_by_shard[s];
+        }
+        return result;
+    }
+
+    bool _find_regex_thread(const size_t s, const ByteRegex& regex, const size_t max_work, vector<pair<size_t, size_t>>& segments) const {
+
+        const auto &index = *_shards[s].data_index;
+        struct State {
+            vector<int> nfa_states;
+            size_t lo, hi; // SA interval, inclusive
+        };
+        vector<State> stack = {{regex.closure({regex.start}), 0, index.size() - 1}};
+        vector<pair<size_t, size_t>> found;
+        uint64_t sigma = 0;
+        vector<uint8_t> cs(index.sigma);
+        vector<uint64_t> rank_c_i(index.sigma), rank_c_j(index.sigma);
+        // pushes the extension of [lo, hi] by c, if any NFA state accepts it
+        auto extend = [&](const State& state, const uint8_t c, const size_t l, const size_t h) {
+            vector<int> next;
+            for (int u : state.nfa_states) {
+                if (regex.states[u].bytes[c]) next.push_back(regex.states[u].next);
+            }
+            if (!next.empty()) {
+                stack.push_back({regex.closure(next), l, h});
+            }
+        };
+
+        size_t work = 0;
+        bool complete = true;
+        while (!stack.empty()) {
+            State state = move(stack.back());
+            stack.pop_back();
+            if (work >= max_work) {
+                complete = false;
+                break;
+            }
+            work++;
+
+            if (binary_search(state.nfa_states.begin(), state.nfa_states.end(), regex.match)) {
+                found.push_back({state.lo, state.hi + 1});
+            }
+            bitset<256> bytes;
+            for (int u : state.nfa_states) bytes |= regex.states[u].bytes;
+            bytes.reset(0xfa); // sdsl ends the text with \xfa in place of \0 (see sdsl/construct.hpp); it is no text byte
+            if (bytes.count() == 1) {
+                uint8_t c = 0;
+                while (!bytes[c]) c++;
+                size_t l, h;
+                if (index.char2comp[c] != 0 && sdsl::backward_search(index, state.lo, state.hi, c, l, h) > 0) {
+                    extend(state, c, l, h);
+                }
+                continue;
+            }
+            if (bytes.none()) {
+                continue;
+            }
+            _interval_symbols(index, state.lo, state.hi + 1, sigma, cs, rank_c_i, rank_c_j);
+            for (uint64_t j = 0; j < sigma; j++) {
+                uint64_t cc = index.char2comp[cs[j]];
+                if (!bytes[cs[j]] || cc == 0) continue; // backward search never matches the smallest byte either
+                extend(state, cs[j], index.C[cc] + rank_c_i[j], index.C[cc] + rank_c_j[j] - 1);
+            }
+        }
+
+        _merge_segments(found, segments);
+        return complete;
+    }
+
+    // Occurrences of different matched strings start at the same position when one is a prefix of the other
+    static void _merge_segments(vector<pair<size_t, size_t>>& found, vector<pair<size_t, size_t>>& segments) {
+        sort(found.begin(), found.end());
+        for (auto [lo, hi] : found) {
+            if (!segments.empty() && lo <= segments.back().second) {
+                segments.back().second = max(segments.back().second, hi);
+            } else {
+                segments.push_back({lo, hi});
+            }
+        }
+    }
+
+    // For every position i, the longest prefix of text[i:] that occurs in each shard, computed in one right-to-left pass.
+    MatchingStatisticsResult matching_statistics(const string& text) const {
+
+        vector<vector<size_t>> len_by_shard(_num_shards);
+        vector<vector<pair<size_t, size_t>>> segment_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() { _matching_statistics_thread(s, &text, &len_by_shard[s], &segment_by_shard[s]); }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        vector<size_t> len(text.length(), 0);
+        for (size_t s = 0; s < _num_shards; s++) {
+            for (size_t i = 0; i < text.length(); i++) {
+                len[i] = max(len[i], len_by_shard[s][i]);
+            }
+        }
+        return MatchingStatisticsResult{ .len = len, .len_by_shard = len_by_shard, .segment_by_shard = segment_by_shard, };
+    }
+
+    // The match end e(i) = i + len[i] never increases as i decreases. So at each position we first try to extend the
+    // current match by one byte to the left; only if that fails, the match is shortened from the right. The index has no
+    // LCP information to widen the SA interval with, so the new end is found by galloping up from i and binary searching,
+    // with a fresh backward search per probe. Galloping up keeps the cost proportional to the new match length, which
+    // is usually much shorter than the old one.
+    void _matching_statistics_thread(const size_t s, const string* const text, vector<size_t>* const lens, vector<pair<size_t, size_t>>* const segments) const {
+
+        const auto &shard = _shards[s];
+        const char* const data = text->data();
+        const size_t n = text->length();
+        lens->assign(n, 0);
+        segments->assign(n, {0, 0});
+
+        size_t end = n;
+        pair<size_t, size_t> segment = {0, shard.data_index->size()}; // of text[i+1, end)
+        for (size_t i = n; i-- > 0; ) {
+            size_t lo, hi;
+            if (sdsl::backward_search(*shard.data_index, segment.first, segment.second - 1, (uint8_t)data[i], lo, hi) > 0) {
+                segment = {lo, hi + 1};
+            } else {
+                // text[i, good) is known to occur and text[i, bad) is known not to
+                size_t good = i, bad = end;
+                pair<size_t, size_t> good_segment = {0, shard.data_index->size()};
+                for (size_t step = 1; bad - good > 1; step *= 2) {
+                    size_t probe = (step < bad - good) ? (good + step) : (good + bad) / 2;
+                    pair<size_t, size_t> probe_segment;
+                    _search(shard, data + i, data + probe, probe_segment);
+                    if (probe_segment.second <= probe_segment.first) {
+                        bad = probe;
+                        break;
+                    }
+                    good = probe;
+                    good_segment = probe_segment;
+                }
+                while (bad - good > 1) {
+                    size_t probe = (good + bad) / 2;
+                    pair<size_t, size_t> probe_segment;
+                    _search(shard, data + i, data + probe, probe_segment);
+                    if (probe_segment.second > probe_segment.first) {
+                        good = probe;
+                        good_segment = probe_segment;
+                    } else {
+                        bad = probe;
+                    }
+                }
+                end = good;
+                segment = good_segment;
+            }
+            (*lens)[i] = end - i;
+            (*segments)[i] = segment;
+        }
+    }
+
+    // Scores every sliding window of `window` bytes (or whitespace-separated words, if by_words) of the text.
+    // Overlapping windows share work: a window starting at byte a is in the index iff the matching statistic at a covers it.
+    ContaminationResult contamination(const string& text, const size_t window, const bool by_words) const {
+
+        assert (window > 0);
+        auto ms = matching_statistics(text);
+
+        vector<pair<size_t, size_t>> windows;
+        if (by_words) {
+            vector<size_t> word_start, word_end;
+            for (size_t i = 0; i < text.length(); i++) {
+                bool is_space = isspace((unsigned char)text[i]);
+                bool prev_space = (i == 0) || isspace((unsigned char)text[i - 1]);
+                if (!is_space && prev_space) word_start.push_back(i);
+                if (is_space && !prev_space) word_end.push_back(i);
+            }
+            if (word_end.size() < word_start.size()) word_end.push_back(text.length());
+            for (size_t j = 0; j + window <= word_start.size(); j++) {
+                windows.push_back({word_start[j], word_end[j + window - 1]});
+            }
+        } else {
+            for (size_t a = 0; a + window <= text.length(); a++) {
+                windows.push_back({a, a + window});
+            }
+        }
+
+        size_t num_contaminated = 0;
+        vector<pair<size_t, size_t>> spans;
+        for (auto [a, b] : windows) {
+            if (ms.len[a] < b - a) continue;
+            num_contaminated++;
+            if (!spans.empty() && spans.back().second >= a) {
+                spans.back().second = max(spans.back().second, b);
+            } else {
+                spans.push_back({a, b});
+            }
+        }
+        double ratio = windows.empty() ? 0.0 : (double)num_contaminated / windows.size();
+        return ContaminationResult{ .num_windows = windows.size(), .num_contaminated = num_contaminated, .ratio = ratio, .spans = spans, };
+    }
+
+    // Scores many texts (e.g. all entries of a benchmark), num_threads texts at a time; each text also fans out over shards
+    vector<ContaminationResult> contamination_batch(const vector<string>& texts, const size_t window, const bool by_words, const size_t num_threads) const {
+
+        vector<ContaminationResult> results(texts.size());
+        atomic<size_t> next{0};
+        vector<thread> threads;
+        for (size_t t = 0; t < max(num_threads, (size_t)1); t++) {
+            threads.emplace_back([&]() {
+                for (size_t i; (i = next.fetch_add(1)) < texts.size(); ) {
+                    results[i] = contamination(texts[i], window, by_words);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        return results;
+    }
+
+    // Lists up to max_docs distinct documents containing the query. With data.doc_rmq, each document costs O(1) range-minimum
+    // queries and one locate; otherwise every occurrence is located, and at most max_work occurrences are visited per shard.
+    DocListResult list_docs(const string& query, const size_t max_docs, const size_t max_work) const {
+
+        auto find_result = find(query);
+        vector<vector<size_t>> docs_by_shard(_num_shards);
+        vector<char> complete_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                auto [lo, hi] = find_result.segment_by_shard[s];
+                complete_by_shard[s] = _list_shard_docs(s, lo, hi, max_docs, max_work, docs_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        vector<size_t> doc_ixs;
+        bool complete = true;
+        for (size_t s = 0; s < _num_shards; s++) {
+            complete = complete && complete_by_shard[s];
+            size_t offset = _doc_ix_offset(s);
+            for (auto doc : docs_by_shard[s]) {
+                if (doc_ixs.size() == max_docs) {
+                    complete = false;
+                    break;
+                }
+                doc_ixs.push_back(offset + doc);
+            }
+        }
+        return DocListResult{ .cnt = find_result.cnt, .doc_ixs = doc_ixs, .complete = complete, };
+    }
+
+    // Counts distinct documents containing the query. A shard's count is exact if its documents can be listed within
+    // max_work steps (see list_docs). Otherwise it is a Horvitz-Thompson estimate from up to sample_size occurrences drawn
+    // uniformly: each sampled occurrence contributes 1 / (occurrences in its document), which is found by extracting the
+    // document, and these sum to the number of documents over all occurrences. Sampling stops when another max_work steps
+    // are spent, charging a step per located occurrence and per SA sample period of bytes extracted (about the cost of a
+    // locate). If that leaves fewer than MIN_DOC_SAMPLE occurrences in a shard, nothing is extracted there, and the
+    // interval only spans from the documents located to the bounds given by the occurrences and the number of documents.
+    // Throws invalid_argument if the query is empty, or if sample_size is less than 2.
+    DocCountResult count_docs(const string& query, const size_t max_work, const size_t sample_size) const {
+
+        if (query.empty()) {
+            throw invalid_argument("query must not be empty");
+        }
+        if (sample_size < 2) {
+            throw invalid_argument("sample_size must be at least 2");
+        }
+        auto find_result = find(query);
+        vector<double> count_by_shard(_num_shards, 0.0), variance_by_shard(_num_shards, 0.0);
+        vector<char> exact_by_shard(_num_shards), sampled_enough_by_shard(_num_shards, true);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                auto [lo, hi] = find_result.segment_by_shard[s];
+                vector<size_t> docs;
+                // without data.doc_rmq, listing visits every occurrence, so there is no point in trying past max_work
+                exact_by_shard[s] = (_shards[s].doc_rmq || hi - lo <= max_work) && _list_shard_docs(s, lo, hi, max_work, max_work, docs);
+                if (exact_by_shard[s]) {
+                    count_by_shard[s] = docs.size();
+                } else {
+                    sampled_enough_by_shard[s] = _estimate_shard_docs(s, query, lo, hi, sample_size, max_work, count_by_shard[s], variance_by_shard[s]);
+                }
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        double count = 0.0, variance = 0.0, min_count = 0.0, max_count = 0.0;
+        size_t doc_cnt = 0;
+        bool exact = true, sampled_enough = true;
+        for (size_t s = 0; s < _num_shards; s++) {
+            auto [lo, hi] = find_result.segment_by_shard[s];
+            count += count_by_shard[s];
+            variance += variance_by_shard[s];
+            exact = exact && exact_by_shard[s];
+            sampled_enough = sampled_enough && sampled_enough_by_shard[s];
+            doc_cnt += _shards[s].doc_cnt;
+            min_count += exact_by_shard[s] || !sampled_enough_by_shard[s] ? count_by_shard[s] : (double)(hi > lo);
+            max_count += exact_by_shard[s] ? count_by_shard[s] : (double)min(hi - lo, _shards[s].doc_cnt);
+        }
+        double ci_low = count, ci_high = count;
+        if (!exact) {
+            ci_low = min_count;
+            ci_high = max_count;
+            if (sampled_enough) {
+                ci_low = max(count - 1.96 * sqrt(variance), find_result.cnt > 0 ? 1.0 : 0.0);
+                ci_high = min(count + 1.96 * sqrt(variance), (double)min(find_result.cnt, doc_cnt));
+            }
+        }
+        return DocCountResult{ .cnt = find_result.cnt, .count = count, .exact = exact, .ci_low = ci_low, .ci_high = ci_high, };
+    }
+
+    // Returns the k documents containing the query most often. A shard is exact if all its occurrences can be located
+    // within max_work steps, or if its documents can be listed (see list_docs) and their occurrences counted by extraction
+    // within max_work steps. Otherwise sample_size occurrences are located, and the 2k documents sampled most often are
+    // counted exactly and ranked. Throws invalid_argument if the query is empty.
+    TopKDocsResult topk_docs(const string& query, const size_t k, const size_t max_work, const size_t sample_size) const {
+
+        if (query.empty()) {
+            throw invalid_argument("query must not be empty");
+        }
+        auto find_result = find(query);
+        vector<vector<pair<size_t, size_t>>> counts_by_shard(_num_shards);
+        vector<char> exact_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                auto [lo, hi] = find_result.segment_by_shard[s];
+                exact_by_shard[s] = _topk_shard_docs(s, query, lo, hi, k, max_work, sample_size, counts_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        // documents do not span shards, so the global top k is among the per-shard top k
+        vector<pair<size_t, size_t>> doc_counts; // (count, global doc ix)
+        bool exact = true;
+        for (size_t s = 0; s < _num_shards; s++) {
+            exact = exact && exact_by_shard[s];
+            size_t offset = _doc_ix_offset(s);
+            for (auto [count, doc] : counts_by_shard[s]) {
+                doc_counts.push_back({count, offset + doc});
+            }
+        }
+        _sort_doc_counts(doc_counts, k);
+
+        TopKDocsResult result{ .cnt = find_result.cnt, .doc_ixs = {}, .counts = {}, .exact = exact, };
+        for (auto [count, doc] : doc_counts) {
+            result.doc_ixs.push_back(doc);
+            result.counts.push_back(count);
+        }
+        return result;
+    }
+
+    // Fills doc_counts with the (count, local doc ix) of the top k documents of SA range [lo, hi); returns whether they are exact
+    bool _topk_shard_docs(const size_t s, const string& query, const size_t lo, const size_t hi, const size_t k, const size_t max_work, const size_t sample_size, vector<pair<size_t, size_t>>& doc_counts) const {
+
+        const auto &shard = _shards[s];
+        if (hi - lo <= max_work) {
+            unordered_map<size_t, size_t> count_by_doc;
+            for (size_t rank = lo; rank < hi; rank++) {
+                count_by_doc[_convert_ptr_to_doc_ix(shard, (*shard.data_index)[rank])]++;
+            }
+            for (auto [doc, count] : count_by_doc) {
+                doc_counts.push_back({count, doc});
+            }
+            _sort_doc_counts(doc_counts, k);
+            return true;
+        }
+
+        vector<size_t> docs;
+        if (shard.doc_rmq && _list_shard_docs(s, lo, hi, max_work, max_work, docs)) {
+            size_t bytes = 0;
+            for (auto doc : docs) {
+                bytes += _convert_doc_ix_to_ptr(shard, doc + 1) - _convert_doc_ix_to_ptr(shard, doc);
+            }
+            if (bytes <= max_work * shard.data_index->sa_sample_dens) {
+                for (auto doc : docs) {
+                    doc_counts.push_back({_count_doc_occurrences(s, doc, query), doc});
+                }
+                _sort_doc_counts(doc_counts, k);
+                return true;
+            }
+        }
+
+        // a document holding a fraction f of the occurrences is expected sample_size * f times in the sample
+        mt19937_64 rng(19260817 + s);
+        unordered_map<size_t, size_t> sampled_by_doc;
+        for (size_t j = 0; j < sample_size; j++) {
+            size_t rank = lo + uniform_int_distribution<size_t>(0, hi - lo - 1)(rng);
+            sampled_by_doc[_convert_ptr_to_doc_ix(shard, (*shard.data_index)[rank])]++;
+        }
+        vector<pair<size_t, size_t>> candidates;
+        for (auto [doc, sampled] : sampled_by_doc) {
+            candidates.push_back({sampled, doc});
+        }
+        _sort_doc_counts(candidates, 2 * k);
+        for (auto [_, doc] : candidates) {
+            doc_counts.push_back({_count_doc_occurrences(s, doc, query), doc});
+        }
+        _sort_doc_counts(doc_counts, k);
+        return false;
+    }
+
+    static void _sort_doc_counts(vector<pair<size_t, size_t>>& doc_counts, const size_t k) {
+        sort(doc_counts.begin(), doc_counts.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        if (doc_counts.size() > k) doc_counts.resize(k);
+    }
+
+    // Occurrences of the query starting in a document, including those that run into the next one
+    size_t _count_doc_occurrences(const size_t s, const size_t doc, const string& query) const {
+
+        size_t doc_len;
+        string text = _extract_doc(s, doc, query.length() - 1, doc_len);
+        return _count_occurrences(text, doc_len, query);
+    }
+
+    // A document's text from its separator on (so that queries starting with the separator are found too), followed by
+    // up to tail_len bytes of the next document for occurrences that run into it
+    string _extract_doc(const size_t s, const size_t doc, const size_t tail_len, size_t& doc_len) const {
+
+        const auto &shard = _shards[s];
+        size_t start_ptr = _convert_doc_ix_to_ptr(shard, doc), end_ptr = _convert_doc_ix_to_ptr(shard, doc + 1);
+        doc_len = end_ptr - start_ptr;
+        return parallel_extract(s, start_ptr, min(end_ptr + tail_len, _convert_doc_ix_to_ptr(shard, shard.doc_cnt)), false);
+    }
+
+    // Occurrences of the query in text that start before len
+    static size_t _count_occurrences(const string& text, const size_t len, const string& query) {
+        size_t occurrences = 0;
+        for (size_t pos = text.find(query); pos != string::npos && pos < len; pos = text.find(query, pos + 1)) occurrences++;
+        return occurrences;
+    }
+
+    // Finds documents matching a CNF of strings, e.g. [[a, b], [c]] for the documents containing (a OR b) AND c.
+    // Candidates come from the clause with the fewest occurrences: its occurrences are located (or its documents listed,
+    // with data.doc_rmq), and each candidate is checked against the other clauses by intersecting with their located
+    // documents if they are rare enough, or else by extracting the candidate. Work is counted as in count_docs; beyond
+    // max_work steps per shard, the count is estimated and approx is set. Throws invalid_argument if the CNF, one of its
+    // clauses or one of their terms is empty.
+    CNFResult find_cnf(const vector<vector<string>>& cnf, const size_t max_docs, const size_t max_work) const {
+
+        if (cnf.empty()) {
+            throw invalid_argument("cnf must have at least one clause");
+        }
+        vector<vector<FindResult>> find_results;
+        for (const auto &clause : cnf) {
+            if (clause.empty() || any_of(clause.begin(), clause.end(), [](const string& term) { return term.empty(); })) {
+                throw invalid_argument("each clause of cnf must have at least one term, and no empty terms");
+            }
+            find_results.emplace_back();
+            for (const auto &term : clause) {
+                find_results.back().push_back(find(term));
+            }
+        }
+
+        vector<vector<size_t>> docs_by_shard(_num_shards);
+        vector<double> count_by_shard(_num_shards, 0.0);
+        vector<char> exact_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                exact_by_shard[s] = _find_cnf_shard(s, cnf, find_results, max_docs, max_work, docs_by_shard[s], count_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        CNFResult result{ .cnt = 0.0, .approx = false, .doc_ixs = {}, };
+        for (size_t s = 0; s < _num_shards; s++) {
+            result.cnt += count_by_shard[s];
+            result.approx = result.approx || !exact_by_shard[s];
+            size_t offset = _doc_ix_offset(s);
+            for (auto doc : docs_by_shard[s]) {
+                if (result.doc_ixs.size() == max_docs) break;
+                result.doc_ixs.push_back(offset + doc);
+            }
+        }
+        return result;
+    }
+
+    // Fills docs with up to max_docs local doc ixs matching the CNF and sets count; returns false if count is an estimate
+    bool _find_cnf_shard(const size_t s, const vector<vector<string>>& cnf, const vector<vector<FindResult>>& find_results, const size_t max_docs, const size_t max_work, vector<size_t>& docs, double& count) const {
+
+        const auto &shard = _shards[s];
+        const size_t dens = shard.data_index->sa_sample_dens;
+        count = 0.0;
+
+        // the occurrences of a clause bound the number of documents it matches, so the rarest one yields the fewest candidates
+        vector<size_t> clause_cnts(cnf.size(), 0);
+        size_t max_term_len = 0;
+        for (size_t c = 0; c < cnf.size(); c++) {
+            for (size_t t = 0; t < cnf[c].size(); t++) {
+                auto [lo, hi] = find_results[c][t].segment_by_shard[s];
+                clause_cnts[c] += hi - lo;
+                max_term_len = max(max_term_len, cnf[c][t].length());
+            }
+        }
+        const size_t r = min_element(clause_cnts.begin(), clause_cnts.end()) - clause_cnts.begin();
+        if (clause_cnts[r] == 0) {
+            return true;
+        }
+
+        size_t work = 0;
+        auto budget = [&]() { return max_work > work ? max_work - work : 0; };
+        auto locate_docs = [&](const size_t c, vector<size_t>& clause_docs) {
+            unordered_set<size_t> seen;
+            for (size_t t = 0; t < cnf[c].size(); t++) {
+                auto [lo, hi] = find_results[c][t].segment_by_shard[s];
+                for (size_t rank = lo; rank < hi; rank++) {
+                    size_t doc = _convert_ptr_to_doc_ix(shard, (*shard.data_index)[rank]);
+                    if (seen.insert(doc).second) clause_docs.push_back(doc);
+                }
+            }
+            work += clause_cnts[c];
+        };
+        // whether the extracted document holds an occurrence of every clause other than r
+        auto matches_text = [&](const string& text, const size_t doc_len, const vector<char>& skip) {
+            for (size_t c = 0; c < cnf.size(); c++) {
+                if (skip[c]) continue;
+                bool found = false;
+                for (const auto &term : cnf[c]) {
+                    size_t pos = text.find(term);
+                    if (pos != string::npos && pos < doc_len) {
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) return false;
+            }
+            return true;
+        };
+
+        vector<size_t> candidates;
+        bool listed = false;
+        if (clause_cnts[r] <= max_work) {
+            locate_docs(r, candidates);
+            listed = true;
+        } else if (shard.doc_rmq) {
+            listed = true;
+            unordered_set<size_t> seen;
+            for (size_t t = 0; t < cnf[r].size() && listed; t++) {
+                auto [lo, hi] = find_results[r][t].segment_by_shard[s];
+                vector<size_t> term_docs;
+                listed = _list_shard_docs(s, lo, hi, budget(), budget(), term_docs);
+                work += term_docs.size();
+                for (auto doc : term_docs) {
+                    if (seen.insert(doc).second) candidates.push_back(doc);
+                }
+            }
+        }
+
+        mt19937_64 rng(19260817 + s);
+        if (listed) {
+            // clauses that are cheap to locate are checked by intersection, the rest by extracting each candidate
+            vector<char> skip(cnf.size(), 0);
+            vector<unordered_set<size_t>> docs_by_clause(cnf.size());
+            skip[r] = 1;
+            for (size_t c = 0; c < cnf.size(); c++) {
+                if (c == r || clause_cnts[c] > budget()) continue;
+                vector<size_t> clause_docs;
+                locate_docs(c, clause_docs);
+                docs_by_clause[c].insert(clause_docs.begin(), clause_docs.end());
+                skip[c] = 1;
+            }
+            const bool extract = std::find(skip.begin(), skip.end(), 0) != skip.end();
+
+            // in random order, so that if the budget runs out, the checked candidates are a uniform sample
+            shuffle(candidates.begin(), candidates.end(), rng);
+            vector<size_t> matches;
+            size_t checked = 0;
+            for (auto doc : candidates) {
+                if (extract && checked > 0 && work >= max_work) break;
+                checked++;
+                bool match = true;
+                for (size_t c = 0; c < cnf.size() && match; c++) {
+                    if (c != r && skip[c]) match = docs_by_clause[c].count(doc) > 0;
+                }
+                if (match && extract) {
+                    size_t doc_len;
+                    string text = _extract_doc(s, doc, max_term_len - 1, doc_len);
+                    work += text.length() / dens + 1;
+                    match = matches_text(text, doc_len, skip);
+                }
+                if (match) matches.push_back(doc);
+            }
+            sort(matches.begin(), matches.end());
+            docs.assign(matches.begin(), matches.begin() + min(matches.size(), max_docs));
+            count = checked == candidates.size() ? matches.size() : (double)matches.size() * candidates.size() / checked;
+            return checked == candidates.size();
+        }
+
+        // Horvitz-Thompson over a uniform sample of the rarest clause's occurrences, as in count_docs: an occurrence in
+        // a matching document contributes 1 / (occurrences of that clause in the document)
+        const size_t n = clause_cnts[r];
+        const size_t mean_doc_len = max(shard.data_index->size() / max(shard.doc_cnt, (size_t)1), (size_t)1);
+        const size_t m = min(n, max(budget() * dens / mean_doc_len, (size_t)2));
+        unordered_set<size_t> sample;
+        for (size_t j = n - m; j < n; j++) {
+            size_t t = uniform_int_distribution<size_t>(0, j)(rng);
+            sample.insert(sample.count(t) ? j : t);
+        }
+        vector<char> skip(cnf.size(), 0);
+        skip[r] = 1;
+        unordered_map<size_t, double> y_by_doc;
+        double sum = 0.0;
+        for (auto offset : sample) {
+            size_t rank = 0;
+            for (size_t t = 0; t < cnf[r].size(); t++) {
+                auto [lo, hi] = find_results[r][t].segment_by_shard[s];
+                if (offset < hi - lo) {
+                    rank = lo + offset;
+                    break;
+                }
+                offset -= hi - lo;
+            }
+            size_t doc = _convert_ptr_to_doc_ix(shard, (*shard.data_index)[rank]);
+            auto it = y_by_doc.find(doc);
+            if (it == y_by_doc.end()) {
+                size_t doc_len;
+                string text = _extract_doc(s, doc, max_term_len - 1, doc_len);
+                double y = 0.0;
+                if (matches_text(text, doc_len, skip)) {
+                    size_t occurrences = 0;
+                    for (const auto &term : cnf[r]) occurrences += _count_occurrences(text, doc_len, term);
+                    y = 1.0 / max(occurrences, (size_t)1);
+                    docs.push_back(doc);
+                }
+                it = y_by_doc.emplace(doc, y).first;
+            }
+            sum += it->second;
+        }
+        sort(docs.begin(), docs.end());
+        if (docs.size() > max_docs) docs.resize(max_docs);
+        count = n * sum / m;
+        return false;
+    }
+
+    // Appends the distinct local doc ixs of SA range [lo, hi) to docs; returns false if max_docs or max_work ran out first
+    bool _list_shard_docs(const size_t s, const size_t lo, const size_t hi, const size_t max_docs, const size_t max_work, vector<size_t>& docs) const {
+
+        const auto &shard = _shards[s];
+        unordered_set<size_t> seen;
+        if (lo >= hi) {
+            return true;
+        }
+        if (shard.doc_rmq) {
+            // The minimum of C over a range is a first occurrence of its document within [lo, hi) unless that document
+            // has been reported already, in which case the range holds no new documents (Sadakane's variant)
+            vector<pair<size_t, size_t>> stack = {{lo, hi - 1}};
+            size_t work = 0;
+            while (!stack.empty()) {
+                if (docs.size() >= max_docs || work >= max_work) {
+                    return false;
+                }
+                auto [l, r] = stack.back();
+                stack.pop_back();
+                size_t m = (*shard.doc_rmq)(l, r);
+                size_t doc = _convert_ptr_to_doc_ix(shard, (*shard.data_index)[m]);
+                work++;
+                if (!seen.insert(doc).second) continue;
+                docs.push_back(doc);
+                if (m < r) stack.push_back({m + 1, r});
+                if (m > l) stack.push_back({l, m - 1});
+            }
+            return true;
+        }
+        for (size_t rank = lo; rank < hi; rank++) {
+            if (docs.size() >= max_docs || rank - lo >= max_work) {
+                return false;
+            }
+            size_t doc = _convert_ptr_to_doc_ix(shard, (*shard.data_index)[rank]);
+            if (seen.insert(doc).second) {
+                docs.push_back(doc);
+            }
+        }
+        return true;
+    }
+
+    // Fewer sampled occurrences than this make the normal approximation of count_docs's interval unreliable, since
+    // 1 / (occurrences in the document) is heavily skewed when most occurrences sit in a few repetitive documents.
+    static constexpr size_t MIN_DOC_SAMPLE = 60;
+
+    // Samples occurrences of SA range [lo, hi) in random order for as long as locating them (a step each) and extracting
+    // their documents (a step per SA sample period of bytes, once per document) fits in max_work steps. Documents are
+    // only extracted if that admits at least MIN_DOC_SAMPLE occurrences; returns false otherwise, in which case count
+    // is just the number of distinct documents located, or 1 if there are none.
+    bool _estimate_shard_docs(const size_t s, const string& query, const size_t lo, const size_t hi, const size_t sample_size, const size_t max_work, double& count, double& variance) const {
+
+        const auto &shard = _shards[s];
+        const size_t n = hi - lo;
+
+        // a prefix of a random permutation of the offsets (Fisher-Yates, swapping lazily), so that stopping early still
+        // leaves a uniform sample; seeded per shard so that results are reproducible
+        mt19937_64 rng(19260817 + s);
+        unordered_map<size_t, size_t> swapped;
+        vector<size_t> sample_docs;
+        unordered_map<size_t, size_t> occurrences_by_doc;
+        size_t work = 0;
+        while (sample_docs.size() < min(sample_size, n)) {
+            const size_t j = sample_docs.size();
+            const size_t t = uniform_int_distribution<size_t>(j, n - 1)(rng);
+            auto it_t = swapped.find(t), it_j = swapped.find(j);
+            const size_t offset = it_t == swapped.end() ? t : it_t->second;
+            swapped[t] = it_j == swapped.end() ? j : it_j->second;
+
+            const size_t doc = _convert_ptr_to_doc_ix(shard, (*shard.data_index)[lo + offset]);
+            size_t cost = 1;
+            if (!occurrences_by_doc.count(doc)) {
+                const size_t doc_len = _convert_doc_ix_to_ptr(shard, doc + 1) - _convert_doc_ix_to_ptr(shard, doc);
+                cost += (doc_len + shard.data_index->sa_sample_dens - 1) / shard.data_index->sa_sample_dens;
+            }
+            if (work + cost > max_work) break;
+            work += cost;
+            occurrences_by_doc.emplace(doc, 0);
+            sample_docs.push_back(doc);
+        }
+        const size_t m = sample_docs.size();
+        if (m < MIN_DOC_SAMPLE && m < n) {
+            count = max(occurrences_by_doc.size(), (size_t)1);
+            variance = 0.0;
+            return false;
+        }
+
+        for (auto &[doc, occurrences] : occurrences_by_doc) {
+            occurrences = max(_count_doc_occurrences(s, doc, query), (size_t)1);
+        }
+        double sum = 0.0, sum_sq = 0.0;
+        for (auto doc : sample_docs) {
+            double y = 1.0 / occurrences_by_doc.at(doc);
+            sum += y;
+            sum_sq += y * y;
+        }
+        double mean = sum / m;
+        double sample_variance = m > 1 ? max(0.0, (sum_sq - m * mean * mean) / (m - 1)) : 0.0;
+        count = n * mean;
+        variance = (double)n * n * sample_variance / m * (1.0 - (double)m / n);
+        return true;
+    }
+
+    // The value of a dictionary-encoded metadata field (see src/indexing.py --meta_dict_fields) of a doc, e.g. one returned
+    // by list_docs. Empty if the doc has no such field, or its shard has no meta.store.
+    string get_doc_field(const size_t doc_ix, const string field) const {
+        size_t s = 0, local_doc_ix = doc_ix;
+        while (s < _num_shards && local_doc_ix >= _shards[s].doc_cnt) {
+            local_doc_ix -= _shards[s++].doc_cnt;
+        }
+        assert (s < _num_shards);
+        string value;
+        const auto meta_store = _shards[s].meta_store;
+        if (meta_store) {
+            int f = meta_store->field_index(field);
+            if (f >= 0) meta_store->get_field(f, local_doc_ix, value);
+        }
+        return value;
+    }
+
+    // The metadata lines of up to max_cnt docs of the corpus that src/indexing.py --dedup collapsed into a doc, e.g. one
+    // returned by get_doc_by_rank with a nonzero dup_cnt, in corpus order. Empty if its shard has no doc_dups. Throws
+    // out_of_range if doc_ix is not less than the number of docs.
+    vector<string> get_doc_dups(const size_t doc_ix, const size_t max_cnt) const {
+        size_t s = 0, local_doc_ix = doc_ix;
+        while (s < _num_shards && local_doc_ix >= _shards[s].doc_cnt) {
+            local_doc_ix -= _shards[s++].doc_cnt;
+        }
+        if (s == _num_shards) {
+            throw out_of_range("doc_ix " + to_string(doc_ix) + " is out of range");
+        }
+        vector<string> dups;
+        const auto doc_dups = _shards[s].doc_dups;
+        if (doc_dups) {
+            for (size_t i = 0; i < min(doc_dups->count(local_doc_ix), max_cnt); i++) {
+                dups.push_back(doc_dups->get(local_doc_ix, i));
+            }
+        }
+        return dups;
+    }
+
+    // Counts the occurrences of the query by the value of a doc attribute (see src/indexing.py --doc_attrs). A shard is
+    // exact if all its occurrences can be located within max_work steps. Otherwise its counts are estimated from
+    // sample_size occurrences, stratified over equal slices of its SA interval. Throws invalid_argument if a shard has no
+    // such attribute, or if sample_size is less than 2.
+    AttributeCountResult count_by_attribute(const string& query, const string& attr, const size_t max_work, const size_t sample_size) const {
 
-struct DocResult {
-    size_t doc_ix;
-    size_t doc_len;
-    size_t disp_len;
-    size_t needle_offset;
-    string metadata;
-    string text;
-};
+        if (sample_size < 2) {
+            throw invalid_argument("sample_size must be at least 2");
+        }
+        for (const auto &shard : _shards) {
+            if (!shard.doc_attrs.count(attr)) {
+                throw invalid_argument("no doc attribute " + attr);
+            }
+        }
+        auto find_result = find(query);
+        vector<vector<pair<double, double>>> counts_by_shard(_num_shards); // (count, variance) by code
+        vector<char> exact_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                auto [lo, hi] = find_result.segment_by_shard[s];
+                exact_by_shard[s] = _count_shard_attribute(s, *_shards[s].doc_attrs.at(attr), lo, hi, max_work, sample_size, counts_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        // shards have their own dictionaries, so merge by value
+        map<string, pair<double, double>> counts_by_value;
+        bool exact = true;
+        for (size_t s = 0; s < _num_shards; s++) {
+            exact = exact && exact_by_shard[s];
+            const auto &values = _shards[s].doc_attrs.at(attr)->values;
+            for (size_t code = 0; code < values.size(); code++) {
+                if (counts_by_shard[s][code].first > 0) {
+                    counts_by_value[values[code]].first += counts_by_shard[s][code].first;
+                    counts_by_value[values[code]].second += counts_by_shard[s][code].second;
+                }
+            }
+        }
+        vector<pair<string, pair<double, double>>> sorted(counts_by_value.begin(), counts_by_value.end());
+        stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.first > b.second.first; });
 
-class Engine {
+        AttributeCountResult result{ .cnt = find_result.cnt, .values = {}, .counts = {}, .ci_low = {}, .ci_high = {}, .exact = exact, };
+        for (const auto &[value, count_variance] : sorted) {
+            auto [count, variance] = count_variance;
+            result.values.push_back(value);
+            result.counts.push_back(count);
+            result.ci_low.push_back(variance > 0 ? max(count - 1.96 * sqrt(variance), 1.0) : count);
+            result.ci_high.push_back(variance > 0 ? min(count + 1.96 * sqrt(variance), (double)find_result.cnt) : count);
+        }
+        return result;
+    }
 
-public:
+    // Occurrences in the SA interval [lo, hi) of shard s by attribute code, with the variance of each estimate.
+    // Returns whether they are exact.
+    bool _count_shard_attribute(const size_t s, const DocAttribute& attr, const size_t lo, const size_t hi, const size_t max_work, const size_t sample_size, vector<pair<double, double>>& counts) const {
 
-    Engine (const vector<string> index_dirs, bool load_to_ram, bool get_metadata)
-            : _load_to_ram(load_to_ram), _get_metadata(get_metadata) {
+        const auto &shard = _shards[s];
+        counts.assign(attr.values.size(), {0.0, 0.0});
+        const size_t n = hi - lo;
+        if (n <= max_work) {
+            vector<size_t> ranks(n);
+            iota(ranks.begin(), ranks.end(), lo);
+            for (auto ptr : _locate_batch(*shard.data_index, ranks)) {
+                counts[attr.codes[_convert_ptr_to_doc_ix(shard, ptr)]].first += 1;
+            }
+            return true;
+        }
 
-        for (const auto &index_dir : index_dirs) {
-            assert (fs::exists(index_dir));
+        // SA neighbors share their right context, and so often their source, so stratifying over slices of the interval
+        // cuts the variance compared to a uniform sample. Each stratum gets at least 8 samples.
+        const size_t m = min(sample_size, n);
+        const size_t strata = max(m / 8, (size_t)1);
+        mt19937_64 rng(19260817 + s);
+        vector<size_t> ranks, stratum_sizes, sample_sizes;
+        for (size_t h = 0; h < strata; h++) {
+            const size_t begin = lo + n * h / strata, end = lo + n * (h + 1) / strata;
+            const size_t n_h = min(m / strata + (h < m % strata), end - begin);
+            // Floyd's algorithm for n_h distinct ranks
+            unordered_set<size_t> sample;
+            for (size_t j = end - begin - n_h; j < end - begin; j++) {
+                size_t t = uniform_int_distribution<size_t>(0, j)(rng);
+                sample.insert(sample.count(t) ? j : t);
+            }
+            for (auto offset : sample) {
+                ranks.push_back(begin + offset);
+            }
+            stratum_sizes.push_back(end - begin);
+            sample_sizes.push_back(n_h);
+        }
 
-            auto data_index = new index_t();
-            auto data_index_path = index_dir + "/data.fm9";
-            if (_load_to_ram) {
-                load_from_file(*data_index, data_index_path);
-            } else {
-                load_from_file_(*data_index, data_index_path);
-            }
-            string data_offset_path = index_dir + "/data_offset";
-            int data_fd = open(data_offset_path.c_str(), O_RDONLY);
-            assert(data_fd >= 0);
-            off_t data_offset_size = lseek(data_fd, 0, SEEK_END);
-            assert(data_offset_size > 0);
-            size_t* data_offset = (size_t*)mmap(nullptr, data_offset_size, PROT_READ, MAP_PRIVATE, data_fd, 0);
-            assert(data_offset != MAP_FAILED);
-            size_t doc_cnt = data_offset_size / sizeof(size_t);
-
-            meta_index_t* meta_index;
-            size_t* meta_offset;
-            if (_get_metadata) {
-                meta_index = new meta_index_t();
-                auto meta_index_path = index_dir + "/meta.fm9";
-                if (_load_to_ram) {
-                    load_from_file(*meta_index, meta_index_path);
-                } else {
-                    load_from_file_(*meta_index, meta_index_path);
+        auto ptrs = _locate_batch(*shard.data_index, ranks);
+        unordered_map<size_t, size_t> sampled_by_code;
+        for (size_t h = 0, i = 0; h < strata; h++) {
+            sampled_by_code.clear();
+            for (size_t j = 0; j < sample_sizes[h]; j++, i++) {
+                sampled_by_code[attr.codes[_convert_ptr_to_doc_ix(shard, ptrs[i])]]++;
+            }
+            const double N_h = stratum_sizes[h], n_h = sample_sizes[h];
+            for (auto [code, k] : sampled_by_code) {
+                const double p = k / n_h;
+                counts[code].first += N_h * p;
+                if (n_h > 1) {
+                    counts[code].second += N_h * N_h * (1.0 - n_h / N_h) * p * (1.0 - p) / (n_h - 1);
                 }
-                string meta_offset_path = index_dir + "/meta_offset";
-                int meta_fd = open(meta_offset_path.c_str(), O_RDONLY);
-                assert(meta_fd >= 0);
-                off_t meta_offset_size = lseek(meta_fd, 0, SEEK_END);
-                assert(meta_offset_size > 0);
-                meta_offset = (size_t*)mmap(nullptr, meta_offset_size, PROT_READ, MAP_PRIVATE, meta_fd, 0);
-                assert(meta_offset != MAP_FAILED);
             }
+        }
+        return false;
+    }
+
+    // Counts the occurrences of the query in the corpus before src/indexing.py --dedup, i.e. each occurrence once for its
+    // doc and once for each doc collapsed into it. A shard is exact if it has no doc_dups, or if all its occurrences can be
+    // located within max_work steps. Otherwise its count is estimated from sample_size occurrences drawn uniformly.
+    // Throws invalid_argument if sample_size is less than 2.
+    DupCountResult count_with_dups(const string& query, const size_t max_work, const size_t sample_size) const {
 
-            auto shard = FMIndexShard{data_index, data_offset, meta_index, meta_offset, doc_cnt};
-            _shards.push_back(shard);
+        if (sample_size < 2) {
+            throw invalid_argument("sample_size must be at least 2");
+        }
+        auto find_result = find(query);
+        vector<double> count_by_shard(_num_shards, 0.0), variance_by_shard(_num_shards, 0.0);
+        vector<char> exact_by_shard(_num_shards);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                auto [lo, hi] = find_result.segment_by_shard[s];
+                exact_by_shard[s] = _count_shard_dups(s, lo, hi, max_work, sample_size, count_by_shard[s], variance_by_shard[s]);
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
         }
 
-        _num_shards = _shards.size();
-        assert(_num_shards > 0);
+        double count = 0.0, variance = 0.0;
+        bool exact = true;
+        for (size_t s = 0; s < _num_shards; s++) {
+            count += count_by_shard[s];
+            variance += variance_by_shard[s];
+            exact = exact && exact_by_shard[s];
+        }
+        double ci_low = count, ci_high = count;
+        if (!exact) {
+            ci_low = max(count - 1.96 * sqrt(variance), (double)find_result.cnt);
+            ci_high = count + 1.96 * sqrt(variance);
+        }
+        return DupCountResult{ .cnt = find_result.cnt, .count = count, .exact = exact, .ci_low = ci_low, .ci_high = ci_high, };
     }
 
-    ~Engine() {
+    // Occurrences in the SA interval [lo, hi) of shard s, each weighted by 1 + the dups of its doc, with the variance of the
+    // estimate. Returns whether it is exact.
+    bool _count_shard_dups(const size_t s, const size_t lo, const size_t hi, const size_t max_work, const size_t sample_size, double& count, double& variance) const {
 
-        for (auto& shard : _shards) {
-            if (_load_to_ram) {
-                delete shard.data_index;
-                if (_get_metadata) {
-                    delete shard.meta_index;
-                }
-            } else {
-                munmap(shard.data_index, shard.data_index->size());
-                if (_get_metadata) {
-                    munmap(shard.meta_index, shard.meta_index->size());
-                }
+        const auto &shard = _shards[s];
+        const size_t n = hi - lo;
+        count = n;
+        variance = 0.0;
+        if (!shard.doc_dups || shard.doc_dups->dup_cnt == 0 || n == 0) {
+            return true;
+        }
+        auto weight = [&](const size_t ptr) { return 1.0 + shard.doc_dups->count(_convert_ptr_to_doc_ix(shard, ptr)); };
+        if (n <= max_work) {
+            vector<size_t> ranks(n);
+            iota(ranks.begin(), ranks.end(), lo);
+            count = 0.0;
+            for (auto ptr : _locate_batch(*shard.data_index, ranks)) {
+                count += weight(ptr);
             }
-            // TODO: munmap *_offset
+            return true;
+        }
+
+        // Floyd's algorithm for m distinct ranks; seeded per shard so that results are reproducible
+        const size_t m = min(sample_size, n);
+        mt19937_64 rng(19260817 + s);
+        unordered_set<size_t> sample;
+        for (size_t j = n - m; j < n; j++) {
+            size_t t = uniform_int_distribution<size_t>(0, j)(rng);
+            sample.insert(sample.count(t) ? j : t);
+        }
+        vector<size_t> ranks;
+        for (auto offset : sample) {
+            ranks.push_back(lo + offset);
         }
+        double sum = 0.0, sum_sq = 0.0;
+        for (auto ptr : _locate_batch(*shard.data_index, ranks)) {
+            double y = weight(ptr);
+            sum += y;
+            sum_sq += y * y;
+        }
+        double mean = sum / m;
+        double sample_variance = m > 1 ? max(0.0, (sum_sq - m * mean * mean) / (m - 1)) : 0.0;
+        count = n * mean;
+        variance = (double)n * n * sample_variance / m * (1.0 - (double)m / n);
+        return false;
     }
 
-    FindResult find(const string query) const {
+    DocResult get_doc_by_rank(const size_t s, const size_t rank, const size_t needle_len, const size_t max_ctx_len) const {
 
-        vector<pair<size_t, size_t>> segment_by_shard(_num_shards);
-        if (query.length() == 0) {
-            for (size_t s = 0; s < _num_shards; s++) {
-                segment_by_shard[s] = {0, _shards[s].data_index->size()};
+        assert (s < _num_shards);
+        const auto &shard = _shards[s];
+        assert (rank < shard.data_index->size());
+
+        string cache_key;
+        if (_cache) {
+            cache_key = ResultCache::doc_key(_shard_epochs[s], s, rank, needle_len, max_ctx_len);
+            DocResult cached;
+            if (_cache->get_doc(cache_key, cached)) {
+                return cached;
             }
+        }
+
+        PhaseTimer timer;
+        const bool profiling = _profiling.load(memory_order_relaxed);
+        QueryProfile profile;
+        auto faults = profiling ? thread_page_faults() : pair<size_t, size_t>{0, 0};
+
+        size_t ptr;
+        if (profiling) {
+            PhaseTimer phase;
+            ptr = _locate(*shard.data_index, rank, &profile);
+            profile.locate_us = phase.elapsed_us();
         } else {
-            vector<thread> threads;
-            for (size_t s = 0; s < _num_shards; s++) {
-                threads.emplace_back(&Engine::_find_thread, this, s, &query, &segment_by_shard[s]);
-            }
-            for (auto &thread : threads) {
-                thread.join();
-            }
+            ptr = (*shard.data_index)[rank];
         }
 
-        size_t cnt = 0;
-        for (size_t s = 0; s < _num_shards; s++) {
-            assert (segment_by_shard[s].first <= segment_by_shard[s].second);
-            cnt += segment_by_shard[s].second - segment_by_shard[s].first;
+        auto result = _get_doc_by_ptr(s, ptr, needle_len, max_ctx_len, profiling ? &profile : nullptr);
+
+        if (profiling) {
+            auto faults_after = thread_page_faults();
+            profile.minor_faults += faults_after.first - faults.first;
+            profile.major_faults += faults_after.second - faults.second;
+            _profiler.locate.record(profile.locate_us);
+            _profiler.doc_search.record(profile.doc_search_us);
+            _profiler.extract.record(profile.extract_us);
+            if (_get_metadata) {
+                _profiler.metadata.record(profile.metadata_us);
+            }
+            _profiler.get_doc_by_rank.record(timer.elapsed_us());
+            _profiler.add_counters(profile);
+            result.profile = profile;
         }
 
-        return FindResult{ .cnt = cnt, .segment_by_shard = segment_by_shard, };
+        if (!cache_key.empty()) {
+            _cache->put_doc(cache_key, result);
+        }
+        return result;
     }
 
-    void _find_thread(const size_t s, const string* const query, pair<size_t, size_t>* const segment) const {
+    // The document around the occurrence at a rank of the token index (see find_tokens), with max_ctx_len tokens of context
+    // on each side. doc_ix is the same as for the byte index.
+    TokenDocResult get_doc_by_token_rank(const size_t s, const size_t rank, const size_t needle_len, const size_t max_ctx_len) const {
 
-        size_t lo = 0;
-        size_t hi = 0;
-        auto count = sdsl::backward_search(*_shards[s].data_index, 0, _shards[s].data_index->size() - 1, query->begin(), query->end(), lo, hi);
-        segment->first = lo;
-        segment->second = hi + 1; // so that right end is exclusive
+        assert (s < _num_shards);
+        const auto &shard = _shards[s];
+        if (!shard.tok_index) {
+            throw invalid_argument("index has no token index (data.tok.fm9)");
+        }
+        const auto &index = *shard.tok_index;
+        assert (rank < index.size());
+
+        size_t ptr = index[rank];
+        size_t local_doc_ix = upper_bound(shard.tok_offset, shard.tok_offset + shard.doc_cnt, ptr) - shard.tok_offset - 1;
+        size_t doc_start_ptr = shard.tok_offset[local_doc_ix] + 1; // skip the TOKEN_DOC_SEP
+        size_t doc_end_ptr = local_doc_ix + 1 < shard.doc_cnt ? shard.tok_offset[local_doc_ix + 1] : index.size() - 1; // -1 to exclude the final 0
+        size_t disp_start_ptr = max(doc_start_ptr, ptr < max_ctx_len ? 0 : (ptr - max_ctx_len));
+        size_t disp_end_ptr = min(doc_end_ptr, ptr + needle_len + max_ctx_len);
+
+        vector<uint32_t> token_ids;
+        if (disp_start_ptr < disp_end_ptr) {
+            auto symbols = sdsl::extract(index, disp_start_ptr, disp_end_ptr - 1);
+            for (auto c : symbols) {
+                token_ids.push_back(c - TOKEN_ID_SHIFT);
+            }
+        }
+
+        return TokenDocResult{
+            .doc_ix = _doc_ix_offset(s) + local_doc_ix,
+            .doc_len = doc_end_ptr - doc_start_ptr,
+            .disp_len = disp_end_ptr - disp_start_ptr,
+            .needle_offset = ptr - disp_start_ptr,
+            .metadata = _get_metadata ? _get_doc_metadata(s, local_doc_ix, nullptr) : "",
+            .token_ids = token_ids,
+        };
     }
 
-    CountResult count(const string& query) const {
+    // Draws n occurrences of the query uniformly at random (with replacement) across all shards, and returns their
+    // documents in draw order. The same seed gives the same sample. Ranks are located together per shard, and the context
+    // before each occurrence is read off the same LF walk (see _locate_batch), so only the rest is extracted.
+    vector<DocResult> sample_occurrences(const string& query, const size_t n, const uint64_t seed, const size_t max_ctx_len) const {
 
         auto find_result = find(query);
-        return CountResult{ .count = find_result.cnt, };
-    }
+        if (find_result.cnt == 0) {
+            return {};
+        }
 
-    DocResult get_doc_by_rank(const size_t s, const size_t rank, const size_t needle_len, const size_t max_ctx_len) const {
+        // a global rank in [0, cnt) picks shard s with probability proportional to its interval size
+        mt19937_64 rng(seed);
+        vector<vector<size_t>> ranks_by_shard(_num_shards), draws_by_shard(_num_shards);
+        for (size_t i = 0; i < n; i++) {
+            size_t rank = uniform_int_distribution<size_t>(0, find_result.cnt - 1)(rng);
+            size_t s = 0;
+            while (rank >= find_result.segment_by_shard[s].second - find_result.segment_by_shard[s].first) {
+                rank -= find_result.segment_by_shard[s].second - find_result.segment_by_shard[s].first;
+                s++;
+            }
+            ranks_by_shard[s].push_back(find_result.segment_by_shard[s].first + rank);
+            draws_by_shard[s].push_back(i);
+        }
 
-        assert (s < _num_shards);
-        const auto &shard = _shards[s];
-        assert (rank < shard.data_index->size());
+        vector<DocResult> results(n);
+        vector<thread> threads;
+        for (size_t s = 0; s < _num_shards; s++) {
+            threads.emplace_back(_on_shard_node(s, [&, s]() {
+                vector<string> lefts;
+                auto ptrs = _locate_batch(*_shards[s].data_index, ranks_by_shard[s], max_ctx_len, &lefts);
+                for (size_t j = 0; j < ptrs.size(); j++) {
+                    results[draws_by_shard[s][j]] = _get_doc_by_ptr(s, ptrs[j], query.length(), max_ctx_len, nullptr, &lefts[j]);
+                }
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        return results;
+    }
 
-        size_t ptr = (*shard.data_index)[rank];
+    // Locates many ranks at once: repeated ranks are located once, and the LF walks of the rest advance in lockstep, so
+    // that their independent wavelet tree lookups overlap instead of each waiting on the previous one's cache misses.
+    // Each LF step also yields the byte before the current position, so if lefts is given, the walks continue until they
+    // have also read the left_len bytes before each located position (wrapping around at the start of the text).
+    static vector<size_t> _locate_batch(const index_t& index, const vector<size_t>& ranks, const size_t left_len = 0, vector<string>* const lefts = nullptr) {
 
-        size_t lo = 0, hi = shard.doc_cnt;
-        while (hi - lo > 1) {
-            // _prefetch_doc(shard, lo, hi); // TODO: implement this
-            size_t mi = (lo + hi) >> 1;
-            size_t p = _convert_doc_ix_to_ptr(shard, mi);
-            if (p <= ptr) {
-                lo = mi;
-            } else {
-                hi = mi;
+        vector<size_t> unique_ranks = ranks;
+        sort(unique_ranks.begin(), unique_ranks.end());
+        unique_ranks.erase(unique(unique_ranks.begin(), unique_ranks.end()), unique_ranks.end());
+
+        const size_t want_left = lefts ? left_len : 0;
+        vector<size_t> ptrs(unique_ranks.size(), SIZE_MAX);
+        vector<string> reversed_lefts(lefts ? unique_ranks.size() : 0);
+        vector<size_t> pending(unique_ranks.size()), current = unique_ranks;
+        iota(pending.begin(), pending.end(), 0);
+        for (size_t off = 0; !pending.empty(); off++) {
+            size_t kept = 0;
+            for (auto j : pending) {
+                if (ptrs[j] == SIZE_MAX && index.sa_sample.is_sampled(current[j])) {
+                    ptrs[j] = (index.sa_sample[current[j]] + off) % index.size();
+                }
+                if (ptrs[j] != SIZE_MAX && off >= want_left) continue;
+                auto [rank, c] = index.wavelet_tree.inverse_select(current[j]);
+                current[j] = index.C[index.char2comp[c]] + rank;
+                if (off < want_left) reversed_lefts[j].push_back(c);
+                pending[kept++] = j;
             }
+            pending.resize(kept);
+        }
+
+        vector<size_t> result;
+        for (auto rank : ranks) {
+            size_t j = lower_bound(unique_ranks.begin(), unique_ranks.end(), rank) - unique_ranks.begin();
+            result.push_back(ptrs[j]);
+            if (lefts) lefts->emplace_back(reversed_lefts[j].rbegin(), reversed_lefts[j].rend());
+        }
+        return result;
+    }
+
+    // The document around text position ptr; fills in the doc search, extract and metadata times if profile is not null.
+    // left, if given, holds the max_ctx_len bytes before ptr, so that only the text from ptr on is extracted.
+    DocResult _get_doc_by_ptr(const size_t s, const size_t ptr, const size_t needle_len, const size_t max_ctx_len, QueryProfile* const profile, const string* const left = nullptr) const {
+
+        const auto &shard = _shards[s];
+        PhaseTimer doc_search_timer;
+        size_t local_doc_ix = _convert_ptr_to_doc_ix(shard, ptr);
+        if (profile) {
+            profile->doc_search_us = doc_search_timer.elapsed_us();
         }
-        size_t local_doc_ix = lo;
-        size_t doc_ix = 0; for (size_t _ = 0; _ < s; _++) doc_ix += _shards[_].doc_cnt; doc_ix += local_doc_ix;
+        size_t doc_ix = _doc_ix_offset(s) + local_doc_ix;
 
         size_t doc_start_ptr = _convert_doc_ix_to_ptr(shard, local_doc_ix) + 1; // left-inclusive; +1 because we want to skip the document separator
         size_t doc_end_ptr = _convert_doc_ix_to_ptr(shard, local_doc_ix + 1); // right-exclusive
@@ -197,36 +2882,51 @@ public:
         size_t disp_len = disp_end_ptr - disp_start_ptr;
         size_t needle_offset = ptr - disp_start_ptr;
 
+        PhaseTimer extract_timer;
         string text = "";
-        if (disp_start_ptr < disp_end_ptr) {
+        if (left && disp_start_ptr <= ptr && ptr < disp_end_ptr) {
+            text = left->substr(left->length() - needle_offset) + parallel_extract(s, ptr, disp_end_ptr, false, profile);
+        } else if (disp_start_ptr < disp_end_ptr) {
             // text = sdsl::extract(*shard.data_index, disp_start_ptr, disp_end_ptr - 1);
-            text = parallel_extract(s, disp_start_ptr, disp_end_ptr, false);
+            text = parallel_extract(s, disp_start_ptr, disp_end_ptr, false, profile);
+        }
+        if (profile) {
+            profile->extract_us = extract_timer.elapsed_us();
         }
 
-        string metadata = "";
-        if (_get_metadata) {
-            size_t meta_start_ptr = _convert_doc_ix_to_meta_ptr(shard, local_doc_ix); // left-inclusive
-            size_t meta_end_ptr = _convert_doc_ix_to_meta_ptr(shard, local_doc_ix + 1) - 1; // right-exclusive; -1 because there is a trailing \n
-            if (meta_start_ptr < meta_end_ptr) {
-                // metadata = sdsl::extract(*shard.meta_index, meta_start_ptr, meta_end_ptr - 1);
-                metadata = parallel_extract(s, meta_start_ptr, meta_end_ptr, true);
-            }
+        PhaseTimer metadata_timer;
+        string metadata = _get_metadata ? _get_doc_metadata(s, local_doc_ix, profile) : "";
+        if (profile) {
+            profile->metadata_us = metadata_timer.elapsed_us();
         }
 
-        return DocResult{ .doc_ix = doc_ix, .doc_len = doc_len, .disp_len = disp_len, .needle_offset = needle_offset, .metadata = metadata, .text = text, };
+        return DocResult{ .doc_ix = doc_ix, .doc_len = doc_len, .disp_len = disp_len, .needle_offset = needle_offset, .metadata = metadata, .text = text, .dup_cnt = shard.doc_dups ? shard.doc_dups->count(local_doc_ix) : 0, .profile = {}, };
     }
 
-    string parallel_extract(size_t shard_index, size_t disp_start_ptr, size_t disp_end_ptr, bool is_meta) const {
+    string _get_doc_metadata(const size_t s, const size_t local_doc_ix, QueryProfile* const profile) const {
+
+        const auto &shard = _shards[s];
+        if (shard.meta_store) {
+            return shard.meta_store->get(local_doc_ix);
+        }
+        size_t meta_start_ptr = _convert_doc_ix_to_meta_ptr(shard, local_doc_ix); // left-inclusive
+        size_t meta_end_ptr = _convert_doc_ix_to_meta_ptr(shard, local_doc_ix + 1) - 1; // right-exclusive; -1 because there is a trailing \n
+        if (meta_start_ptr >= meta_end_ptr) {
+            return "";
+        }
+        // return sdsl::extract(*shard.meta_index, meta_start_ptr, meta_end_ptr - 1);
+        return parallel_extract(s, meta_start_ptr, meta_end_ptr, true, profile);
+    }
+
+    string parallel_extract(size_t shard_index, size_t disp_start_ptr, size_t disp_end_ptr, bool is_meta, QueryProfile* const profile = nullptr) const {
         if (disp_start_ptr >= disp_end_ptr) return "";
 
         const size_t total_len = disp_end_ptr - disp_start_ptr;
 
         if (total_len < 100) {
-            if (is_meta) {
-                return sdsl::extract(*_shards[shard_index].meta_index, disp_start_ptr, disp_end_ptr - 1); // inclusive
-            } else {
-                return sdsl::extract(*_shards[shard_index].data_index, disp_start_ptr, disp_end_ptr - 1); // inclusive
-            }
+            string result;
+            _extract_thread(shard_index, disp_start_ptr, disp_end_ptr, &result, is_meta, profile);
+            return result;
         }
 
         const size_t num_threads = min(total_len / 100, size_t(10));
@@ -234,6 +2934,7 @@ public:
         const size_t chunk_size = (total_len + num_threads - 1) / num_threads;
 
         vector<string> segments(num_threads);
+        vector<QueryProfile> profiles(profile ? num_threads : 0);
         vector<thread> threads;
 
         for (size_t i = 0; i < num_threads; ++i) {
@@ -244,7 +2945,7 @@ public:
             }
 
             const size_t end = min(start + chunk_size, disp_end_ptr);
-            threads.emplace_back(&Engine::_extract_thread, this, shard_index, start, end, &segments[i], is_meta);
+            threads.emplace_back(_on_shard_node(shard_index, [&, i, start, end]() { _extract_thread(shard_index, start, end, &segments[i], is_meta, profile ? &profiles[i] : nullptr); }));
         }
 
         for (auto &t : threads) {
@@ -255,21 +2956,352 @@ public:
         for (auto &seg : segments) {
             result += seg;
         }
+        for (const auto &p : profiles) {
+            profile->merge(p);
+        }
 
         return result;
     }
 
-    void _extract_thread(size_t shard_index, size_t start, size_t end, string* out, bool is_meta) const {
+    void _extract_thread(size_t shard_index, size_t start, size_t end, string* out, bool is_meta, QueryProfile* const profile = nullptr) const {
+        auto faults = profile ? thread_page_faults() : pair<size_t, size_t>{0, 0};
         if (is_meta) {
             *out = sdsl::extract(*_shards[shard_index].meta_index, start, end - 1); // inclusive
         } else {
             *out = sdsl::extract(*_shards[shard_index].data_index, start, end - 1); // inclusive
         }
+        if (profile) {
+            auto faults_after = thread_page_faults();
+            profile->lf_steps += end - start; // one LF step per extracted byte, plus the ISA lookup
+            profile->rank_calls += end - start;
+            profile->minor_faults += faults_after.first - faults.first;
+            profile->major_faults += faults_after.second - faults.second;
+        }
+    }
+
+    // Enables per-query profiles in results and aggregation into the histograms returned by stats()
+    void set_profiling(const bool enabled) {
+        _profiling.store(enabled, memory_order_relaxed);
+    }
+
+    EngineStats stats() const {
+        return _profiler.stats();
+    }
+
+    // Caches find results and DocResults of at most max_doc_bytes, using at most max_bytes in total.
+    // Not synchronized with queries: call before serving, or while no query is in flight.
+    void enable_cache(const size_t max_bytes, const size_t max_doc_bytes) {
+        _cache = make_unique<ResultCache>(max_bytes, max_doc_bytes);
+    }
+
+    void disable_cache() {
+        _cache.reset();
+    }
+
+    void clear_cache() {
+        if (_cache) _cache->clear();
+    }
+
+    CacheStats cache_stats() const {
+        if (!_cache) return CacheStats{0, 0, 0, 0, 0, 0, 0};
+        return _cache->stats();
+    }
+
+    // Persists the cached entries, so that a restarted engine can come up warm with load_cache()
+    size_t save_cache(const string& path) const {
+        assert (_cache);
+        return _cache->save(path, _shard_epochs);
+    }
+
+    // Returns the number of entries loaded; entries of shards whose files have changed since save_cache() are dropped
+    size_t load_cache(const string& path) {
+        assert (_cache);
+        return _cache->load(path, _shard_epochs);
+    }
+
+    // Whether find() starts backward search from data.kgram intervals where available; on by default
+    void set_use_kgram_table(const bool enabled) {
+        _use_kgram_table.store(enabled, memory_order_relaxed);
+    }
+
+    // Whether find() searches all shards in this thread, interleaving their memory accesses (see _find_interleaved),
+    // rather than in one thread per shard; off by default
+    void set_interleaved_search(const bool enabled) {
+        _interleaved_search.store(enabled, memory_order_relaxed);
+    }
+
+    size_t num_shards() const {
+        return _num_shards;
+    }
+
+    size_t shard_size(const size_t s) const {
+        assert (s < _num_shards);
+        return _shards[s].data_index->size();
+    }
+
+    // The NUMA node each shard is placed on (all 0 unless the engine is NUMA-aware on a machine with several nodes)
+    vector<size_t> shard_nodes() const {
+        return _node_cpus.size() > 1 ? _shard_nodes : vector<size_t>(_num_shards, 0);
+    }
+
+    // Seconds each shard took to load, in the constructor
+    vector<double> shard_load_seconds() const {
+        return _shard_load_seconds;
     }
 
 private:
 
-    inline size_t _convert_doc_ix_to_ptr(const FMIndexShard& shard, const size_t doc_ix) const {
+    // Loads shard s from index_dir, reading meta.fm9 and data.tok.fm9 in their own threads while this one reads data.fm9
+    void _load_shard(const size_t s, const string& index_dir) {
+        auto start_time = steady_clock::now();
+        assert (fs::exists(index_dir));
+
+        // from the page-aligned container of the file (src/convert_paged.cpp) if there is one
+        auto load_fm9 = [&](auto* index, const string& path) {
+            if (fs::exists(path + "p")) {
+                bool loaded = _load_to_ram ? load_from_paged_file(*index, path + "p") : load_from_paged_file_(*index, path + "p");
+                assert (loaded);
+            } else if (_load_to_ram) {
+                load_from_file(*index, path);
+            } else {
+                load_from_file_(*index, path);
+            }
+        };
+        vector<thread> threads;
+
+        string meta_store_path = index_dir + "/meta.store";
+        meta_index_t* meta_index = nullptr;
+        if (_get_metadata && !fs::exists(meta_store_path)) {
+            meta_index = new meta_index_t();
+            threads.emplace_back(_on_shard_node(s, [&]() { load_fm9(meta_index, index_dir + "/meta.fm9"); }));
+        }
+        tok_index_t* tok_index = nullptr;
+        string tok_index_path = index_dir + "/data.tok.fm9";
+        if (fs::exists(tok_index_path) || fs::exists(tok_index_path + "p")) {
+            tok_index = new tok_index_t();
+            threads.emplace_back(_on_shard_node(s, [&]() { load_fm9(tok_index, tok_index_path); }));
+        }
+
+        auto data_index = new index_t();
+        auto data_index_path = index_dir + "/" + data_index_file<index_t>;
+        load_fm9(data_index, data_index_path);
+        string data_offset_path = index_dir + "/data_offset";
+        int data_fd = open(data_offset_path.c_str(), O_RDONLY);
+        assert(data_fd >= 0);
+        off_t data_offset_size = lseek(data_fd, 0, SEEK_END);
+        assert(data_offset_size > 0);
+        size_t* data_offset = (size_t*)mmap(nullptr, data_offset_size, PROT_READ, MAP_PRIVATE, data_fd, 0);
+        assert(data_offset != MAP_FAILED);
+        size_t doc_cnt = data_offset_size / sizeof(size_t);
+
+        MetaStore* meta_store = nullptr;
+        if (fs::exists(meta_store_path)) {
+            int meta_store_fd = open(meta_store_path.c_str(), O_RDONLY);
+            assert(meta_store_fd >= 0);
+            off_t meta_store_size = lseek(meta_store_fd, 0, SEEK_END);
+            char* meta_store_base = (char*)mmap(nullptr, meta_store_size, PROT_READ, MAP_PRIVATE, meta_store_fd, 0);
+            assert(meta_store_base != MAP_FAILED);
+            meta_store = new MetaStore(meta_store_base, meta_store_size);
+            assert (meta_store->doc_cnt == doc_cnt);
+        }
+
+        size_t* meta_offset = nullptr;
+        if (meta_index) {
+            string meta_offset_path = index_dir + "/meta_offset";
+            int meta_fd = open(meta_offset_path.c_str(), O_RDONLY);
+            assert(meta_fd >= 0);
+            off_t meta_offset_size = lseek(meta_fd, 0, SEEK_END);
+            assert(meta_offset_size > 0);
+            meta_offset = (size_t*)mmap(nullptr, meta_offset_size, PROT_READ, MAP_PRIVATE, meta_fd, 0);
+            assert(meta_offset != MAP_FAILED);
+        }
+
+        KGramTable* kgram_table = nullptr;
+        string kgram_path = index_dir + "/data.kgram";
+        if (fs::exists(kgram_path)) {
+            int kgram_fd = open(kgram_path.c_str(), O_RDONLY);
+            assert(kgram_fd >= 0);
+            off_t kgram_size = lseek(kgram_fd, 0, SEEK_END);
+            assert(kgram_size >= 2 * (off_t)sizeof(size_t));
+            size_t* kgram = (size_t*)mmap(nullptr, kgram_size, PROT_READ, MAP_PRIVATE, kgram_fd, 0);
+            assert(kgram != MAP_FAILED);
+            kgram_table = new KGramTable{kgram[0], kgram[1], kgram + 2, vector<size_t>((1 << 16) + 1)};
+            assert(kgram_size == (off_t)((2 + 3 * kgram_table->cnt) * sizeof(size_t)));
+            for (size_t b = 0, i = 0; b <= (1 << 16); b++) {
+                while (i < kgram_table->cnt && (kgram_table->entries[3 * i] >> 48) < b) i++;
+                kgram_table->bucket_start[b] = i;
+            }
+        }
+
+        rmq_succinct_sct<true>* doc_rmq = nullptr;
+        string doc_rmq_path = index_dir + "/data.doc_rmq";
+        if (fs::exists(doc_rmq_path)) {
+            doc_rmq = new rmq_succinct_sct<true>();
+            load_from_file(*doc_rmq, doc_rmq_path);
+            assert (doc_rmq->size() == data_index->size());
+        }
+
+        unordered_map<string, DocAttribute*> doc_attrs;
+        for (const auto& entry : fs::directory_iterator(index_dir)) {
+            const string name = entry.path().filename();
+            if (name.rfind("doc_attr.", 0) != 0 || entry.path().extension() == ".dict") continue;
+            auto doc_attr = new DocAttribute(entry.path());
+            assert (doc_attr->codes.size() == doc_cnt);
+            doc_attrs[name.substr(strlen("doc_attr."))] = doc_attr;
+        }
+
+        size_t* tok_offset = nullptr;
+        if (tok_index) {
+            string tok_offset_path = index_dir + "/tokens_offset";
+            int tok_fd = open(tok_offset_path.c_str(), O_RDONLY);
+            assert(tok_fd >= 0);
+            off_t tok_offset_size = lseek(tok_fd, 0, SEEK_END);
+            assert(tok_offset_size == (off_t)(doc_cnt * sizeof(size_t)));
+            tok_offset = (size_t*)mmap(nullptr, tok_offset_size, PROT_READ, MAP_PRIVATE, tok_fd, 0);
+            assert(tok_offset != MAP_FAILED);
+        }
+
+        DocDups* doc_dups = nullptr;
+        string doc_dups_path = index_dir + "/doc_dups";
+        if (fs::exists(doc_dups_path)) {
+            int doc_dups_fd = open(doc_dups_path.c_str(), O_RDONLY);
+            assert(doc_dups_fd >= 0);
+            off_t doc_dups_size = lseek(doc_dups_fd, 0, SEEK_END);
+            char* doc_dups_base = (char*)mmap(nullptr, doc_dups_size, PROT_READ, MAP_PRIVATE, doc_dups_fd, 0);
+            assert(doc_dups_base != MAP_FAILED);
+            doc_dups = new DocDups(doc_dups_base, doc_dups_size);
+            assert (doc_dups->doc_cnt == doc_cnt);
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        _shards[s] = FMIndexShard<index_t>{data_index, data_offset, meta_index, meta_offset, doc_cnt, kgram_table, doc_rmq, meta_store, doc_attrs, tok_index, tok_offset, doc_dups};
+        _shard_epochs[s] = _file_epoch(fs::exists(data_index_path + "p") ? data_index_path + "p" : data_index_path, _file_epoch(data_offset_path, 0));
+        _shard_load_seconds[s] = duration<double>(steady_clock::now() - start_time).count();
+    }
+
+    // Pins the calling thread to the CPUs of shard s's NUMA node, if the engine is NUMA-aware
+    void _pin_to_shard_node(const size_t s) const {
+        if (_node_cpus.size() > 1) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &_node_cpus[_shard_nodes[s]]);
+        }
+    }
+
+    // Wraps the work of a per-shard thread so that it runs on the shard's NUMA node
+    template <class F>
+    auto _on_shard_node(const size_t s, F f) const {
+        return [this, s, f]() {
+            _pin_to_shard_node(s);
+            f();
+        };
+    }
+
+    // Same as index[rank], but counts the LF steps taken to reach a sampled SA entry
+    template <class t_index>
+    size_t _locate(const t_index& index, size_t rank, QueryProfile* const profile) const {
+        size_t off = 0;
+        while (!index.sa_sample.is_sampled(rank)) {
+            rank = index.lf[rank];
+            ++off;
+        }
+        profile->lf_steps += off;
+        profile->rank_calls += off;
+        size_t result = index.sa_sample[rank];
+        return (result + off < index.size()) ? (result + off) : (result + off - index.size());
+    }
+
+    // The k distinct symbols of BWT[i, j), with the ranks of each at i and j, as wt_huff::interval_symbols. Without such a
+    // traversal in the wavelet tree (wt_rlmn), this takes two ranks per symbol of the alphabet.
+    static void _interval_symbols(const index_t& index, const size_t i, const size_t j, uint64_t& k, vector<uint8_t>& cs, vector<uint64_t>& rank_c_i, vector<uint64_t>& rank_c_j) {
+        if constexpr (sdsl::has_interval_symbols<typename index_t::wavelet_tree_type>::value) {
+            index.wavelet_tree.interval_symbols(i, j, k, cs, rank_c_i, rank_c_j);
+        } else {
+            k = 0;
+            for (size_t cc = 0; cc < index.sigma; cc++) {
+                const uint8_t c = index.comp2char[cc];
+                const uint64_t r_i = index.wavelet_tree.rank(i, c), r_j = index.wavelet_tree.rank(j, c);
+                if (r_i < r_j) {
+                    cs[k] = c;
+                    rank_c_i[k] = r_i;
+                    rank_c_j[k] = r_j;
+                    k++;
+                }
+            }
+        }
+    }
+
+    // Backward search for [begin, end) in a shard, starting from the k-gram table interval of its last bytes if available.
+    // Returns the number of backward steps taken.
+    size_t _search(const FMIndexShard<index_t>& shard, const char* const begin, const char* end, pair<size_t, size_t>& segment) const {
+        size_t lo = 0;
+        size_t hi = shard.data_index->size() - 1;
+        if (!_search_start(shard, begin, end, lo, hi)) {
+            segment = {0, 0};
+            return 0;
+        }
+        sdsl::backward_search(*shard.data_index, lo, hi, begin, end, lo, hi);
+        segment = {lo, hi + 1}; // so that right end is exclusive
+        return end - begin;
+    }
+
+    // Narrows [lo, hi] to the k-gram table interval of the last bytes of [begin, end) and moves end before them, if the
+    // table is available. Returns false if those bytes do not occur in the shard.
+    bool _search_start(const FMIndexShard<index_t>& shard, const char* const begin, const char*& end, size_t& lo, size_t& hi) const {
+        // \0 bytes are left to backward search, which treats them specially
+        const auto kgram_table = _use_kgram_table.load(memory_order_relaxed) ? shard.kgram_table : nullptr;
+        if (kgram_table) {
+            size_t len = min(kgram_table->k, (size_t)(end - begin));
+            if (memchr(end - len, 0, len) == nullptr) {
+                if (!kgram_table->lookup(end - len, len, lo, hi)) {
+                    return false;
+                }
+                end -= len;
+            }
+        }
+        return true;
+    }
+
+    static uint64_t _fnv1a(const void* data, const size_t len, uint64_t h) {
+        if (h == 0) h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < len; i++) {
+            h ^= ((const unsigned char*)data)[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // Changes whenever the file is rewritten, e.g. when a shard is re-indexed
+    static uint64_t _file_epoch(const string& path, const uint64_t h) {
+        struct stat st;
+        int ret = stat(path.c_str(), &st);
+        assert (ret == 0);
+        uint64_t fields[3] = {(uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec};
+        return _fnv1a(fields, sizeof(fields), h);
+    }
+
+    inline size_t _convert_ptr_to_doc_ix(const FMIndexShard<index_t>& shard, const size_t ptr) const {
+        size_t lo = 0, hi = shard.doc_cnt;
+        while (hi - lo > 1) {
+            // _prefetch_doc(shard, lo, hi); // TODO: implement this
+            size_t mi = (lo + hi) >> 1;
+            size_t p = _convert_doc_ix_to_ptr(shard, mi);
+            if (p <= ptr) {
+                lo = mi;
+            } else {
+                hi = mi;
+            }
+        }
+        return lo;
+    }
+
+    inline size_t _doc_ix_offset(const size_t s) const {
+        size_t offset = 0;
+        for (size_t _ = 0; _ < s; _++) offset += _shards[_].doc_cnt;
+        return offset;
+    }
+
+    inline size_t _convert_doc_ix_to_ptr(const FMIndexShard<index_t>& shard, const size_t doc_ix) const {
         assert (doc_ix <= shard.doc_cnt);
         if (doc_ix == shard.doc_cnt) {
             return shard.data_index->size() - 1; // -1 to exclude the last \0 byte
@@ -277,7 +3309,7 @@ private:
         return *(shard.data_offset + doc_ix);
     }
 
-    inline size_t _convert_doc_ix_to_meta_ptr(const FMIndexShard& shard, const size_t doc_ix) const {
+    inline size_t _convert_doc_ix_to_meta_ptr(const FMIndexShard<index_t>& shard, const size_t doc_ix) const {
         assert (doc_ix <= shard.doc_cnt);
         if (doc_ix == shard.doc_cnt) {
             return shard.meta_index->size() - 1; // -1 to exclude the last \0 byte
@@ -287,8 +3319,24 @@ private:
 
 private:
 
-    vector<FMIndexShard> _shards;
+    vector<FMIndexShard<index_t>> _shards;
     size_t _num_shards;
     bool _load_to_ram;
     bool _get_metadata;
+
+    atomic<bool> _profiling{false};
+    atomic<bool> _use_kgram_table{true};
+    atomic<bool> _interleaved_search{false};
+    vector<cpu_set_t> _node_cpus; // empty unless NUMA-aware
+    vector<size_t> _shard_nodes;
+    mutable EngineProfiler _profiler;
+
+    vector<uint64_t> _shard_epochs;
+    vector<double> _shard_load_seconds;
+    uint64_t _index_epoch;
+    unique_ptr<ResultCache> _cache;
 };
+
+typedef BasicEngine<index_t> Engine;
+typedef BasicEngine<rl_index_t> RLEngine;
+typedef BasicEngine<il_index_t> ILEngine;
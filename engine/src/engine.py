@@ -1,37 +1,236 @@
+import os
 import sys
 from typing import Iterable, List, Optional, cast
 
-from src.models import EngineResponse, FindResponse, CountResponse, DocResponse
-from .cpp_engine import Engine
+from src.models import EngineResponse, ApproxCountResponse, AttributeCountResponse, ApproxFindResponse, CNFResponse, FindResponse, ContaminationResponse, CountResponse, DocCountResponse, DupCountResponse, DocListResponse, DocResponse, TokenDocResponse, TopKDocsResponse, MatchingStatisticsResponse, ProfileResponse, StatsResponse, CacheStatsResponse
+from .cpp_engine import Engine, ILEngine, RLEngine
 
 class InfiniGramMiniEngine:
 
-    def __init__(self, index_dirs: Iterable[str], load_to_ram: bool, get_metadata: bool) -> None:
+    def __init__(self, index_dirs: Iterable[str], load_to_ram: bool, get_metadata: bool, numa_aware: bool = False, load_threads: int = 0) -> None:
 
         assert sys.byteorder == 'little', 'This code is designed to run on little-endian machines only!'
         assert type(index_dirs) == list and all(type(d) == str for d in index_dirs)
 
-        self.engine = Engine(index_dirs, load_to_ram, get_metadata)
+        # Indexes built with --index_type rlmn store a run-length BWT instead of data.fm9, and src/convert_rrr_il.cpp adds
+        # data.il.fm9, the same index with cache-line rrr rank samples, next to it; either may also come only as its
+        # page-aligned container (src/convert_paged.cpp)
+        def exists(name):
+            return os.path.exists(os.path.join(index_dirs[0], name)) or os.path.exists(os.path.join(index_dirs[0], name + 'p'))
+        if exists('data.rl.fm9'):
+            engine_t = RLEngine
+        elif exists('data.il.fm9'):
+            engine_t = ILEngine
+        else:
+            engine_t = Engine
+        # with numa_aware, shards are spread over NUMA nodes and the threads working on each shard are pinned to its node;
+        # shards are loaded by load_threads threads at once (0: one per core)
+        self.engine = engine_t(index_dirs, load_to_ram, get_metadata, numa_aware, load_threads)
+        self.profiling = False
+
+    def set_profiling(self, enabled: bool) -> None:
+        self.profiling = enabled
+        self.engine.set_profiling(enabled)
+
+    def set_use_kgram_table(self, enabled: bool) -> None:
+        self.engine.set_use_kgram_table(enabled)
+
+    def set_interleaved_search(self, enabled: bool) -> None:
+        self.engine.set_interleaved_search(enabled)
+
+    def shard_nodes(self) -> List[int]:
+        return self.engine.shard_nodes()
+
+    def shard_load_seconds(self) -> List[float]:
+        return self.engine.shard_load_seconds()
+
+    def stats(self) -> StatsResponse:
+        stats = self.engine.stats()
+        return {
+            'latency': {name: {'count': h.count, 'mean_us': h.mean_us, 'p50_us': h.p50_us, 'p90_us': h.p90_us, 'p99_us': h.p99_us, 'max_us': h.max_us} for name, h in stats.latency.items()},
+            'counters': dict(stats.counters),
+        }
+
+    def enable_cache(self, max_bytes: int, max_doc_bytes: int = 65536) -> None:
+        self.engine.enable_cache(max_bytes, max_doc_bytes)
+
+    def disable_cache(self) -> None:
+        self.engine.disable_cache()
+
+    def clear_cache(self) -> None:
+        self.engine.clear_cache()
+
+    def cache_stats(self) -> CacheStatsResponse:
+        s = self.engine.cache_stats()
+        return {'hits': s.hits, 'misses': s.misses, 'insertions': s.insertions, 'evictions': s.evictions, 'entries': s.entries, 'bytes': s.bytes, 'max_bytes': s.max_bytes}
+
+    def save_cache(self, path: str) -> int:
+        return self.engine.save_cache(path)
+
+    def load_cache(self, path: str) -> int:
+        return self.engine.load_cache(path)
+
+    def _with_profile(self, response, result):
+        if self.profiling:
+            p = result.profile
+            response['profile'] = {
+                'search_us_by_shard': p.search_us_by_shard,
+                'locate_us': p.locate_us,
+                'doc_search_us': p.doc_search_us,
+                'extract_us': p.extract_us,
+                'metadata_us': p.metadata_us,
+                'lf_steps': p.lf_steps,
+                'rank_calls': p.rank_calls,
+                'minor_faults': p.minor_faults,
+                'major_faults': p.major_faults,
+            }
+        return response
 
     def find(self, query: str) -> EngineResponse[FindResponse]:
         result = self.engine.find(query)
-        return {'cnt': result.cnt, 'segment_by_shard': result.segment_by_shard}
+        return self._with_profile({'cnt': result.cnt, 'segment_by_shard': result.segment_by_shard}, result)
 
     def count(self, query: str) -> EngineResponse[CountResponse]:
         result = self.engine.count(query)
+        return self._with_profile({'count': result.count}, result)
+
+    def find_tokens(self, token_ids: List[int]) -> EngineResponse[FindResponse]:
+        try:
+            result = self.engine.find_tokens(token_ids)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'segment_by_shard': result.segment_by_shard}
+
+    def count_tokens(self, token_ids: List[int]) -> EngineResponse[CountResponse]:
+        try:
+            result = self.engine.count_tokens(token_ids)
+        except ValueError as e:
+            return {'error': str(e)}
         return {'count': result.count}
 
+    def find_approx(self, query: str, max_edits: int = 1, max_work: int = 100000) -> EngineResponse[ApproxFindResponse]:
+        try:
+            result = self.engine.find_approx(query, max_edits, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'segments_by_shard': result.segments_by_shard, 'complete': result.complete}
+
+    def count_approx(self, query: str, max_edits: int = 1, max_work: int = 100000) -> EngineResponse[ApproxCountResponse]:
+        try:
+            result = self.engine.count_approx(query, max_edits, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'count': result.count, 'complete': result.complete}
+
+    def find_folded(self, query: str, fold_case: bool = True, whitespace: str = ' \t\r\n', max_work: int = 100000) -> EngineResponse[ApproxFindResponse]:
+        try:
+            result = self.engine.find_folded(query, fold_case, whitespace, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'segments_by_shard': result.segments_by_shard, 'complete': result.complete}
+
+    def count_folded(self, query: str, fold_case: bool = True, whitespace: str = ' \t\r\n', max_work: int = 100000) -> EngineResponse[ApproxCountResponse]:
+        try:
+            result = self.engine.count_folded(query, fold_case, whitespace, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'count': result.count, 'complete': result.complete}
+
+    def find_regex(self, pattern: str, max_work: int = 100000) -> EngineResponse[ApproxFindResponse]:
+        try:
+            result = self.engine.find_regex(pattern, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'segments_by_shard': result.segments_by_shard, 'complete': result.complete}
+
+    def count_docs(self, query: str, max_work: int = 10000, sample_size: int = 1000) -> EngineResponse[DocCountResponse]:
+        try:
+            result = self.engine.count_docs(query, max_work, sample_size)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'count': result.count, 'exact': result.exact, 'ci_low': result.ci_low, 'ci_high': result.ci_high}
+
+    def count_with_dups(self, query: str, max_work: int = 10000, sample_size: int = 1000) -> EngineResponse[DupCountResponse]:
+        try:
+            result = self.engine.count_with_dups(query, max_work, sample_size)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'count': result.count, 'exact': result.exact, 'ci_low': result.ci_low, 'ci_high': result.ci_high}
+
+    def list_docs(self, query: str, max_docs: int = 10, max_work: int = 10000) -> EngineResponse[DocListResponse]:
+        result = self.engine.list_docs(query, max_docs, max_work)
+        return {'cnt': result.cnt, 'doc_ixs': result.doc_ixs, 'complete': result.complete}
+
+    def topk_docs(self, query: str, k: int = 10, max_work: int = 10000, sample_size: int = 1000) -> EngineResponse[TopKDocsResponse]:
+        try:
+            result = self.engine.topk_docs(query, k, max_work, sample_size)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'doc_ixs': result.doc_ixs, 'counts': result.counts, 'exact': result.exact}
+
+    def find_cnf(self, cnf: List[List[str]], max_docs: int = 10, max_work: int = 10000) -> EngineResponse[CNFResponse]:
+        try:
+            result = self.engine.find_cnf(cnf, max_docs, max_work)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'approx': result.approx, 'doc_ixs': result.doc_ixs}
+
+    def count_by_attribute(self, query: str, attr: str, max_work: int = 10000, sample_size: int = 1000) -> EngineResponse[AttributeCountResponse]:
+        try:
+            result = self.engine.count_by_attribute(query, attr, max_work, sample_size)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'cnt': result.cnt, 'values': result.values, 'counts': result.counts, 'ci_low': result.ci_low, 'ci_high': result.ci_high, 'exact': result.exact}
+
+    def matching_statistics(self, text: str) -> EngineResponse[MatchingStatisticsResponse]:
+        result = self.engine.matching_statistics(text)
+        return {'len': result.len, 'len_by_shard': result.len_by_shard, 'segment_by_shard': result.segment_by_shard}
+
+    def _contamination_response(self, result) -> ContaminationResponse:
+        return {'num_windows': result.num_windows, 'num_contaminated': result.num_contaminated, 'ratio': result.ratio, 'spans': result.spans}
+
+    def contamination(self, text: str, window: int, unit: str = 'bytes') -> EngineResponse[ContaminationResponse]:
+        assert unit in ['bytes', 'words']
+        return self._contamination_response(self.engine.contamination(text, window, unit == 'words'))
+
+    def contamination_batch(self, texts: List[str], window: int, unit: str = 'bytes', num_threads: Optional[int] = None) -> List[ContaminationResponse]:
+        assert unit in ['bytes', 'words']
+        results = self.engine.contamination_batch(texts, window, unit == 'words', num_threads or os.cpu_count())
+        return [self._contamination_response(result) for result in results]
+
     def get_doc_by_rank(self, s: int, rank: int, needle_len: int, max_ctx_len: int) -> EngineResponse[DocResponse]:
-        result = self.engine.get_doc_by_rank(s, rank, needle_len, max_ctx_len)
+        return self._doc_response(self.engine.get_doc_by_rank(s, rank, needle_len, max_ctx_len))
+
+    def get_doc_by_token_rank(self, s: int, rank: int, needle_len: int, max_ctx_len: int) -> EngineResponse[TokenDocResponse]:
+        try:
+            result = self.engine.get_doc_by_token_rank(s, rank, needle_len, max_ctx_len)
+        except ValueError as e:
+            return {'error': str(e)}
+        return {'doc_ix': result.doc_ix, 'doc_len': result.doc_len, 'disp_len': result.disp_len, 'needle_offset': result.needle_offset, 'metadata': result.metadata, 'token_ids': result.token_ids}
+
+    def get_doc_field(self, doc_ix: int, field: str) -> str:
+        return self.engine.get_doc_field(doc_ix, field)
+
+    def get_doc_dups(self, doc_ix: int, max_cnt: int = 100) -> EngineResponse[List[str]]:
+        try:
+            return self.engine.get_doc_dups(doc_ix, max_cnt)
+        except IndexError as e:
+            return {'error': str(e)}
+
+    def sample_occurrences(self, query: str, n: int, seed: int = 0, max_ctx_len: int = 100) -> List[EngineResponse[DocResponse]]:
+        return [self._doc_response(result) for result in self.engine.sample_occurrences(query, n, seed, max_ctx_len)]
+
+    def _doc_response(self, result) -> EngineResponse[DocResponse]:
         try:
             text = result.text
         except:
             return {'error': 'Failed to decode document text with UTF-8. This is likely because the context was cut off in the middle of a multi-byte char. Please try with a different max context length.'}
-        return {
+        return self._with_profile({
             'doc_ix': result.doc_ix,
             'doc_len': result.doc_len,
             'disp_len': result.disp_len,
             'needle_offset': result.needle_offset,
             'metadata': result.metadata,
             'text': result.text,
-        }
+            'dup_cnt': result.dup_cnt,
+        }, result)
@@ -1,4 +1,4 @@
-from typing import List, Tuple, TypeAlias, TypeVar, TypedDict
+from typing import Dict, List, NotRequired, Tuple, TypeAlias, TypeVar, TypedDict
 
 class ErrorResponse(TypedDict):
     error: str
@@ -6,12 +6,25 @@ class ErrorResponse(TypedDict):
 T = TypeVar("T")
 EngineResponse: TypeAlias = ErrorResponse | T
 
+class ProfileResponse(TypedDict):
+    search_us_by_shard: List[float]
+    locate_us: float
+    doc_search_us: float
+    extract_us: float
+    metadata_us: float
+    lf_steps: int
+    rank_calls: int
+    minor_faults: int
+    major_faults: int
+
 class FindResponse(TypedDict):
     cnt: int
     segment_by_shard: List[Tuple[int, int]]
+    profile: NotRequired[ProfileResponse]
 
 class CountResponse(TypedDict):
     count: int
+    profile: NotRequired[ProfileResponse]
 
 class DocResponse(TypedDict):
     doc_ix: int
@@ -20,4 +33,93 @@ class DocResponse(TypedDict):
     needle_offset: int
     metadata: str
     text: str
+    dup_cnt: int
+    profile: NotRequired[ProfileResponse]
+
+class TokenDocResponse(TypedDict):
+    doc_ix: int
+    doc_len: int
+    disp_len: int
+    needle_offset: int
+    metadata: str
+    token_ids: List[int]
+
+class MatchingStatisticsResponse(TypedDict):
+    len: List[int]
+    len_by_shard: List[List[int]]
+    segment_by_shard: List[List[Tuple[int, int]]]
+
+class ContaminationResponse(TypedDict):
+    num_windows: int
+    num_contaminated: int
+    ratio: float
+    spans: List[Tuple[int, int]]
+
+class ApproxFindResponse(TypedDict):
+    cnt: int
+    segments_by_shard: List[List[Tuple[int, int]]]
+    complete: bool
+
+class ApproxCountResponse(TypedDict):
+    count: int
+    complete: bool
+
+class DocCountResponse(TypedDict):
+    cnt: int
+    count: float
+    exact: bool
+    ci_low: float
+    ci_high: float
+
+class DupCountResponse(TypedDict):
+    cnt: int
+    count: float
+    exact: bool
+    ci_low: float
+    ci_high: float
+
+class DocListResponse(TypedDict):
+    cnt: int
+    doc_ixs: List[int]
+    complete: bool
+
+class TopKDocsResponse(TypedDict):
+    cnt: int
+    doc_ixs: List[int]
+    counts: List[int]
+    exact: bool
+
+class CNFResponse(TypedDict):
+    cnt: float
+    approx: bool
+    doc_ixs: List[int]
+
+class AttributeCountResponse(TypedDict):
+    cnt: int
+    values: List[str]
+    counts: List[float]
+    ci_low: List[float]
+    ci_high: List[float]
+    exact: bool
+
+class HistogramResponse(TypedDict):
+    count: int
+    mean_us: float
+    p50_us: float
+    p90_us: float
+    p99_us: float
+    max_us: float
+
+class StatsResponse(TypedDict):
+    latency: Dict[str, HistogramResponse]
+    counters: Dict[str, int]
+
 
+class CacheStatsResponse(TypedDict):
+    hits: int
+    misses: int
+    insertions: int
+    evictions: int
+    entries: int
+    bytes: int
+    max_bytes: int
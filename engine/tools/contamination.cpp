@@ -0,0 +1,113 @@
+// g++ -std=c++17 -O3 contamination.cpp -o contamination -I../../sdsl/include -L../../sdsl/lib -lsdsl -ldivsufsort -ldivsufsort64 -lzstd -pthread
+
+// Scores a benchmark dataset for contamination against an index.
+// Every sliding window of every entry is looked up in all shards; an entry's ratio is the fraction of its windows
+// that occur verbatim. Writes one JSON line per entry, with the offending spans, and prints a summary to stderr.
+//
+// ./contamination --index_dir DIR [--index_dir DIR ...] --input mmlu.jsonl --field question --window 50 --output scores.jsonl
+
+#include "../src/cpp_engine.h"
+#include "../../nlohmann/json.hpp"
+#include <iomanip>
+
+using json = nlohmann::json;
+
+// Entries may hold the text as a string or as a list of strings (e.g. multiple-choice options), which are joined by newlines
+string get_text(const json& entry, const vector<string>& fields) {
+    string text = "";
+    for (const auto& field : fields) {
+        if (!entry.contains(field)) continue;
+        const auto& value = entry[field];
+        if (value.is_string()) {
+            text += (text.empty() ? "" : "\n") + value.get<string>();
+        } else if (value.is_array()) {
+            for (const auto& item : value) {
+                if (item.is_string()) text += (text.empty() ? "" : "\n") + item.get<string>();
+            }
+        }
+    }
+    return text;
+}
+
+int main(int argc, char** argv) {
+
+    vector<string> index_dirs;
+    string input_path = "";
+    string output_path = "";
+    vector<string> fields;
+    size_t window = 50;
+    string unit = "bytes";
+    string mode = "mmap";
+    size_t num_threads = thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "--index_dir") index_dirs.push_back(argv[i + 1]);
+        else if (flag == "--input") input_path = argv[i + 1];
+        else if (flag == "--output") output_path = argv[i + 1];
+        else if (flag == "--field") fields.push_back(argv[i + 1]);
+        else if (flag == "--window") window = stoull(argv[i + 1]);
+        else if (flag == "--unit") unit = argv[i + 1];
+        else if (flag == "--mode") mode = argv[i + 1];
+        else if (flag == "--threads") num_threads = stoull(argv[i + 1]);
+        else {
+            cerr << "Unknown flag: " << flag << endl;
+            return 1;
+        }
+    }
+    if (index_dirs.empty() || input_path.empty() || window == 0 || (unit != "bytes" && unit != "words") || (mode != "ram" && mode != "mmap")) {
+        cerr << "Usage: " << argv[0] << " --index_dir DIR [--index_dir DIR ...] --input FILE [--field text ...] [--window 50] [--unit bytes|words] [--mode ram|mmap] [--threads N] [--output FILE]" << endl;
+        return 1;
+    }
+    if (fields.empty()) fields.push_back("text");
+
+    vector<string> texts;
+    {
+        ifstream fin(input_path);
+        assert (fin.is_open());
+        string line;
+        while (getline(fin, line)) {
+            if (line.empty()) continue;
+            texts.push_back(get_text(json::parse(line), fields));
+        }
+    }
+
+    auto start_time = steady_clock::now();
+    Engine engine(index_dirs, mode == "ram", false);
+    auto load_time = steady_clock::now();
+    auto results = engine.contamination_batch(texts, window, unit == "words", num_threads);
+    auto end_time = steady_clock::now();
+
+    ofstream fout;
+    if (!output_path.empty()) fout.open(output_path);
+    ostream& out = output_path.empty() ? cout : fout;
+    double ratio_sum = 0.0;
+    size_t num_dirty = 0, num_scored = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        json spans = json::array();
+        for (auto [start, end] : result.spans) {
+            // spans are in bytes and may cut a multi-byte char; replace invalid UTF-8 rather than failing the dump
+            spans.push_back({{"start", start}, {"end", end}, {"text", texts[i].substr(start, end - start)}});
+        }
+        out << json{
+            {"entry", i},
+            {"num_windows", result.num_windows},
+            {"num_contaminated", result.num_contaminated},
+            {"ratio", result.ratio},
+            {"spans", spans},
+        }.dump(-1, ' ', false, json::error_handler_t::replace) << "\n";
+        if (result.num_windows > 0) {
+            ratio_sum += result.ratio;
+            num_dirty += result.num_contaminated == result.num_windows;
+            num_scored++;
+        }
+    }
+
+    cerr << "Scored " << num_scored << " / " << results.size() << " entries (the rest are shorter than one window)"
+         << " in " << fixed << setprecision(3) << duration<double>(end_time - load_time).count() << " seconds"
+         << " (index load " << duration<double>(load_time - start_time).count() << " seconds)" << endl;
+    cerr << "Mean contamination ratio: " << (num_scored ? ratio_sum / num_scored : 0.0) << endl;
+    cerr << "Fully contaminated entries: " << num_dirty << endl;
+
+    return 0;
+}
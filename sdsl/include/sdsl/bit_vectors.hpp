@@ -8,6 +8,7 @@
 #include "int_vector.hpp"
 #include "bit_vector_il.hpp"
 #include "rrr_vector.hpp"
+#include "rrr_vector_il.hpp"
 #include "sd_vector.hpp"
 #include "hyb_vector.hpp"
 
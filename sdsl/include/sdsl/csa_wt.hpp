@@ -356,7 +356,6 @@ template<class t_wt, uint32_t t_dens, uint32_t t_inv_dens, class t_sa_sample_str
 inline auto csa_wt<t_wt, t_dens, t_inv_dens, t_sa_sample_strat, t_isa, t_alphabet_strat>::operator[](size_type i)const -> value_type
 {
     size_type off = 0;
-    auto start_time = std::chrono::high_resolution_clock::now();
     while (!m_sa_sample.is_sampled(i)) {
         i = lf[i];
         ++off;
@@ -31,6 +31,7 @@
 #include "memory_management.hpp"
 #include "ram_fs.hpp"
 #include "sfstream.hpp"
+#include "paged_file.hpp"
 
 #include <iosfwd>    // forward declaration of ostream
 #include <stdexcept> // for exceptions
@@ -1575,7 +1576,12 @@ typename int_vector<t_width>::size_type int_vector<t_width>::serialize(std::ostr
     } else {
         written_bytes += int_vector<t_width>::write_header(m_size, m_width, out);
     }
-    written_bytes += write_data(out);
+    auto paged = dynamic_cast<paged_ostream*>(&out);
+    if (paged and paged->add_array(m_data, (capacity()>>6)*sizeof(uint64_t))) {
+        written_bytes += (capacity()>>6)*sizeof(uint64_t);
+    } else {
+        written_bytes += write_data(out);
+    }
     structure_tree::add_size(child, written_bytes);
     return written_bytes;
 }
@@ -1587,6 +1593,10 @@ void int_vector<t_width>::load(std::istream& in)
     int_vector<t_width>::read_header(size, m_width, in);
 
     bit_resize(size);
+    if (auto paged = dynamic_cast<paged_istream*>(&in)) {
+        std::memcpy(m_data, paged->map_array((capacity()>>6)*sizeof(uint64_t)), (capacity()>>6)*sizeof(uint64_t));
+        return;
+    }
     uint64_t* p = m_data;
     size_type idx = 0;
     while (idx+conf::SDSL_BLOCK_SIZE < (capacity()>>6)) {
@@ -1604,6 +1614,12 @@ void int_vector<t_width>::load_(std::istream& in, const std::string& path)
     int_vector<t_width>::read_header(size, m_width, in);
     m_size = size;
 
+    // in a paged file, which is already mapped, the payload is used in place
+    if (auto paged = dynamic_cast<paged_istream*>(&in)) {
+        m_data = (uint64_t*)paged->map_array(((size + 63) / 64) * sizeof(uint64_t));
+        return;
+    }
+
     auto pos = in.tellg();
     int fd = open(path.c_str(), O_RDONLY);
     assert (fd != -1);
@@ -0,0 +1,289 @@
+/* sdsl - succinct data structures library
+    Copyright (C) 2011-2013 Simon Gog
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!\file paged_file.hpp
+   \brief paged_file.hpp contains a single-file container in which every
+          large array of an sdsl object starts at a page boundary, and the
+          functions to store and load objects in it.
+*/
+#ifndef INCLUDED_SDSL_PAGED_FILE
+#define INCLUDED_SDSL_PAGED_FILE
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//! Namespace for the succinct data structure library
+namespace sdsl
+{
+
+//! Layout of a paged file:
+/*!
+ *   header:         magic, version, alignment, header block offset and size, number of arrays,
+ *                   followed by the offset and size of each array (all uint64_t),
+ *   header block:   the object serialized as usual, except for the payloads of the arrays,
+ *   arrays:         each at a multiple of the alignment, in serialization order.
+ * An int_vector payload of at least `alignment` bytes is an array; smaller ones stay in the
+ * header block. Loading with load_from_paged_file_() is one mmap of the whole file: the arrays
+ * and the small members are used in place, and only the fields of the objects are parsed.
+ */
+const uint64_t paged_file_magic = 0x4547415053445321ULL; // "!SDSPAGE"
+const uint64_t paged_file_version = 1;
+
+//! Output stream that serializes an object into the header block of a paged file.
+/*!
+ * The int_vector payloads offered with add_array() are only recorded, and written page aligned
+ * after the header block by write_to().
+ */
+class paged_ostream : public std::ostream
+{
+    private:
+        struct array {
+            const char* data;
+            uint64_t    bytes;
+            uint64_t    zero_bytes; // written after data, as part of the array
+        };
+
+        std::stringbuf     m_header_block;
+        std::vector<array> m_arrays;
+        uint64_t           m_alignment;
+
+    public:
+        explicit paged_ostream(uint64_t alignment) : std::ostream(nullptr), m_alignment(alignment)
+        {
+            assert(alignment > 0 and alignment % 4096 == 0);
+            rdbuf(&m_header_block);
+        }
+
+        //! Records that data[0..bytes) followed by zero_bytes zeros is an array, if it is large enough.
+        /*! Returns false if it is not, in which case the caller writes it into the stream as usual.
+         *  data has to stay valid until write_to().
+         */
+        bool add_array(const void* data, uint64_t bytes, uint64_t zero_bytes=0)
+        {
+            if (bytes + zero_bytes < m_alignment) {
+                return false;
+            }
+            m_arrays.push_back({(const char*)data, bytes, zero_bytes});
+            return true;
+        }
+
+        //! Writes the header, the header block and the arrays; returns the number of bytes written.
+        uint64_t write_to(std::ostream& out) const
+        {
+            const std::string header_block = m_header_block.str();
+            std::vector<uint64_t> header = {paged_file_magic, paged_file_version, m_alignment, 0,
+                                            header_block.size(), m_arrays.size()
+                                           };
+            uint64_t offset = header.size() * sizeof(uint64_t) + 2 * m_arrays.size() * sizeof(uint64_t);
+            header[3] = offset;
+            offset += header_block.size();
+            for (const auto& a : m_arrays) {
+                offset = (offset + m_alignment - 1) / m_alignment * m_alignment;
+                header.push_back(offset);
+                header.push_back(a.bytes + a.zero_bytes);
+                offset += a.bytes + a.zero_bytes;
+            }
+            out.write((const char*)header.data(), header.size() * sizeof(uint64_t));
+            out.write(header_block.data(), header_block.size());
+            uint64_t written = header.size() * sizeof(uint64_t) + header_block.size();
+            const std::vector<char> zeros(m_alignment, 0);
+            for (size_t i = 0; i < m_arrays.size(); i++) {
+                const uint64_t start = header[6 + 2 * i];
+                out.write(zeros.data(), start - written);
+                out.write(m_arrays[i].data, m_arrays[i].bytes);
+                for (uint64_t z = m_arrays[i].zero_bytes; z > 0; z -= std::min(z, m_alignment)) {
+                    out.write(zeros.data(), std::min(z, m_alignment));
+                }
+                written = start + m_arrays[i].bytes + m_arrays[i].zero_bytes;
+            }
+            return written;
+        }
+};
+
+//! Input stream over the mapped header block of a paged file.
+/*!
+ * map_array() hands out the arrays in the order in which they were added, as pointers into the
+ * mapping.
+ */
+class paged_istream : public std::istream
+{
+    private:
+        class header_block_buf : public std::streambuf
+        {
+            public:
+                header_block_buf(const char* begin, const char* end)
+                {
+                    setg((char*)begin, (char*)begin, (char*)end);
+                }
+
+                const char* position() const
+                {
+                    return gptr();
+                }
+
+            protected:
+                pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                                 std::ios_base::openmode which=std::ios_base::in) override
+                {
+                    char* base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+                    if (!(which & std::ios_base::in) or base + off < eback() or base + off > egptr()) {
+                        return pos_type(off_type(-1));
+                    }
+                    setg(eback(), base + off, egptr());
+                    return pos_type(gptr() - eback());
+                }
+
+                pos_type seekpos(pos_type pos, std::ios_base::openmode which=std::ios_base::in) override
+                {
+                    return seekoff(off_type(pos), std::ios_base::beg, which);
+                }
+        };
+
+        const char*                                m_base;
+        uint64_t                                   m_alignment;
+        std::vector<std::pair<uint64_t, uint64_t>> m_arrays; // offset and size
+        size_t                                     m_next_array = 0;
+        header_block_buf                           m_header_block;
+
+    public:
+        //! base points to the mapped file of file_bytes bytes, which has been checked with is_paged_file()
+        paged_istream(const char* base, uint64_t file_bytes) : std::istream(nullptr),
+            m_base(base),
+            m_alignment(((const uint64_t*)base)[2]),
+            m_header_block(base + ((const uint64_t*)base)[3], base + ((const uint64_t*)base)[3] + ((const uint64_t*)base)[4])
+        {
+            const uint64_t* header = (const uint64_t*)base;
+            for (uint64_t i = 0; i < header[5]; i++) {
+                m_arrays.emplace_back(header[6 + 2 * i], header[7 + 2 * i]);
+                assert(m_arrays.back().first + m_arrays.back().second <= file_bytes);
+            }
+            rdbuf(&m_header_block);
+        }
+
+        //! Whether the file_bytes bytes at base are a paged file
+        static bool is_paged_file(const char* base, uint64_t file_bytes)
+        {
+            const uint64_t* header = (const uint64_t*)base;
+            return file_bytes >= 6 * sizeof(uint64_t) and header[0] == paged_file_magic and header[1] == paged_file_version
+                   and header[3] + header[4] <= file_bytes;
+        }
+
+        //! The next array of the given size: the next page-aligned array if it is that large, or else the
+        //! payload at the current position of the header block, which is skipped.
+        const char* map_array(uint64_t bytes)
+        {
+            if (bytes >= m_alignment) {
+                assert(m_next_array < m_arrays.size() and m_arrays[m_next_array].second == bytes);
+                return m_base + m_arrays[m_next_array++].first;
+            }
+            const char* data = m_header_block.position();
+            seekg(bytes, std::ios_base::cur);
+            return data;
+        }
+
+        //! The current position in the header block, for payloads that are used in place
+        const char* position() const
+        {
+            return m_header_block.position();
+        }
+};
+
+//! Stores v in a paged file whose arrays start at multiples of alignment (the page size, or e.g. 2 MiB for huge pages).
+template<class T>
+bool store_to_paged_file(const T& v, const std::string& file, uint64_t alignment=4096)
+{
+    paged_ostream paged(alignment);
+    v.serialize(paged);
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    paged.write_to(out);
+    out.close();
+    return (bool)out;
+}
+
+namespace paged_file_detail
+{
+//! Maps the whole file, or returns nullptr if it is not a paged file
+inline const char* map(const std::string& file, uint64_t& file_bytes)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file_bytes = st.st_size;
+    void* base = file_bytes > 0 ? mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    if (!paged_istream::is_paged_file((const char*)base, file_bytes)) {
+        munmap(base, file_bytes);
+        return nullptr;
+    }
+    return (const char*)base;
+}
+}
+
+//! Loads v from a paged file into memory.
+template<class T>
+bool load_from_paged_file(T& v, const std::string& file)
+{
+    uint64_t file_bytes = 0;
+    const char* base = paged_file_detail::map(file, file_bytes);
+    if (!base) {
+        return false;
+    }
+    {
+        paged_istream in(base, file_bytes);
+        v.load(in);
+    }
+    munmap((void*)base, file_bytes);
+    return true;
+}
+
+//! Loads v from a paged file with one mmap; the arrays and small members of v point into the mapping.
+/*! As with load_from_file_(), the mapping lives as long as the process.
+ */
+template<class T>
+bool load_from_paged_file_(T& v, const std::string& file)
+{
+    uint64_t file_bytes = 0;
+    const char* base = paged_file_detail::map(file, file_bytes);
+    if (!base) {
+        return false;
+    }
+    paged_istream in(base, file_bytes);
+    v.load_(in, file);
+    return true;
+}
+
+} // end namespace sdsl
+
+#endif
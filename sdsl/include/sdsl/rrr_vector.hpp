@@ -42,6 +42,9 @@ class rank_support_rrr;                // in rrr_vector
 template<uint8_t t_b=1, uint16_t t_bs=15, class t_rac=int_vector<>, uint16_t t_k=32>
 class select_support_rrr;                // in rrr_vector
 
+template<uint16_t t_bs, uint16_t t_k>
+class rrr_vector_il;                     // in rrr_vector_il
+
 //! A \f$H_0f$-compressed bitvector representation.
 /*!
  *   \tparam t_bs   Size of a basic block.
@@ -92,6 +95,7 @@ class rrr_vector
         friend class rank_support_rrr<1, t_bs, t_rac, t_k>;
         friend class select_support_rrr<0, t_bs, t_rac, t_k>;
         friend class select_support_rrr<1, t_bs, t_rac, t_k>;
+        template<uint16_t, uint16_t> friend class rrr_vector_il;
 
         typedef rrr_helper<t_bs> rrr_helper_type;
         typedef typename rrr_helper_type::number_type number_type;
@@ -491,6 +495,19 @@ class rank_support_rrr
             return rank_support_rrr_trait<t_b>::adjust_rank(rank + popcnt, i);
         }
 
+        //! Prefetches the rank samples and block types that rank(i) reads
+        void prefetch(size_type i)const
+        {
+            size_type bt_idx = i/t_bs;
+            size_type sample_pos = bt_idx/t_k;
+            __builtin_prefetch(m_v->m_rank.data() + ((sample_pos * m_v->m_rank.width()) >> 6));
+            __builtin_prefetch(m_v->m_rank.data() + (((sample_pos+1) * m_v->m_rank.width()) >> 6));
+            __builtin_prefetch(m_v->m_btnrp.data() + ((sample_pos * m_v->m_btnrp.width()) >> 6));
+            __builtin_prefetch(m_v->m_invert.data() + (sample_pos >> 6));
+            __builtin_prefetch(m_v->m_bt.data() + ((sample_pos * t_k * m_v->m_bt.width()) >> 6));
+            __builtin_prefetch(m_v->m_bt.data() + ((bt_idx * m_v->m_bt.width()) >> 6));
+        }
+
         //! Short hand for rank(i)
         const size_type operator()(size_type i)const
         {
@@ -0,0 +1,628 @@
+/* sdsl - succinct data structures library
+    Copyright (C) 2011-2013 Simon Gog
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!\file rrr_vector_il.hpp
+   \brief rrr_vector_il.hpp contains the sdsl::rrr_vector_il class, and
+          classes which support rank and select for rrr_vector_il.
+*/
+#ifndef SDSL_RRR_VECTOR_IL
+#define SDSL_RRR_VECTOR_IL
+
+#include "int_vector.hpp"
+#include "util.hpp"
+#include "iterators.hpp"
+#include "rrr_vector.hpp"
+#include <cstring> // for memmove
+
+//! Namespace for the succinct data structure library
+namespace sdsl
+{
+
+template<uint16_t t_bs=63, uint16_t t_k=32>
+class rrr_vector_il;
+
+template<uint8_t t_b=1, uint16_t t_bs=63, uint16_t t_k=32>// forward declaration needed for friend declaration
+class rank_support_rrr_il;  // in rrr_vector_il
+
+template<uint8_t t_b=1, uint16_t t_bs=63, uint16_t t_k=32>// forward declaration needed for friend declaration
+class select_support_rrr_il;  // in rrr_vector_il
+
+//! An rrr_vector whose superblock samples are interleaved into cache-line records.
+/*!
+ * Holds the same \f$H_0\f$-compressed block type numbers (btnr) as
+ * rrr_vector<t_bs, int_vector<>, t_k>, but instead of the four separate
+ * vectors bt, btnrp, rank_samples and invert, each superblock of t_k blocks
+ * has one 64-byte record:
+ *   word 0:    number of set bits before the superblock,
+ *   word 1:    bits [0..49]  pointer into btnr,
+ *              bit  50       invert bit of the superblock,
+ *              bits [51..63] number of set bits in the superblock,
+ *   words 2-7: the t_k block types, hi(t_bs)+1 bits each.
+ * A rank therefore touches one record and the btnr bits of one block, i.e.
+ * two cache lines instead of four to six. The records are 64-byte aligned in
+ * memory, and in the serialized file, so that they are aligned when mmapped by load_().
+ *
+ * \tparam t_bs Size of a basic block.
+ * \tparam t_k  Number of blocks per superblock.
+ */
+template<uint16_t t_bs, uint16_t t_k>
+class rrr_vector_il
+{
+    public:
+        typedef bit_vector::size_type                          size_type;
+        typedef bit_vector::value_type                         value_type;
+        typedef bit_vector::difference_type                    difference_type;
+        typedef random_access_const_iterator<rrr_vector_il>    iterator;
+        typedef iterator                                       const_iterator;
+        typedef bv_tag                                         index_category;
+
+        typedef rank_support_rrr_il<1, t_bs, t_k>   rank_1_type;
+        typedef rank_support_rrr_il<0, t_bs, t_k>   rank_0_type;
+        typedef select_support_rrr_il<1, t_bs, t_k> select_1_type;
+        typedef select_support_rrr_il<0, t_bs, t_k> select_0_type;
+
+        friend class rank_support_rrr_il<0, t_bs, t_k>;
+        friend class rank_support_rrr_il<1, t_bs, t_k>;
+        friend class select_support_rrr_il<0, t_bs, t_k>;
+        friend class select_support_rrr_il<1, t_bs, t_k>;
+
+        typedef rrr_helper<t_bs> rrr_helper_type;
+        typedef typename rrr_helper_type::number_type number_type;
+
+        enum { block_size = t_bs };
+
+    private:
+        static constexpr uint8_t bt_width()
+        {
+            uint8_t w = 0;
+            for (uint16_t x = t_bs; x; x >>= 1) ++w;
+            return w;
+        }
+        enum { record_words = 8,       // one cache line
+               btnrp_bits = 50,
+               popcount_shift = 51
+             };
+        static_assert(t_k > 1, "rrr_vector_il: t_k must be > 1.");
+        static_assert(t_k * bt_width() <= 6 * 64, "rrr_vector_il: the t_k block types have to fit into 6 words.");
+        static_assert(t_bs * t_k < (1 << (64 - popcount_shift)), "rrr_vector_il: t_bs * t_k has to fit into 13 bits.");
+
+        size_type      m_size = 0;  // Size of the original bit_vector.
+        bit_vector     m_btnr;      // Compressed block type numbers.
+        size_type      m_records_cnt = 0;// Superblocks, plus one record with the total rank.
+        size_type      m_first = 0; // Index of the first word of the records in m_records.
+        int_vector<64> m_records;   // The records, with up to 7 words of slack for alignment.
+
+        const uint64_t* record(size_type sb)const
+        {
+            return m_records.data() + m_first + sb * record_words;
+        }
+
+        static uint16_t record_bt(const uint64_t* rec, size_type j)
+        {
+            size_type pos = j * bt_width();
+            return bits::read_int(rec + 2 + (pos >> 6), pos & 63, bt_width());
+        }
+
+        static size_type record_btnrp(const uint64_t* rec)
+        {
+            return rec[1] & bits::lo_set[btnrp_bits];
+        }
+
+        static bool record_invert(const uint64_t* rec)
+        {
+            return (rec[1] >> btnrp_bits) & 1ULL;
+        }
+
+        static size_type record_popcount(const uint64_t* rec)
+        {
+            return rec[1] >> popcount_shift;
+        }
+
+        // Moves the records so that they start at a 64-byte boundary of the memory they are in
+        void align_records()
+        {
+            size_type first = ((64 - ((uintptr_t)m_records.data() & 63)) & 63) / 8;
+            if (first != m_first) {
+                std::memmove(m_records.data() + first, m_records.data() + m_first,
+                             m_records_cnt * record_words * sizeof(uint64_t));
+                m_first = first;
+            }
+        }
+
+        void copy(const rrr_vector_il& rrr)
+        {
+            m_size = rrr.m_size;
+            m_btnr = rrr.m_btnr;
+            m_records_cnt = rrr.m_records_cnt;
+            m_first = rrr.m_first;
+            m_records = rrr.m_records;
+            align_records();
+        }
+
+        // pointer into btnr of block bt_idx
+        size_type btnr_pos(const uint64_t* rec, size_type bt_idx)const
+        {
+            size_type btnrp = record_btnrp(rec);
+            for (size_type j = 0; j < bt_idx % t_k; ++j) {
+                btnrp += rrr_helper_type::space_for_bt(record_bt(rec, j));
+            }
+            return btnrp;
+        }
+
+    public:
+        //! Default constructor
+        rrr_vector_il() {}
+
+        //! Copy constructor
+        rrr_vector_il(const rrr_vector_il& rrr)
+        {
+            copy(rrr);
+        }
+
+        //! Move constructor
+        rrr_vector_il(rrr_vector_il&& rrr)
+        {
+            *this = std::move(rrr);
+        }
+
+        //! Constructor
+        /*!
+        *  \param bv  Uncompressed bitvector.
+        */
+        rrr_vector_il(const bit_vector& bv) : rrr_vector_il(rrr_vector<t_bs, int_vector<>, t_k>(bv)) {}
+
+        //! Converts an rrr_vector, reusing its block type numbers.
+        explicit rrr_vector_il(const rrr_vector<t_bs, int_vector<>, t_k>& rrr)
+        {
+            m_size = rrr.m_size;
+            m_btnr = rrr.m_btnr;
+            size_type superblocks = (rrr.m_bt.size() + t_k - 1) / t_k;
+            size_type total = rrr.m_rank[rrr.m_rank.size() - 1];
+            m_records_cnt = superblocks + 1;
+            m_first = 0;
+            m_records = int_vector<64>(m_records_cnt * record_words + record_words - 1, 0);
+            for (size_type sb = 0; sb < superblocks; ++sb) {
+                uint64_t* rec = m_records.data() + sb * record_words;
+                size_type rank = rrr.m_rank[sb];
+                size_type next = sb + 1 < rrr.m_rank.size() ? rrr.m_rank[sb + 1] : total;
+                rec[0] = rank;
+                rec[1] = rrr.m_btnrp[sb] | ((uint64_t)rrr.m_invert[sb] << btnrp_bits)
+                         | ((uint64_t)(next - rank) << popcount_shift);
+                for (size_type j = 0; j < t_k and sb * t_k + j < rrr.m_bt.size(); ++j) {
+                    size_type pos = j * bt_width();
+                    bits::write_int(rec + 2 + (pos >> 6), rrr.m_bt[sb * t_k + j], pos & 63, bt_width());
+                }
+            }
+            // the last record only holds the total rank, for select
+            m_records[superblocks * record_words] = total;
+            align_records();
+        }
+
+        //! Swap method
+        void swap(rrr_vector_il& rrr)
+        {
+            if (this != &rrr) {
+                std::swap(m_size, rrr.m_size);
+                m_btnr.swap(rrr.m_btnr);
+                std::swap(m_records_cnt, rrr.m_records_cnt);
+                std::swap(m_first, rrr.m_first);
+                m_records.swap(rrr.m_records);
+            }
+        }
+
+        //! Accessing the i-th element of the original bit_vector
+        /*! \param i An index i with \f$ 0 \leq i < size()  \f$.
+           \return The i-th bit of the original bit_vector
+        */
+        value_type operator[](size_type i)const
+        {
+            size_type bt_idx = i/t_bs;
+            const uint64_t* rec = record(bt_idx / t_k);
+            uint16_t bt = record_bt(rec, bt_idx % t_k);
+            if (record_invert(rec))
+                bt = t_bs - bt;
+#ifndef RRR_NO_OPT
+            if (bt == 0 or bt == t_bs) { // very effective optimization
+                return bt>0;
+            }
+#endif
+            uint16_t off = i % t_bs;
+            uint16_t btnrlen = rrr_helper_type::space_for_bt(bt);
+            number_type btnr = rrr_helper_type::decode_btnr(m_btnr, btnr_pos(rec, bt_idx), btnrlen);
+            return rrr_helper_type::decode_bit(bt, btnr, off);
+        }
+
+        //! Get the integer value of the binary string of length len starting at position idx.
+        /*! \param idx Starting index of the binary representation of the integer.
+         *  \param len Length of the binary representation of the integer. Default value is 64.
+         *   \returns The integer value of the binary string of length len starting at position idx.
+         *
+         *  \pre idx+len-1 in [0..size()-1]
+         *  \pre len in [1..64]
+         */
+        uint64_t get_int(size_type idx, uint8_t len=64)const
+        {
+            uint64_t res = 0;
+            size_type bb_idx = idx/t_bs; // begin block index
+            size_type bb_off = idx%t_bs; // begin block offset
+            size_type eb_idx = (idx+len-1)/t_bs; // end block index
+            if (bb_idx == eb_idx) {  // extract only in one block
+                const uint64_t* rec = record(bb_idx / t_k);
+                uint16_t bt = record_bt(rec, bb_idx % t_k);
+                if (record_invert(rec))
+                    bt = t_bs - bt;
+                if (bt == 0) {   // all bits are zero
+                    res = 0;
+                } else if (bt == t_bs and t_bs <= 64) { // all bits are one
+                    res = bits::lo_set[len];
+                } else {
+                    uint16_t btnrlen = rrr_helper_type::space_for_bt(bt);
+                    number_type btnr = rrr_helper_type::decode_btnr(m_btnr, btnr_pos(rec, bb_idx), btnrlen);
+                    res =  rrr_helper_type::decode_int(bt, btnr, bb_off, len);
+                }
+            } else { // solve multiple block case by recursion
+                uint16_t b_len = t_bs-bb_off; // remaining bits in first block
+                uint16_t b_len_sum = 0;
+                do {
+                    res |= get_int(idx, b_len) << b_len_sum;
+                    idx += b_len;
+                    b_len_sum += b_len;
+                    len -= b_len;
+                    b_len = t_bs;
+                    b_len = std::min((uint16_t)len, b_len);
+                } while (len > 0);
+            }
+            return res;
+        }
+
+        //! Assignment operator
+        rrr_vector_il& operator=(const rrr_vector_il& rrr)
+        {
+            if (this != &rrr) {
+                copy(rrr);
+            }
+            return *this;
+        }
+
+        //! Move assignment operator
+        rrr_vector_il& operator=(rrr_vector_il&& rrr)
+        {
+            swap(rrr);
+            return *this;
+        }
+
+        //! Returns the size of the original bit vector.
+        size_type size()const
+        {
+            return m_size;
+        }
+
+        //! Serializes the data structure into the given ostream
+        size_type serialize(std::ostream& out, structure_tree_node* v=nullptr, std::string name="")const
+        {
+            structure_tree_node* child = structure_tree::add_child(v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += write_member(m_size, out, child, "size");
+            written_bytes += m_btnr.serialize(out, child, "btnr");
+            written_bytes += write_member(m_records_cnt, out, child, "records_cnt");
+            // place the records at a 64-byte boundary of the file, after m_first and the header of m_records; in a
+            // paged file, they start an array of their own, which is page aligned
+            auto paged = dynamic_cast<paged_ostream*>(&out);
+            auto pos = out.tellp();
+            size_type first = 0;
+            if (!paged and pos >= 0 and pos % 8 == 0) {
+                first = ((64 - ((size_type)pos + 2 * sizeof(uint64_t)) % 64) % 64) / 8;
+            }
+            written_bytes += write_member(first, out, child, "first");
+            structure_tree_node* records_child = structure_tree::add_child(child, "records", util::class_name(m_records));
+            size_type records_bytes = int_vector<64>::write_header(m_records.bit_size(), 64, out);
+            const size_type bytes = m_records_cnt * record_words * sizeof(uint64_t);
+            if (!paged or !paged->add_array(record(0), bytes, (record_words - 1) * sizeof(uint64_t))) {
+                const uint64_t zeros[record_words] = {};
+                out.write((const char*)zeros, first * sizeof(uint64_t));
+                out.write((const char*)record(0), bytes);
+                out.write((const char*)zeros, (record_words - 1 - first) * sizeof(uint64_t));
+            }
+            records_bytes += m_records.size() * sizeof(uint64_t);
+            structure_tree::add_size(records_child, records_bytes);
+            written_bytes += records_bytes;
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        //! Loads the data structure from the given istream.
+        void load(std::istream& in)
+        {
+            read_member(m_size, in);
+            m_btnr.load(in);
+            read_member(m_records_cnt, in);
+            read_member(m_first, in);
+            m_records.load(in);
+            align_records();
+        }
+
+        //! Loads the data structure from the given istream and mmaps the btnr and the records from path.
+        void load_(std::istream& in, const std::string& path)
+        {
+            read_member(m_size, in);
+            m_btnr.load_(in, path);
+            read_member(m_records_cnt, in);
+            read_member(m_first, in);
+            m_records.load_(in, path);
+        }
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, size());
+        }
+};
+
+//! rank_support for the rrr_vector_il class
+/*!
+* \tparam t_b   The bit pattern of size one. (so `0` or `1`)
+* \tparam t_bs  The block size of the corresponding rrr_vector_il.
+* \tparam t_k   The superblock size of the corresponding rrr_vector_il.
+*/
+template<uint8_t t_b, uint16_t t_bs, uint16_t t_k>
+class rank_support_rrr_il
+{
+        static_assert(t_b == 1u or t_b == 0u , "rank_support_rrr_il: bit pattern must be `0` or `1`");
+    public:
+        typedef rrr_vector_il<t_bs, t_k> bit_vector_type;
+        typedef typename bit_vector_type::size_type size_type;
+        typedef typename bit_vector_type::rrr_helper_type rrr_helper_type;
+        typedef typename rrr_helper_type::number_type number_type;
+        enum { bit_pat = t_b };
+        enum { bit_pat_len = (uint8_t)1 };
+
+    private:
+        const bit_vector_type* m_v; //!< Pointer to the rank supported rrr_vector_il
+
+    public:
+        //! Standard constructor
+        /*! \param v Pointer to the rrr_vector_il, which should be supported
+         */
+        explicit rank_support_rrr_il(const bit_vector_type* v=nullptr)
+        {
+            set_vector(v);
+        }
+
+        //! Answers rank queries
+        /*! \param i Argument for the length of the prefix v[0..i-1], with \f$0\leq i \leq size()\f$.
+           \returns Number of 1-bits in the prefix [0..i-1] of the original bit_vector.
+           \par Time complexity
+                \f$ \Order{ t\_k } \f$, within one cache line
+        */
+        const size_type rank(size_type i)const
+        {
+            assert(m_v != nullptr);
+            assert(i <= m_v->size());
+            size_type bt_idx = i/t_bs;
+            size_type sample_pos = bt_idx/t_k;
+            const uint64_t* rec = m_v->record(sample_pos);
+            size_type rank = rec[0];
+#ifndef RRR_NO_OPT
+            size_type popcount = bit_vector_type::record_popcount(rec);
+            if (popcount == (size_type)0) {
+                return rank_support_rrr_trait<t_b>::adjust_rank(rank, i);
+            } else if (popcount == (size_type)t_bs*t_k) {
+                return rank_support_rrr_trait<t_b>::adjust_rank(
+                           rank + i - sample_pos*t_k*t_bs, i);
+            }
+#endif
+            const bool inv = bit_vector_type::record_invert(rec);
+            size_type btnrp = bit_vector_type::record_btnrp(rec);
+            for (size_type j = 0; j < bt_idx % t_k; ++j) {
+                uint16_t r = bit_vector_type::record_bt(rec, j);
+                rank  += (inv ? t_bs - r: r);
+                btnrp += rrr_helper_type::space_for_bt(r);
+            }
+            uint16_t off = i % t_bs;
+            if (!off) {   // needed for special case: if i=size() is a multiple of t_bs
+                return rank_support_rrr_trait<t_b>::adjust_rank(rank, i);
+            }
+            uint16_t bt = bit_vector_type::record_bt(rec, bt_idx % t_k);
+            bt = inv ? t_bs - bt : bt;
+
+            uint16_t btnrlen = rrr_helper_type::space_for_bt(bt);
+            number_type btnr = rrr_helper_type::decode_btnr(m_v->m_btnr, btnrp, btnrlen);
+            uint16_t popcnt  = rrr_helper_type::decode_popcount(bt, btnr, off);
+            return rank_support_rrr_trait<t_b>::adjust_rank(rank + popcnt, i);
+        }
+
+        //! Prefetches the record that rank(i) reads
+        void prefetch(size_type i)const
+        {
+            __builtin_prefetch(m_v->record(i/t_bs/t_k));
+        }
+
+        //! Short hand for rank(i)
+        const size_type operator()(size_type i)const
+        {
+            return rank(i);
+        }
+
+        //! Returns the size of the original vector
+        const size_type size()const
+        {
+            return m_v->size();
+        }
+
+        //! Set the supported vector.
+        void set_vector(const bit_vector_type* v=nullptr)
+        {
+            m_v = v;
+        }
+
+        rank_support_rrr_il& operator=(const rank_support_rrr_il& rs)
+        {
+            if (this != &rs) {
+                set_vector(rs.m_v);
+            }
+            return *this;
+        }
+
+        void swap(rank_support_rrr_il&) { }
+
+        //! Load the data structure from a stream and set the supported vector.
+        void load(std::istream&, const bit_vector_type* v=nullptr)
+        {
+            set_vector(v);
+        }
+
+        //! Serializes the data structure into a stream.
+        size_type serialize(std::ostream&, structure_tree_node* v=nullptr, std::string name="")const
+        {
+            structure_tree_node* child = structure_tree::add_child(v, name, util::class_name(*this));
+            structure_tree::add_size(child, 0);
+            return 0;
+        }
+};
+
+
+//! Select support for the rrr_vector_il class.
+/*
+* \tparam t_b   The bit pattern of size one. (so `0` or `1`)
+* \tparam t_bs  The block size of the corresponding rrr_vector_il.
+* \tparam t_k   The superblock size of the corresponding rrr_vector_il.
+*/
+template<uint8_t t_b, uint16_t t_bs, uint16_t t_k>
+class select_support_rrr_il
+{
+        static_assert(t_b == 1u or t_b == 0u , "select_support_rrr_il: bit pattern must be `0` or `1`");
+    public:
+        typedef rrr_vector_il<t_bs, t_k> bit_vector_type;
+        typedef typename bit_vector_type::size_type size_type;
+        typedef typename bit_vector_type::rrr_helper_type rrr_helper_type;
+        typedef typename rrr_helper_type::number_type number_type;
+        enum { bit_pat = t_b };
+        enum { bit_pat_len = (uint8_t)1 };
+    private:
+        const bit_vector_type* m_v; //!< Pointer to the rank supported rrr_vector_il
+
+        // number of t_b bits before superblock sb
+        size_type sample_rank(size_type sb)const
+        {
+            size_type rank = m_v->record(sb)[0];
+            return t_b ? rank : sb*t_bs*t_k - rank;
+        }
+
+        size_type select_b(size_type i)const
+        {
+            size_type last = m_v->m_records_cnt - 1;
+            size_type ones = m_v->record(last)[0];
+            if ((t_b ? ones : size() - ones) < i)
+                return size();
+            //  (1) binary search for the answer in the records
+            size_type begin=0, end=last; // min included, max excluded
+            size_type idx, rank;
+            // invariant:  rank of end   >= i
+            //             rank of begin  < i
+            while (end-begin > 1) {
+                idx  = (begin+end) >> 1;
+                rank = sample_rank(idx);
+                if (rank >= i)
+                    end = idx;
+                else { // rank < i
+                    begin = idx;
+                }
+            }
+            //   (2) linear search in the record
+            const uint64_t* rec = m_v->record(begin);
+            rank = sample_rank(begin); // now i>rank
+            idx = begin * t_k; // initialize idx for select result
+#ifndef RRR_NO_OPT
+            size_type popcount = bit_vector_type::record_popcount(rec);
+            if (popcount == (t_b ? (size_type)t_bs*t_k : 0)) { // a superblock of t_b bits only
+                return idx*t_bs + i-rank -1;
+            }
+#endif
+            const bool inv = bit_vector_type::record_invert(rec);
+            size_type btnrp = bit_vector_type::record_btnrp(rec);
+            uint16_t bt = 0, btnrlen = 0; // temp variables for block_type and space for block type
+            size_type j = 0;
+            while (i > rank) {
+                bt = bit_vector_type::record_bt(rec, j++); bt = inv ? t_bs-bt : bt;
+                rank += t_b ? bt : t_bs-bt;
+                btnrp += (btnrlen=rrr_helper_type::space_for_bt(bt));
+            }
+            rank -= t_b ? bt : t_bs-bt;
+            idx += j;
+            number_type btnr = rrr_helper_type::decode_btnr(m_v->m_btnr, btnrp-btnrlen, btnrlen);
+            if (t_b) {
+                return (idx-1) * t_bs + rrr_helper_type::decode_select(bt, btnr, i-rank);
+            }
+            return (idx-1) * t_bs + rrr_helper_type::template decode_select_bitpattern<0, 1>(bt, btnr, i-rank);
+        }
+
+    public:
+        explicit select_support_rrr_il(const bit_vector_type* v=nullptr)
+        {
+            set_vector(v);
+        }
+
+        //! Answers select queries
+        size_type select(size_type i)const
+        {
+            return select_b(i);
+        }
+
+        const size_type operator()(size_type i)const
+        {
+            return select(i);
+        }
+
+        const size_type size()const
+        {
+            return m_v->size();
+        }
+
+        void set_vector(const bit_vector_type* v=nullptr)
+        {
+            m_v = v;
+        }
+
+        select_support_rrr_il& operator=(const select_support_rrr_il& rs)
+        {
+            if (this != &rs) {
+                set_vector(rs.m_v);
+            }
+            return *this;
+        }
+
+        void swap(select_support_rrr_il&) { }
+
+        void load(std::istream&, const bit_vector_type* v=nullptr)
+        {
+            set_vector(v);
+        }
+
+        size_type serialize(std::ostream&, structure_tree_node* v=nullptr, std::string name="")const
+        {
+            structure_tree_node* child = structure_tree::add_child(v, name, util::class_name(*this));
+            structure_tree::add_size(child, 0);
+            return 0;
+        }
+};
+
+}// end namespace sdsl
+
+#endif
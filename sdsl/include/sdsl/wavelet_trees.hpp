@@ -37,6 +37,7 @@
 #include "wt_int.hpp"
 #include "wm_int.hpp"
 #include "wt_rlmn.hpp"
+#include "wt_kary.hpp"
 #include "wt_ap.hpp"
 #include "construct.hpp"
 #include "wt_algorithm.hpp"
@@ -245,6 +245,23 @@ struct has_interval_symbols {
     static constexpr bool value = type::value;
 };
 
+//! Whether t_wt computes ranks one level at a time (rank_begin, rank_prefetch, rank_step), as wt_pc does
+template<typename t_wt>
+struct has_rank_cursor {
+    template<typename T>
+    static constexpr auto check(T*)
+    -> typename
+    std::is_same<
+    decltype(std::declval<T>().rank_step(
+                 std::declval<typename T::rank_cursor&>()
+             )),
+             void>::type {return std::true_type();}
+             template<typename>
+    static constexpr std::false_type check(...) {return std::false_type();}
+    typedef decltype(check<t_wt>(nullptr)) type;
+    static constexpr bool value = type::value;
+};
+
 template<typename t_wt, bool t_has_interval_symbols>
 struct _interval_symbols_wt {
     typedef typename t_wt::size_type  size_type;
@@ -363,6 +363,15 @@ struct _byte_tree {
         uint64_t m_nodes_size = 0;
         read_member(m_nodes_size, in);
 
+        // in a paged file, which is already mapped, the nodes are used in place
+        if (auto paged = dynamic_cast<paged_istream*>(&in)) {
+            m_nodes = NodeVector<data_node>((data_node*)paged->position(), fixed_sigma);
+            in.seekg(m_nodes_size * sizeof(data_node), std::ios_base::cur);
+            in.read((char*) m_c_to_leaf, fixed_sigma*sizeof(m_c_to_leaf[0]));
+            in.read((char*) m_path, fixed_sigma*sizeof(m_path[0]));
+            return;
+        }
+
         auto pos = in.tellg();
         int fd = open(path.c_str(), O_RDONLY);
         assert (fd != -1);
@@ -715,6 +715,17 @@ class wt_int
             read_member(m_max_level, in);
         }
 
+        //! Loads the data structure from the given istream and file path.
+        void load_(std::istream& in, const std::string& path) {
+            read_member(m_size, in);
+            read_member(m_sigma, in);
+            m_tree.load_(in, path);
+            m_tree_rank.load(in, &m_tree);
+            m_tree_select1.load(in, &m_tree);
+            m_tree_select0.load(in, &m_tree);
+            read_member(m_max_level, in);
+        }
+
         //! Represents a node in the wavelet tree
         struct node_type {
             size_type  offset   = 0;
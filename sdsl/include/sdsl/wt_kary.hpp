@@ -0,0 +1,517 @@
+/* sdsl - succinct data structures library
+    Copyright (C) 2011-2013 Simon Gog
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*! \file wt_kary.hpp
+    \brief wt_kary.hpp contains a multi-ary wavelet tree over bytes, with
+           2^t_bits children per node.
+*/
+#ifndef INCLUDED_SDSL_WT_KARY
+#define INCLUDED_SDSL_WT_KARY
+
+#include "sdsl_concepts.hpp"
+#include "int_vector.hpp"
+#include "iterators.hpp"
+#include "util.hpp"
+#include <algorithm> // for std::swap
+#include <vector>
+#include <utility> // for pair
+#include <iostream>
+
+//! Namespace for the succinct data structure library.
+namespace sdsl
+{
+
+//! A balanced multi-ary wavelet tree over a byte alphabet.
+/*!
+ * \tparam t_bits  Bits of the symbol resolved per level: 2 (4-ary tree,
+ *                 4 levels) or 4 (16-ary tree, 2 levels).
+ *
+ *  Level l holds the l-th t_bits digit (most significant first) of each
+ *  symbol, grouped into nodes by the preceding digits, like the levels of
+ *  wt_int. A rank, access or inverse_select therefore takes 8 / t_bits
+ *  dependent steps instead of the ~H_0 binary levels of wt_huff.
+ *
+ *  Each level is stored as fixed-size records (64 bytes for t_bits = 2,
+ *  128 bytes for t_bits = 4) that hold, for each digit, its 16-bit count
+ *  since the start of the superblock, followed by the packed digits of
+ *  the block, so that a rank at a level reads one record and one entry of
+ *  the superblock counts. Digits within a record are counted with
+ *  broadword comparisons. Symbols are not compressed: the tree takes about
+ *  8 bits per symbol plus 14% (t_bits = 2) or 33% (t_bits = 4) for counts.
+ *
+ *  @ingroup wt
+ */
+template<uint8_t t_bits = 4>
+class wt_kary
+{
+        static_assert(t_bits == 2 or t_bits == 4, "wt_kary: t_bits has to be 2 or 4.");
+
+    public:
+
+        typedef int_vector<>::size_type               size_type;
+        typedef uint8_t                               value_type;
+        typedef int_vector<>::difference_type         difference_type;
+        typedef random_access_const_iterator<wt_kary> const_iterator;
+        typedef const_iterator                        iterator;
+        typedef wt_tag                                index_category;
+        typedef byte_alphabet_tag                     alphabet_category;
+        enum { lex_ordered=false };
+        enum { width = 8 };
+
+        enum { fanout = 1 << t_bits,
+               levels = 8 / t_bits,
+               record_words = t_bits == 2 ? 8 : 16,              // 64 or 128 bytes
+               count_words = fanout * 16 / 64,                   // one 16-bit count per digit
+               data_words = record_words - count_words,
+               digits_per_word = 64 / t_bits,
+               block_size = data_words * digits_per_word,        // 224 or 192 symbols
+               blocks_per_superblock = 256                       // so that the counts fit in 16 bits
+             };
+
+    private:
+
+        size_type           m_size = 0;
+        size_type           m_sigma = 0;      // number of distinct symbols
+        size_type           m_blocks = 0;     // records per level
+        size_type           m_superblocks = 0;// superblocks per level
+        int_vector<64>      m_records;        // the records of all levels, level by level
+        int_vector<64>      m_super_counts;   // [level][superblock][digit]: digits before the superblock
+        int_vector<64>      m_node_start;     // [node]: start of the node in its level, nodes numbered level by level
+        int_vector<64>      m_node_rank;      // [node][digit]: digits in the level before the node
+
+        // Nodes at level l are numbered from (fanout^l - 1) / (fanout - 1), by the digits above them
+        static size_type node_id(size_type level, size_type prefix) {
+            return ((1ULL << (t_bits * level)) - 1) / (fanout - 1) + prefix;
+        }
+
+        static constexpr uint64_t digit_ones() {
+            return t_bits == 2 ? 0x5555555555555555ULL : 0x1111111111111111ULL;
+        }
+
+        // The lowest bit of each digit of x that is zero
+        static uint64_t zero_digits(uint64_t x) {
+            if (t_bits == 2) {
+                return ~(x | (x >> 1)) & digit_ones();
+            }
+            x |= x >> 1;
+            x |= x >> 2;
+            return ~x & digit_ones();
+        }
+
+        const uint64_t* record(size_type level, size_type block)const {
+            return m_records.data() + (level * m_blocks + block) * record_words;
+        }
+
+        // Number of occurrences of digit d in [0..i-1] of a level
+        size_type level_rank(size_type level, size_type i, uint64_t d)const {
+            size_type block = i / block_size, k = i % block_size;
+            const uint64_t* rec = record(level, block);
+            size_type res = m_super_counts[(level * m_superblocks + block / blocks_per_superblock) * fanout + d]
+                            + ((rec[d / 4] >> (16 * (d % 4))) & 0xFFFFULL);
+            const uint64_t* data = rec + count_words;
+            const uint64_t pattern = d * digit_ones();
+            size_type w = 0;
+            for (; w < k / digits_per_word; ++w) {
+                res += bits::cnt(zero_digits(data[w] ^ pattern));
+            }
+            if (k % digits_per_word) {
+                res += bits::cnt(zero_digits(data[w] ^ pattern) & bits::lo_set[(k % digits_per_word) * t_bits]);
+            }
+            return res;
+        }
+
+        // Number of occurrences of every digit in [0..i-1] of a level
+        void level_rank_all(size_type level, size_type i, size_type* res)const {
+            size_type block = i / block_size, k = i % block_size;
+            const uint64_t* rec = record(level, block);
+            const uint64_t* super = m_super_counts.data() + (level * m_superblocks + block / blocks_per_superblock) * fanout;
+            for (size_type d = 0; d < fanout; ++d) {
+                res[d] = super[d] + ((rec[d / 4] >> (16 * (d % 4))) & 0xFFFFULL);
+            }
+            const uint64_t* data = rec + count_words;
+            for (size_type w = 0; w * digits_per_word < k; ++w) {
+                uint64_t mask = (w + 1) * digits_per_word <= k ? ~0ULL : bits::lo_set[(k % digits_per_word) * t_bits];
+                for (size_type d = 0; d < fanout; ++d) {
+                    res[d] += bits::cnt(zero_digits(data[w] ^ (d * digit_ones())) & mask);
+                }
+            }
+        }
+
+        uint64_t level_digit(size_type level, size_type i)const {
+            const uint64_t* data = record(level, i / block_size) + count_words;
+            size_type k = i % block_size;
+            return (data[k / digits_per_word] >> ((k % digits_per_word) * t_bits)) & (fanout - 1);
+        }
+
+        // Position of the j-th (j >= 1) occurrence of digit d in a level
+        size_type level_select(size_type level, size_type j, uint64_t d)const {
+            const uint64_t* super = m_super_counts.data() + level * m_superblocks * fanout;
+            size_type lo = 0, hi = m_superblocks;
+            while (hi - lo > 1) { // last superblock with fewer than j occurrences before it
+                size_type mid = (lo + hi) / 2;
+                if (super[mid * fanout + d] < j) lo = mid; else hi = mid;
+            }
+            j -= super[lo * fanout + d];
+            size_type block = lo * blocks_per_superblock;
+            size_type block_end = std::min(m_blocks, block + blocks_per_superblock);
+            while (block + 1 < block_end and ((record(level, block + 1)[d / 4] >> (16 * (d % 4))) & 0xFFFFULL) < j) {
+                ++block;
+            }
+            const uint64_t* rec = record(level, block);
+            j -= (rec[d / 4] >> (16 * (d % 4))) & 0xFFFFULL;
+            const uint64_t* data = rec + count_words;
+            for (size_type w = 0; ; ++w) {
+                uint64_t matches = zero_digits(data[w] ^ (d * digit_ones()));
+                size_type cnt = bits::cnt(matches);
+                if (cnt >= j) {
+                    return block * block_size + w * digits_per_word + bits::sel(matches, j) / t_bits;
+                }
+                j -= cnt;
+            }
+        }
+
+        void copy(const wt_kary& wt) {
+            m_size         = wt.m_size;
+            m_sigma        = wt.m_sigma;
+            m_blocks       = wt.m_blocks;
+            m_superblocks  = wt.m_superblocks;
+            m_records      = wt.m_records;
+            m_super_counts = wt.m_super_counts;
+            m_node_start   = wt.m_node_start;
+            m_node_rank    = wt.m_node_rank;
+        }
+
+    public:
+
+        const size_type& sigma = m_sigma;
+
+        //! Default constructor
+        wt_kary() {};
+
+        //! Construct the wavelet tree from a file_buffer
+        /*! \param text_buf  A int_vector_buffer to the original text.
+         *  \param size      The length of the prefix of the text, for which
+         *                   the wavelet tree should be build.
+         */
+        wt_kary(int_vector_buffer<width>& text_buf, size_type size):m_size(size) {
+            m_blocks = size / block_size + 1; // + 1 so that rank(size, c) has a record
+            m_superblocks = (m_blocks + blocks_per_superblock - 1) / blocks_per_superblock;
+            size_type nodes = node_id(levels, 0);
+            m_node_start = int_vector<64>(nodes, 0);
+            m_node_rank = int_vector<64>(nodes * fanout, 0);
+            m_super_counts = int_vector<64>(levels * m_superblocks * fanout, 0);
+            m_records = int_vector<64>(levels * m_blocks * record_words, 0);
+            if (0 == size)
+                return;
+
+            std::vector<size_type> C(256, 0);
+            for (size_type i=0; i < size; ++i) {
+                ++C[text_buf[i]];
+            }
+            m_sigma = 0;
+            for (size_type c=0; c < 256; ++c) {
+                m_sigma += C[c] > 0;
+            }
+            // a node starts after all symbols of its level with smaller digits above it
+            for (size_type l=0; l < levels; ++l) {
+                size_type shift = 8 - t_bits * l, start = 0;
+                for (size_type prefix=0; prefix < (1ULL << (t_bits * l)); ++prefix) {
+                    m_node_start[node_id(l, prefix)] = start;
+                    for (size_type c = prefix << shift; c < (prefix + 1) << shift; ++c) {
+                        start += C[c];
+                    }
+                }
+            }
+
+            // place the digits; within a node, symbols keep their order in the text
+            std::vector<size_type> next(m_node_start.begin(), m_node_start.end());
+            for (size_type i=0; i < size; ++i) {
+                value_type c = text_buf[i];
+                for (size_type l=0; l < levels; ++l) {
+                    size_type pos = next[node_id(l, c >> (8 - t_bits * l))]++;
+                    uint64_t d = (c >> (8 - t_bits * (l + 1))) & (fanout - 1);
+                    m_records[(l * m_blocks + pos / block_size) * record_words + count_words + (pos % block_size) / digits_per_word]
+                    |= d << (((pos % block_size) % digits_per_word) * t_bits);
+                }
+            }
+
+            // block and superblock counts
+            for (size_type l=0; l < levels; ++l) {
+                std::vector<size_type> cnt(fanout, 0), super(fanout, 0);
+                for (size_type b=0; b < m_blocks; ++b) {
+                    if (b % blocks_per_superblock == 0) {
+                        for (size_type d=0; d < fanout; ++d) {
+                            super[d] = cnt[d];
+                            m_super_counts[(l * m_superblocks + b / blocks_per_superblock) * fanout + d] = cnt[d];
+                        }
+                    }
+                    uint64_t* rec = m_records.data() + (l * m_blocks + b) * record_words;
+                    for (size_type d=0; d < fanout; ++d) {
+                        rec[d / 4] |= (uint64_t)(cnt[d] - super[d]) << (16 * (d % 4));
+                    }
+                    for (size_type i = b * block_size; i < std::min(size, (b + 1) * block_size); ++i) {
+                        ++cnt[level_digit(l, i)];
+                    }
+                }
+            }
+            for (size_type l=0; l < levels; ++l) {
+                for (size_type prefix=0; prefix < (1ULL << (t_bits * l)); ++prefix) {
+                    size_type v = node_id(l, prefix);
+                    for (size_type d=0; d < fanout; ++d) {
+                        m_node_rank[v * fanout + d] = level_rank(l, m_node_start[v], d);
+                    }
+                }
+            }
+        }
+
+        //! Copy constructor
+        wt_kary(const wt_kary& wt) {
+            copy(wt);
+        }
+
+        //! Move constructor
+        wt_kary(wt_kary&& wt) {
+            *this = std::move(wt);
+        }
+
+        //! Assignment operator
+        wt_kary& operator=(const wt_kary& wt) {
+            if (this != &wt) {
+                copy(wt);
+            }
+            return *this;
+        }
+
+        //! Assignment move operator
+        wt_kary& operator=(wt_kary&& wt) {
+            if (this != &wt) {
+                m_size         = wt.m_size;
+                m_sigma        = wt.m_sigma;
+                m_blocks       = wt.m_blocks;
+                m_superblocks  = wt.m_superblocks;
+                m_records      = std::move(wt.m_records);
+                m_super_counts = std::move(wt.m_super_counts);
+                m_node_start   = std::move(wt.m_node_start);
+                m_node_rank    = std::move(wt.m_node_rank);
+            }
+            return *this;
+        }
+
+        //! Swap operator
+        void swap(wt_kary& wt) {
+            if (this != &wt) {
+                std::swap(m_size, wt.m_size);
+                std::swap(m_sigma, wt.m_sigma);
+                std::swap(m_blocks, wt.m_blocks);
+                std::swap(m_superblocks, wt.m_superblocks);
+                m_records.swap(wt.m_records);
+                m_super_counts.swap(wt.m_super_counts);
+                m_node_start.swap(wt.m_node_start);
+                m_node_rank.swap(wt.m_node_rank);
+            }
+        }
+
+        //! Returns the size of the original vector.
+        size_type size()const {
+            return m_size;
+        }
+
+        //! Returns whether the wavelet tree contains no data.
+        bool empty()const {
+            return 0 == m_size;
+        }
+
+        //! Recovers the i-th symbol of the original vector.
+        /*! \param i Index in the original vector. \f$i \in [0..size()-1]\f$.
+         *  \return The i-th symbol of the original vector.
+         *  \par Time complexity
+         *        \f$ \Order{8 / t\_bits} \f$
+         */
+        value_type operator[](size_type i)const {
+            assert(i < size());
+            return inverse_select(i).second;
+        };
+
+        //! Calculates how many symbols c are in the prefix [0..i-1].
+        /*!
+         *  \param i Exclusive right bound of the range (\f$i\in[0..size()]\f$).
+         *  \param c Symbol c.
+         *  \return Number of occurrences of symbol c in the prefix [0..i-1].
+         *  \par Time complexity
+         *        \f$ \Order{8 / t\_bits} \f$
+         */
+        size_type rank(size_type i, value_type c)const {
+            assert(i <= size());
+            size_type prefix = 0, v = 0;
+            for (size_type l=0; l < levels; ++l) {
+                uint64_t d = (c >> (8 - t_bits * (l + 1))) & (fanout - 1);
+                i = level_rank(l, m_node_start[v] + i, d) - m_node_rank[v * fanout + d];
+                if (i == 0)
+                    return 0;
+                prefix = (prefix << t_bits) | d;
+                v = node_id(l + 1, prefix);
+            }
+            return i;
+        };
+
+        //! Calculates how many times symbol wt[i] occurs in the prefix [0..i-1].
+        /*!
+         *  \param i The index of the symbol.
+         *  \return  Pair (rank(wt[i],i),wt[i])
+         *  \par Time complexity
+         *        \f$ \Order{8 / t\_bits} \f$
+         */
+        std::pair<size_type, value_type>
+        inverse_select(size_type i)const {
+            assert(i < size());
+            size_type prefix = 0, v = 0;
+            for (size_type l=0; l < levels; ++l) {
+                size_type pos = m_node_start[v] + i;
+                uint64_t d = level_digit(l, pos);
+                i = level_rank(l, pos, d) - m_node_rank[v * fanout + d];
+                prefix = (prefix << t_bits) | d;
+                v = node_id(l + 1, prefix);
+            }
+            return std::make_pair(i, (value_type)prefix);
+        }
+
+        //! Calculates the ith occurrence of the symbol c in the supported vector.
+        /*!
+         *  \param i The ith occurrence. \f$i\in [1..rank(size(),c)]\f$.
+         *  \param c The symbol c.
+         *  \par Time complexity
+         *       \f$ \Order{8 / t\_bits \cdot \log n} \f$
+         */
+        size_type select(size_type i, value_type c)const {
+            assert(i > 0);
+            assert(i <= rank(size(), c));
+            for (size_type l=levels; l-- > 0; ) {
+                size_type v = node_id(l, c >> (8 - t_bits * l));
+                uint64_t d = (c >> (8 - t_bits * (l + 1))) & (fanout - 1);
+                i = level_select(l, m_node_rank[v * fanout + d] + i, d) - m_node_start[v] + 1;
+            }
+            return i - 1;
+        };
+
+        //! For each symbol c in wt[i..j-1] get rank(i,c) and rank(j,c).
+        /*!
+         *  \param i        The start index (inclusive) of the interval.
+         *  \param j        The end index (exclusive) of the interval.
+         *  \param k        Reference for number of different symbols in [i..j-1].
+         *  \param cs       Reference to a vector that will contain in
+         *                  cs[0..k-1] all symbols that occur in [i..j-1] in
+         *                  ascending order.
+         *  \param rank_c_i Reference to a vector which equals
+         *                  rank_c_i[p] = rank(i,cs[p]), for \f$ 0 \leq p < k \f$.
+         *  \param rank_c_j Reference to a vector which equals
+         *                  rank_c_j[p] = rank(j,cs[p]), for \f$ 0 \leq p < k \f$.
+         *  \par Time complexity
+         *       \f$ \Order{\min{\sigma, k \cdot 8 / t\_bits}} \f$ record visits
+         */
+        void interval_symbols(size_type i, size_type j, size_type& k,
+                              std::vector<value_type>& cs,
+                              std::vector<size_type>& rank_c_i,
+                              std::vector<size_type>& rank_c_j)const {
+            assert(i <= j and j <= size());
+            k = 0;
+            if (i < j) {
+                interval_symbols_rec(0, 0, i, j, k, cs, rank_c_i, rank_c_j);
+            }
+        }
+
+    private:
+
+        void interval_symbols_rec(size_type l, size_type prefix, size_type i, size_type j, size_type& k,
+                                  std::vector<value_type>& cs,
+                                  std::vector<size_type>& rank_c_i,
+                                  std::vector<size_type>& rank_c_j)const {
+            size_type v = node_id(l, prefix);
+            size_type ri[fanout], rj[fanout];
+            level_rank_all(l, m_node_start[v] + i, ri);
+            level_rank_all(l, m_node_start[v] + j, rj);
+            for (size_type d=0; d < fanout; ++d) {
+                if (ri[d] == rj[d])
+                    continue;
+                size_type ci = ri[d] - m_node_rank[v * fanout + d], cj = rj[d] - m_node_rank[v * fanout + d];
+                if (l + 1 == levels) {
+                    cs[k] = (value_type)((prefix << t_bits) | d);
+                    rank_c_i[k] = ci;
+                    rank_c_j[k] = cj;
+                    ++k;
+                } else {
+                    interval_symbols_rec(l + 1, (prefix << t_bits) | d, ci, cj, k, cs, rank_c_i, rank_c_j);
+                }
+            }
+        }
+
+    public:
+
+        //! Returns a const_iterator to the first element.
+        const_iterator begin()const {
+            return const_iterator(this, 0);
+        }
+
+        //! Returns a const_iterator to the element after the last element.
+        const_iterator end()const {
+            return const_iterator(this, size());
+        }
+
+        //! Serializes the data structure into the given ostream
+        size_type serialize(std::ostream& out, structure_tree_node* v=nullptr,
+                            std::string name="")const {
+            structure_tree_node* child = structure_tree::add_child(
+                                             v, name, util::class_name(*this));
+            size_type written_bytes = 0;
+            written_bytes += write_member(m_size, out, child, "size");
+            written_bytes += write_member(m_sigma, out, child, "sigma");
+            written_bytes += write_member(m_blocks, out, child, "blocks");
+            written_bytes += write_member(m_superblocks, out, child, "superblocks");
+            written_bytes += m_records.serialize(out, child, "records");
+            written_bytes += m_super_counts.serialize(out, child, "super_counts");
+            written_bytes += m_node_start.serialize(out, child, "node_start");
+            written_bytes += m_node_rank.serialize(out, child, "node_rank");
+            structure_tree::add_size(child, written_bytes);
+            return written_bytes;
+        }
+
+        //! Loads the data structure from the given istream.
+        void load(std::istream& in) {
+            read_member(m_size, in);
+            read_member(m_sigma, in);
+            read_member(m_blocks, in);
+            read_member(m_superblocks, in);
+            m_records.load(in);
+            m_super_counts.load(in);
+            m_node_start.load(in);
+            m_node_rank.load(in);
+        }
+
+        //! Loads the data structure from the given istream and file path.
+        //! Only the records are mmapped; the counts per superblock and node are read into memory.
+        void load_(std::istream& in, const std::string& path) {
+            read_member(m_size, in);
+            read_member(m_sigma, in);
+            read_member(m_blocks, in);
+            read_member(m_superblocks, in);
+            m_records.load_(in, path);
+            m_super_counts.load(in);
+            m_node_start.load(in);
+            m_node_rank.load(in);
+        }
+};
+
+}// end namespace sdsl
+#endif
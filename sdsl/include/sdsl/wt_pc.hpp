@@ -403,6 +403,56 @@ class wt_pc
             return result;
         };
 
+        //! State of a rank(i, c) that is computed one level at a time, see rank_begin.
+        struct rank_cursor {
+            node_type v;      // current node
+            uint64_t  p;      // remaining bits of the path to the leaf of c
+            uint32_t  levels; // remaining levels
+            size_type result; // rank(i, c) once rank_done
+        };
+
+        //! Starts rank(i, c) for rank_step.
+        /*! Several ranks can be advanced in lockstep, calling rank_prefetch for each one
+         *  before the rank_step of any, so that their cache misses overlap.
+         */
+        rank_cursor rank_begin(size_type i, value_type c)const
+        {
+            assert(i <= size());
+            rank_cursor cur = {m_tree.root(), 0, 0, 0};
+            if (!m_tree.is_valid(m_tree.c_to_leaf(c))) {
+                return cur;  // if `c` was not in the text
+            }
+            cur.result = i;
+            if (m_sigma == 1) {
+                return cur;
+            }
+            cur.p = m_tree.bit_path(c);
+            cur.levels = cur.p >> 56;
+            return cur;
+        }
+
+        //! Whether cur.result is the rank.
+        bool rank_done(const rank_cursor& cur)const
+        {
+            return cur.levels == 0 or cur.result == 0;
+        }
+
+        //! Prefetches the rank samples that the next rank_step of cur reads.
+        void rank_prefetch(const rank_cursor& cur)const
+        {
+            m_bv_rank.prefetch(m_tree.bv_pos(cur.v) + cur.result);
+        }
+
+        //! Descends one level of the rank, as one iteration of the loop in rank.
+        void rank_step(rank_cursor& cur)const
+        {
+            size_type ones = m_bv_rank(m_tree.bv_pos(cur.v) + cur.result) - m_tree.bv_pos_rank(cur.v);
+            cur.result = (cur.p & 1) ? ones : cur.result - ones;
+            cur.v = m_tree.child(cur.v, cur.p & 1);
+            cur.p >>= 1;
+            --cur.levels;
+        }
+
         //! Calculates how many times symbol wt[i] occurs in the prefix [0..i-1].
         /*!
          * \param i The index of the symbol.
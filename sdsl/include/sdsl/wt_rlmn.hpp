@@ -432,6 +432,21 @@ class wt_rlmn
             m_C.load(in);
             m_C_bf_rank.load(in);
         }
+
+        //! Loads the data structure from the given istream and file path.
+        //! Only the wavelet tree of the run heads is mmapped; the run bitvectors are read into memory.
+        void load_(std::istream& in, const std::string& path) {
+            read_member(m_size, in);
+            m_bl.load(in);
+            m_bf.load(in);
+            m_wt.load_(in, path);
+            m_bl_rank.load(in, &m_bl);
+            m_bf_rank.load(in, &m_bf);
+            m_bl_select.load(in, &m_bl);
+            m_bf_select.load(in, &m_bf);
+            m_C.load(in);
+            m_C_bf_rank.load(in);
+        }
 };
 
 }// end namespace sdsl
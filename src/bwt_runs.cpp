@@ -0,0 +1,77 @@
+// g++ -std=c++17 -O3 -I../sdsl/include -L../sdsl/lib bwt_runs.cpp -o bwt_runs -lsdsl -ldivsufsort -ldivsufsort64 -pthread
+
+// Counts the runs of equal bytes in the BWT of each shard (data.fm9), to tell whether a corpus is repetitive enough
+// for a run-length encoded index (indexing.py --index_type rlmn): that index takes space proportional to the number
+// of runs r rather than to the text length n, so it pays off when the mean run length n / r is large.
+//
+// The BWT is split into one chunk per thread; a chunk's runs are counted by accessing every position in it.
+
+#include <sdsl/suffix_arrays.hpp>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+typedef csa_wt<wt_huff<rrr_vector<127> >, 32, 64> index_t;
+
+// number of positions i in [begin, end) with bwt[i] != bwt[i - 1] (position 0 always starts a run)
+void count_run_heads(const index_t* index, const uint64_t begin, const uint64_t end, uint64_t* heads) {
+    uint64_t cnt = 0;
+    uint8_t prev = begin > 0 ? index->wavelet_tree[begin - 1] : 0;
+    for (uint64_t i = begin; i < end; i++) {
+        uint8_t c = index->wavelet_tree[i];
+        if (i == 0 || c != prev) cnt++;
+        prev = c;
+    }
+    *heads = cnt;
+}
+
+int count(const string& index_dir, const size_t num_threads) {
+    index_t index;
+    if (!load_from_file(index, index_dir + "/data.fm9")) {
+        cerr << "Failed to load " << index_dir << "/data.fm9" << endl;
+        return 1;
+    }
+
+    auto start_time = steady_clock::now();
+    uint64_t n = index.size();
+    uint64_t chunk = (n + num_threads - 1) / num_threads;
+    vector<uint64_t> heads(num_threads, 0);
+    vector<thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        uint64_t begin = min(n, t * chunk), end = min(n, (t + 1) * chunk);
+        threads.emplace_back(count_run_heads, &index, begin, end, &heads[t]);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    uint64_t r = 0;
+    for (auto h : heads) r += h;
+
+    auto end_time = steady_clock::now();
+    cout << index_dir << ": n = " << n << ", r = " << r << ", r/n = " << fixed << setprecision(4) << (double)r / n
+         << ", mean run length = " << setprecision(2) << (double)n / r
+         << " (" << setprecision(3) << duration<double>(end_time - start_time).count() << " seconds)" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " [index directory]..." << endl;
+        return 1;
+    }
+
+    size_t num_threads = max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        if (count(argv[i], num_threads)) {
+            return 1;
+        }
+    }
+    return 0;
+}
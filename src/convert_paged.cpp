@@ -0,0 +1,97 @@
+// g++ -std=c++17 -O3 -I../sdsl/include -L../sdsl/lib convert_paged.cpp -o convert_paged -lsdsl -ldivsufsort -ldivsufsort64
+
+// Writes a page-aligned container (sdsl/paged_file.hpp) next to each FM-index file of the given index directories:
+// data.fm9p for data.fm9, and likewise for data.il.fm9, data.rl.fm9, meta.fm9 and data.tok.fm9. A container holds the
+// same index, but with every large array at a page (or --alignment) boundary and all small members in one header
+// block, so that the engine loads it with a single mmap and no reads. The engine uses the container of a file when it
+// exists; the .fm9 files are still needed by the tools that read them directly (kgram_table, doc_rmq, ...).
+
+#include <sdsl/suffix_arrays.hpp>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+typedef csa_wt<wt_huff<rrr_vector<127> >, 32, 64> index_t;
+typedef csa_wt<wt_huff<rrr_vector_il<127> >, 32, 64> il_index_t;
+typedef csa_wt<wt_rlmn<>, 32, 64> rl_index_t;
+typedef csa_wt<wt_int<>, 32, 64, sa_order_sa_sampling<>, isa_sampling<>, int_alphabet<> > tok_index_t;
+
+uint64_t fs_size(const string& file) {
+    ifstream in(file, ios::binary | ios::ate);
+    return in.tellg();
+}
+
+// the indexes are not freed: the vectors of an mmapped index cannot be
+template <class t_index>
+int convert(const string& index_file, const uint64_t alignment) {
+    const string paged_file = index_file + "p";
+    auto start_time = steady_clock::now();
+
+    auto index = new t_index();
+    if (!load_from_file_(*index, index_file)) {
+        cerr << "Failed to load " << index_file << endl;
+        return 1;
+    }
+    if (!store_to_paged_file(*index, paged_file, alignment)) {
+        cerr << "Failed to write " << paged_file << endl;
+        return 1;
+    }
+
+    // the container has to load and agree with the original on its size, the first BWT symbols and SA values
+    auto paged_index = new t_index();
+    if (!load_from_paged_file_(*paged_index, paged_file) || paged_index->size() != index->size()) {
+        cerr << "Failed to load " << paged_file << endl;
+        return 1;
+    }
+    for (uint64_t i = 0; i < min<uint64_t>(index->size(), 1 << 16); i++) {
+        if (paged_index->bwt[i] != index->bwt[i] || (i < (1 << 10) && (*paged_index)[i] != (*index)[i])) {
+            cerr << paged_file << " differs from " << index_file << " at position " << i << endl;
+            return 1;
+        }
+    }
+
+    auto end_time = steady_clock::now();
+    cout << index_file << " -> " << paged_file << ": " << fs_size(index_file) << " -> " << fs_size(paged_file) << " bytes ("
+         << fixed << setprecision(3) << duration<double>(end_time - start_time).count() << " seconds)" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    uint64_t alignment = 4096;
+    int first_dir = 1;
+    if (argc > 2 && string(argv[1]) == "--alignment") {
+        alignment = stoull(argv[2]);
+        first_dir = 3;
+    }
+    if (first_dir >= argc || alignment == 0 || alignment % 4096 != 0) {
+        cerr << "Usage: " << argv[0] << " [--alignment BYTES (multiple of 4096, default 4096)] [index directory]..." << endl;
+        return 1;
+    }
+
+    for (int i = first_dir; i < argc; i++) {
+        const string index_dir = argv[i];
+        int converted = 0;
+        for (const string name : {"data.fm9", "data.il.fm9", "data.rl.fm9", "meta.fm9", "data.tok.fm9"}) {
+            const string index_file = index_dir + "/" + name;
+            if (!ifstream(index_file).good()) continue;
+            int ret = name == "data.il.fm9" ? convert<il_index_t>(index_file, alignment)
+                    : name == "data.rl.fm9" ? convert<rl_index_t>(index_file, alignment)
+                    : name == "data.tok.fm9" ? convert<tok_index_t>(index_file, alignment)
+                    : convert<index_t>(index_file, alignment);
+            if (ret) {
+                return ret;
+            }
+            converted++;
+        }
+        if (converted == 0) {
+            cerr << "No FM-index files in " << index_dir << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// g++ -std=c++17 -O3 -I../sdsl/include -L../sdsl/lib doc_rmq.cpp -o doc_rmq -lsdsl -ldivsufsort -ldivsufsort64
+
+// Builds data.doc_rmq next to data.fm9, which lets the engine list the distinct documents of an SA range in time
+// proportional to their number (Muthukrishnan's document listing, in Sadakane's variant that stores only the RMQ).
+//
+// With D[r] the document containing suffix SA[r] and C[r] the largest r' < r with D[r'] = D[r] (or -1), the first
+// occurrence of each document within an SA range [l, r] is exactly a position with C < l. The file holds a succinct
+// range-minimum structure over C + 1 (2n + o(n) bits); C and D themselves are not stored.
+//
+// D is filled in by walking the text backwards with LF, so this takes O(n) rank operations and about 2n words of memory.
+
+#include <sdsl/suffix_arrays.hpp>
+#include <sdsl/rmq_support.hpp>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+typedef csa_wt<wt_huff<rrr_vector<127> >, 32, 64> index_t;
+
+int build(const string& index_dir) {
+    index_t index;
+    if (!load_from_file(index, index_dir + "/data.fm9")) {
+        cerr << "Failed to load " << index_dir << "/data.fm9" << endl;
+        return 1;
+    }
+    vector<uint64_t> data_offset;
+    {
+        ifstream fin(index_dir + "/data_offset", ios::binary);
+        assert (fin.is_open());
+        fin.seekg(0, ios::end);
+        data_offset.resize(fin.tellg() / sizeof(uint64_t));
+        fin.seekg(0, ios::beg);
+        fin.read((char*)data_offset.data(), data_offset.size() * sizeof(uint64_t));
+    }
+    assert (!data_offset.empty());
+
+    auto start_time = steady_clock::now();
+    const uint64_t n = index.size();
+
+    // each LF step moves one text position to the left, wrapping around from 0 to n - 1
+    auto doc_of = [&](const uint64_t pos) {
+        return (uint64_t)(upper_bound(data_offset.begin() + 1, data_offset.end(), pos) - data_offset.begin() - 1);
+    };
+    int_vector<> doc_by_rank(n, 0, bits::hi(max<uint64_t>(data_offset.size() - 1, 1)) + 1);
+    uint64_t rank = 0;
+    uint64_t pos = index[rank];
+    uint64_t doc = doc_of(pos);
+    for (uint64_t i = 0; i < n; i++) {
+        doc_by_rank[rank] = doc;
+        rank = index.lf[rank];
+        if (pos == 0) {
+            pos = n - 1;
+            doc = data_offset.size() - 1;
+        } else {
+            pos--;
+            while (doc > 0 && data_offset[doc] > pos) doc--;
+        }
+    }
+    cout << "Computed document array in " << fixed << setprecision(3) << duration<double>(steady_clock::now() - start_time).count() << " seconds" << endl;
+
+    int_vector<> prev_plus_one(n, 0, bits::hi(n) + 1);
+    {
+        vector<uint64_t> last_plus_one(data_offset.size(), 0);
+        for (uint64_t r = 0; r < n; r++) {
+            prev_plus_one[r] = last_plus_one[doc_by_rank[r]];
+            last_plus_one[doc_by_rank[r]] = r + 1;
+        }
+    }
+    util::clear(doc_by_rank);
+
+    rmq_succinct_sct<true> rmq(&prev_plus_one);
+    util::clear(prev_plus_one);
+
+    string path = index_dir + "/data.doc_rmq";
+    store_to_file(rmq, path);
+    cout << "Wrote " << path << " (" << setprecision(1) << size_in_mega_bytes(rmq) << " MiB) in "
+         << setprecision(3) << duration<double>(steady_clock::now() - start_time).count() << " seconds" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " [index directory]" << endl;
+        return 1;
+    }
+
+    return build(argv[1]);
+}
@@ -13,12 +13,8 @@ using namespace std;
 using namespace std::chrono;
 
 
-int construct(string index_dir) {
-    string index_file = index_dir + "/data.fm9";
-    string meta_index_file = index_dir + "/meta.fm9";
-    csa_wt<wt_huff<rrr_vector<127> >, 32, 64> fm_index;
-    csa_wt<wt_huff<rrr_vector<127> >, 32, 64> metadata_index;
-
+template <class t_index>
+void construct_data(t_index& fm_index, string index_dir, string index_file) {
     if (!load_from_file(fm_index, index_file)) {
         memory_monitor::start();
         sdsl::cache_config config(true, index_dir, "data");
@@ -30,8 +26,34 @@ int construct(string index_dir) {
         memory_monitor::write_memory_log<HTML_FORMAT>(fout);
         fout.close();
     }
+}
 
-    if (!load_from_file(metadata_index, meta_index_file)) {
+int construct(string index_dir, string index_type) {
+    string meta_index_file = index_dir + "/meta.fm9";
+    csa_wt<wt_huff<rrr_vector<127> >, 32, 64> metadata_index;
+
+    if (index_type == "rlmn") {
+        // Run-length encoded BWT, much smaller on repetitive corpora
+        csa_wt<wt_rlmn<>, 32, 64> fm_index;
+        construct_data(fm_index, index_dir, index_dir + "/data.rl.fm9");
+    } else {
+        csa_wt<wt_huff<rrr_vector<127> >, 32, 64> fm_index;
+        construct_data(fm_index, index_dir, index_dir + "/data.fm9");
+    }
+
+    // indexing.py --tokenizer writes text_int_tok.sdsl; its SA is built here, by sdsl, rather than by rust_indexing
+    string tok_index_file = index_dir + "/data.tok.fm9";
+    csa_wt<wt_int<>, 32, 64, sa_order_sa_sampling<>, isa_sampling<>, int_alphabet<> > tok_index;
+    if (!load_from_file(tok_index, tok_index_file) && ifstream(index_dir + "/text_int_tok.sdsl").good()) {
+        memory_monitor::start();
+        sdsl::cache_config config(true, index_dir, "tok");
+        construct(tok_index, index_dir + "/tok", config, 0);
+        store_to_file(tok_index, tok_index_file);
+        memory_monitor::stop();
+    }
+
+    // indexing.py --meta_store leaves no text_meta.sdsl, as the metadata goes to meta.store instead
+    if (!load_from_file(metadata_index, meta_index_file) && ifstream(index_dir + "/text_meta.sdsl").good()) {
         memory_monitor::start();
         sdsl::cache_config config(true, index_dir, "meta");
         construct(metadata_index, index_dir + "/meta", config, 1);
@@ -43,14 +65,19 @@ int construct(string index_dir) {
 }
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " [directory to write index]" << endl;
+    if (argc != 2 && argc != 3) {
+        cerr << "Usage: " << argv[0] << " [directory to write index] [huff|rlmn]" << endl;
         return 1;
     }
 
     string index_directory = argv[1];
+    string index_type = argc == 3 ? argv[2] : "huff";
+    if (index_type != "huff" && index_type != "rlmn") {
+        cerr << "Unknown index type: " << index_type << endl;
+        return 1;
+    }
 
-    construct(index_directory);
+    construct(index_directory, index_type);
 
     return 0;
 }
@@ -2,6 +2,7 @@ import argparse
 import gc
 import glob
 import gzip
+import hashlib
 import json
 import multiprocessing as mp
 import numpy as np
@@ -219,6 +220,314 @@ def prepare(args):
     else:
         prepare_manyfiles(args)
 
+DOC_DUPS_MAGIC = b'IGMDUPS1'
+
+def hash_docs(ds_path, start, end, offsets, doc_sep_len, whitespace):
+    # a 16-byte digest of the text of each doc in [start, end) of text_data.sdsl, each starting at its offset with the doc
+    # separator; with whitespace, runs of ASCII whitespace count as one space and leading and trailing ones are ignored
+    with open(ds_path, 'rb') as f:
+        f.seek(8 + start)
+        block = f.read(end - start)
+    digests = []
+    for i in range(len(offsets)):
+        text = block[offsets[i]+doc_sep_len:(offsets[i+1] if i+1 < len(offsets) else len(block))]
+        if whitespace:
+            text = b' '.join(text.split())
+        digests.append(hashlib.blake2b(text, digest_size=16).digest())
+    return b''.join(digests)
+
+def hash_docs_star(task):
+    return hash_docs(*task)
+
+def dedup(args):
+    # Keeps the first of the docs with the same text (the same up to whitespace with --dedup whitespace) in text_data.sdsl
+    # and text_meta.sdsl, so that everything built from them has one doc per distinct text. The metadata of the others
+    # goes to doc_dups. All integers are little-endian uint64:
+    #   magic (IGMDUPS1), doc_cnt, dup_cnt
+    #   dup_starts[doc_cnt + 1]: the dups of doc d are [dup_starts[d], dup_starts[d + 1]), in corpus order
+    #   meta_offsets[dup_cnt + 1]: offset of each dup's metadata line within the lines below, plus their end
+    #   the metadata lines, each ending with \n
+
+    ds_path = os.path.join(args.save_dir, f'text_data.sdsl')
+    od_path = os.path.join(args.save_dir, f'data_offset')
+    mt_path = os.path.join(args.save_dir, f'text_meta.sdsl')
+    om_path = os.path.join(args.save_dir, f'meta_offset')
+    dd_path = os.path.join(args.save_dir, f'doc_dups')
+    if os.path.exists(dd_path):
+        print('Step 1.1 (dedup): Skipped. doc_dups already exists.', flush=True)
+        return
+
+    print('Step 1.1 (dedup): Starting ...', flush=True)
+    start_time = time.time()
+
+    sizes = {}
+    for path in [ds_path, mt_path]:
+        with open(path, 'rb') as f:
+            sizes[path] = int.from_bytes(f.read(8), 'little') // 8 - 1 # exclude the trailing \xfa
+    od = np.fromfile(od_path, dtype=np.uint64).astype(np.int64)
+    om = np.fromfile(om_path, dtype=np.uint64).astype(np.int64)
+    doc_cnt = len(od)
+    assert len(om) == doc_cnt
+    starts = {ds_path: np.append(od, sizes[ds_path]), mt_path: np.append(om, sizes[mt_path])}
+    batches = range(0, doc_cnt, args.batch_size)
+
+    tasks = ((ds_path, int(starts[ds_path][d]), int(starts[ds_path][min(d + args.batch_size, doc_cnt)]), od[d:d+args.batch_size] - starts[ds_path][d], len(args.doc_sep), args.dedup == 'whitespace') for d in batches)
+    with mp.get_context('fork').Pool(args.cpus) as p:
+        digests = np.frombuffer(b''.join(p.imap(hash_docs_star, tasks)), dtype='V16')
+    _, first, inverse = np.unique(digests, return_index=True, return_inverse=True)
+    canonical = first[inverse.reshape(-1)] # the kept doc with the same text, by original doc
+    keep = canonical == np.arange(doc_cnt)
+    new_ix = np.cumsum(keep) - 1
+    dups = np.flatnonzero(~keep)
+    dups = dups[np.argsort(new_ix[canonical[dups]], kind='stable')] # grouped by the kept doc, in corpus order within
+
+    # copy the kept docs to new files, and the metadata lines of the others aside
+    dup_meta = {}
+    new_sizes = {}
+    with open(dd_path + '.lines', 'wb') as dup_fout:
+        for path, offset_path in [(ds_path, od_path), (mt_path, om_path)]:
+            with open(path, 'rb') as fin, open(path + '.dedup', 'wb') as fout:
+                fout.write(np.array([0], dtype=np.uint64).tobytes()) # a placeholder header
+                new_offsets = np.zeros(len(first), dtype=np.uint64)
+                for d in batches:
+                    e = min(d + args.batch_size, doc_cnt)
+                    fin.seek(8 + int(starts[path][d]))
+                    block = fin.read(int(starts[path][e] - starts[path][d]))
+                    for i in range(d, e):
+                        doc = block[starts[path][i] - starts[path][d]:starts[path][i + 1] - starts[path][d]]
+                        if keep[i]:
+                            new_offsets[new_ix[i]] = fout.tell() - 8
+                            fout.write(doc)
+                        elif path == mt_path:
+                            dup_meta[i] = (dup_fout.tell(), len(doc))
+                            dup_fout.write(doc)
+                # as in prepare: one \xfa, padding to 8 bytes, and the size in bits in the header
+                new_sizes[path] = fout.tell() - 8
+                size = new_sizes[path] + 1
+                fout.write(b'\xfa' + b'\00' * (-size % 8))
+                fout.seek(0)
+                fout.write(np.array([size * 8], dtype=np.uint64).tobytes())
+            new_offsets.tofile(offset_path + '.dedup')
+
+    dup_starts = np.searchsorted(new_ix[canonical[dups]], np.arange(len(first) + 1)).astype(np.uint64)
+    meta_offsets = np.cumsum([0] + [dup_meta[i][1] for i in dups], dtype=np.uint64)
+    lines = np.memmap(dd_path + '.lines', dtype=np.uint8, mode='r') if len(dups) > 0 else None
+    with open(dd_path + '.dedup', 'wb') as f:
+        f.write(DOC_DUPS_MAGIC + np.array([len(first), len(dups)], dtype=np.uint64).tobytes())
+        f.write(dup_starts.tobytes() + meta_offsets.tobytes())
+        for i in dups:
+            f.write(lines[dup_meta[i][0]:dup_meta[i][0] + dup_meta[i][1]].tobytes())
+    del lines
+    os.remove(dd_path + '.lines')
+    # doc_dups last, as it marks the step as done
+    for path in [ds_path, od_path, mt_path, om_path, dd_path]:
+        os.replace(path + '.dedup', path)
+
+    end_time = time.time()
+    print(f'Step 1.1 (dedup): Done. Collapsed {len(dups)} of {doc_cnt} docs; text {sizes[ds_path] / 1048576:.1f} MiB -> {new_sizes[ds_path] / 1048576:.1f} MiB. Took {end_time-start_time:.2f} seconds', flush=True)
+
+META_STORE_MAGIC = b'IGMSTOR1'
+
+def read_meta_fields(mt_path, start, end, offsets, fields):
+    # the metadata lines in [start, end) of text_meta.sdsl, and the value of each dotted field in each of them
+    # (None if absent, JSON-encoded if not a string)
+    with open(mt_path, 'rb') as f:
+        f.seek(8 + start)
+        block = f.read(end - start)
+    values = [[] for _ in fields]
+    for i in range(len(offsets)):
+        record = json.loads(block[offsets[i]:(offsets[i+1] if i+1 < len(offsets) else len(block))])
+        for j, field in enumerate(fields):
+            value = record
+            for key in field.split('.'):
+                value = value.get(key) if isinstance(value, dict) else None
+            values[j].append(value if value is None or isinstance(value, str) else json.dumps(value))
+    return block, values
+
+def build_meta_store_block(mt_path, start, end, offsets, dict_fields, level):
+    import zstandard as zstd
+    block, values = read_meta_fields(mt_path, start, end, offsets, dict_fields)
+    return zstd.ZstdCompressor(level=level).compress(block), values
+
+def build_meta_store(args):
+    # meta.store holds the same JSON lines as meta.fm9, in independently compressed zstd blocks of about
+    # --meta_block_kb each, so that the metadata of a doc is one block decode away. All integers are little-endian uint64:
+    #   magic (IGMSTOR1), doc_cnt, block_cnt, field_cnt, fields_offset
+    #   block_offsets[block_cnt + 1]: file offset of each block's zstd frame, plus the end of the last one
+    #   doc_locs[doc_cnt]: (block << 32) | offset of the doc's line within the decompressed block
+    #   the zstd frames
+    #   at fields_offset, for each of --meta_dict_fields: name_len, name (padded to 8 bytes), value_cnt,
+    #   value_offsets[value_cnt + 1], values (padded), and one uint32 code per doc (padded; 0xffffffff if absent)
+
+    mt_path = os.path.join(args.save_dir, f'text_meta.sdsl')
+    om_path = os.path.join(args.save_dir, f'meta_offset')
+    ms_path = os.path.join(args.save_dir, f'meta.store')
+    if os.path.exists(ms_path):
+        print('Step 1.6 (meta_store): Skipped. meta.store already exists.', flush=True)
+        return
+
+    print('Step 1.6 (meta_store): Starting ...', flush=True)
+    start_time = time.time()
+
+    with open(mt_path, 'rb') as f:
+        mt_size = int.from_bytes(f.read(8), 'little') // 8 - 1 # exclude the trailing \xfa
+    om = np.fromfile(om_path, dtype=np.uint64).astype(np.int64)
+    doc_cnt = len(om)
+    block_bytes = args.meta_block_kb * 1024
+    # a block holds the docs whose line starts within the same block_bytes range; empty ranges are dropped
+    block_keys, block_of_doc = np.unique(om // block_bytes, return_inverse=True)
+    block_cnt = len(block_keys)
+    block_first_doc = np.searchsorted(block_of_doc, np.arange(block_cnt + 1))
+    block_start = np.append(om, mt_size)[block_first_doc]
+    doc_locs = (block_of_doc.astype(np.uint64) << np.uint64(32)) | (om - block_start[block_of_doc]).astype(np.uint64)
+
+    tasks = ((mt_path, int(block_start[b]), int(block_start[b+1]), om[block_first_doc[b]:block_first_doc[b+1]] - block_start[b], args.meta_dict_fields, args.meta_zstd_level) for b in range(block_cnt))
+    codes = [np.full(doc_cnt, 0xffffffff, dtype=np.uint32) for _ in args.meta_dict_fields]
+    dicts = [{} for _ in args.meta_dict_fields]
+    block_offsets = np.zeros(block_cnt + 1, dtype=np.uint64)
+    header_size = 5 * 8 + (block_cnt + 1) * 8 + doc_cnt * 8
+    with open(ms_path, 'wb') as f, mp.get_context('fork').Pool(args.cpus) as p:
+        f.write(b'\00' * header_size)
+        for b, (frame, values) in enumerate(p.imap(build_meta_store_block_star, tasks, chunksize=16)):
+            block_offsets[b] = f.tell()
+            f.write(frame)
+            for j, field_values in enumerate(values):
+                for i, value in enumerate(field_values):
+                    if value is not None:
+                        codes[j][block_first_doc[b] + i] = dicts[j].setdefault(value, len(dicts[j]))
+        block_offsets[block_cnt] = f.tell()
+        f.write(b'\00' * (-f.tell() % 8))
+        fields_offset = f.tell()
+        for field, d, c in zip(args.meta_dict_fields, dicts, codes):
+            name = field.encode('utf-8')
+            values = [value.encode('utf-8') for value in d]
+            value_offsets = np.cumsum([0] + [len(value) for value in values], dtype=np.uint64)
+            f.write(np.array([len(name)], dtype=np.uint64).tobytes() + name + b'\00' * (-len(name) % 8))
+            f.write(np.array([len(values)], dtype=np.uint64).tobytes() + value_offsets.tobytes())
+            f.write(b''.join(values) + b'\00' * (-int(value_offsets[-1]) % 8))
+            f.write(c.tobytes() + b'\00' * (-c.nbytes % 8))
+        f.seek(0)
+        f.write(META_STORE_MAGIC + np.array([doc_cnt, block_cnt, len(args.meta_dict_fields), fields_offset], dtype=np.uint64).tobytes())
+        f.write(block_offsets.tobytes() + doc_locs.tobytes())
+
+    end_time = time.time()
+    print(f'Step 1.6 (meta_store): Done. {block_cnt} blocks, {os.path.getsize(ms_path) / 1048576:.1f} MiB (uncompressed {mt_size / 1048576:.1f} MiB). Took {end_time-start_time:.2f} seconds', flush=True)
+
+def build_meta_store_block_star(task):
+    return build_meta_store_block(*task)
+
+def read_meta_fields_star(task):
+    return read_meta_fields(*task)[1]
+
+def build_doc_attrs(args):
+    # For each of --doc_attrs, doc_attr.<field> is an sdsl int_vector<> with the code of each doc's value (8, 16 or 32 bits
+    # wide), and doc_attr.<field>.dict holds value_cnt, value_offsets[value_cnt + 1] (uint64) and the concatenated values.
+    # Docs without the field get the value ''.
+
+    mt_path = os.path.join(args.save_dir, f'text_meta.sdsl')
+    om_path = os.path.join(args.save_dir, f'meta_offset')
+    attr_paths = [os.path.join(args.save_dir, f'doc_attr.{field}') for field in args.doc_attrs]
+    if all(os.path.exists(path) for path in attr_paths):
+        print('Step 1.5 (doc_attrs): Skipped. All files already exist.', flush=True)
+        return
+
+    print('Step 1.5 (doc_attrs): Starting ...', flush=True)
+    start_time = time.time()
+
+    with open(mt_path, 'rb') as f:
+        mt_size = int.from_bytes(f.read(8), 'little') // 8 - 1 # exclude the trailing \xfa
+    om = np.fromfile(om_path, dtype=np.uint64).astype(np.int64)
+    doc_cnt = len(om)
+    starts = np.append(om, mt_size)
+    tasks = ((mt_path, int(starts[d]), int(starts[min(d + args.batch_size, doc_cnt)]), om[d:d+args.batch_size] - starts[d], args.doc_attrs) for d in range(0, doc_cnt, args.batch_size))
+    codes = [np.zeros(doc_cnt, dtype=np.uint32) for _ in args.doc_attrs]
+    dicts = [{} for _ in args.doc_attrs]
+    with mp.get_context('fork').Pool(args.cpus) as p:
+        for d, values in zip(range(0, doc_cnt, args.batch_size), p.imap(read_meta_fields_star, tasks)):
+            for j, field_values in enumerate(values):
+                for i, value in enumerate(field_values):
+                    codes[j][d + i] = dicts[j].setdefault(value or '', len(dicts[j]))
+
+    for path, d, c in zip(attr_paths, dicts, codes):
+        width = 8 if len(d) <= 1 << 8 else 16 if len(d) <= 1 << 16 else 32
+        c = c.astype(f'uint{width}')
+        with open(path, 'wb') as f:
+            f.write(np.array([doc_cnt * width], dtype=np.uint64).tobytes() + np.array([width], dtype=np.uint8).tobytes())
+            f.write(c.tobytes() + b'\00' * (-c.nbytes % 8))
+        values = [value.encode('utf-8') for value in d]
+        with open(path + '.dict', 'wb') as f:
+            f.write(np.array([len(values)], dtype=np.uint64).tobytes() + np.cumsum([0] + [len(value) for value in values], dtype=np.uint64).tobytes())
+            f.write(b''.join(values))
+        print(f'\t{os.path.basename(path)}: {len(d)} values', flush=True)
+
+    end_time = time.time()
+    print(f'Step 1.5 (doc_attrs): Done. Took {end_time-start_time:.2f} seconds', flush=True)
+
+TOKEN_DOC_SEP = 1 # the separator before each doc in text_tokens.sdsl; 0 is the end-of-text symbol of the index
+TOKEN_ID_SHIFT = 2 # token id t is stored as t + TOKEN_ID_SHIFT
+
+tokenizer = None
+
+def init_tokenizer(name):
+    global tokenizer
+    from transformers import AutoTokenizer
+    tokenizer = AutoTokenizer.from_pretrained(name)
+
+def tokenize_docs(ds_path, start, end, offsets, doc_sep_len):
+    # the token ids of the docs in [start, end) of text_data.sdsl, each starting at its offset with the doc separator
+    with open(ds_path, 'rb') as f:
+        f.seek(8 + start)
+        block = f.read(end - start)
+    texts = [block[offsets[i]+doc_sep_len:(offsets[i+1] if i+1 < len(offsets) else len(block))].decode('utf-8') for i in range(len(offsets))]
+    return [np.array(ids, dtype=np.uint32) for ids in tokenizer(texts, add_special_tokens=False)['input_ids']]
+
+def tokenize_docs_star(task):
+    return tokenize_docs(*task)
+
+def prepare_tokens(args):
+    # text_int_tok.sdsl (the name under which sdsl looks for the text of the "tok" index) is an sdsl int_vector<>, 32 bits
+    # wide, of all docs in the same order as text_data.sdsl, each as TOKEN_DOC_SEP followed by its token ids shifted by
+    # TOKEN_ID_SHIFT, and a final 0. tokens_offset holds the position of each doc's separator (uint64), like data_offset
+    # does in bytes, so that both indexes agree on doc ids.
+
+    ds_path = os.path.join(args.save_dir, f'text_data.sdsl')
+    od_path = os.path.join(args.save_dir, f'data_offset')
+    ts_path = os.path.join(args.save_dir, f'text_int_tok.sdsl')
+    ot_path = os.path.join(args.save_dir, f'tokens_offset')
+    if all(os.path.exists(path) for path in [ts_path, ot_path]):
+        print('Step 1.7 (prepare_tokens): Skipped. All files already exist.', flush=True)
+        return
+
+    print('Step 1.7 (prepare_tokens): Starting ...', flush=True)
+    start_time = time.time()
+
+    with open(ds_path, 'rb') as f:
+        ds_size = int.from_bytes(f.read(8), 'little') // 8 - 1 # exclude the trailing \xfa
+    od = np.fromfile(od_path, dtype=np.uint64).astype(np.int64)
+    doc_cnt = len(od)
+    starts = np.append(od, ds_size)
+    tasks = ((ds_path, int(starts[d]), int(starts[min(d + args.batch_size, doc_cnt)]), od[d:d+args.batch_size] - starts[d], len(args.doc_sep)) for d in range(0, doc_cnt, args.batch_size))
+    ot = np.zeros(doc_cnt, dtype=np.uint64)
+    tokens_cnt = 0
+    with open(ts_path, 'wb') as f, mp.get_context('fork').Pool(args.cpus, initializer=init_tokenizer, initargs=(args.tokenizer,)) as p:
+        # a placeholder header: size in bits and width
+        f.write(np.array([0], dtype=np.uint64).tobytes() + np.array([32], dtype=np.uint8).tobytes())
+        d = 0
+        for batch in p.imap(tokenize_docs_star, tasks):
+            for ids in batch:
+                assert ids.size == 0 or int(ids.max()) < (1 << 32) - TOKEN_ID_SHIFT
+                ot[d] = tokens_cnt
+                f.write(np.array([TOKEN_DOC_SEP], dtype=np.uint32).tobytes() + (ids + TOKEN_ID_SHIFT).tobytes())
+                tokens_cnt += 1 + ids.size
+                d += 1
+        f.write(b'\00' * 4 + b'\00' * (-(tokens_cnt + 1) * 4 % 8))
+        f.seek(0)
+        f.write(np.array([(tokens_cnt + 1) * 32], dtype=np.uint64).tobytes())
+    ot.tofile(ot_path)
+
+    end_time = time.time()
+    print(f'Step 1.7 (prepare_tokens): Done. {tokens_cnt} tokens ({ds_size / max(tokens_cnt, 1):.2f} bytes per token). Took {end_time-start_time:.2f} seconds', flush=True)
+
 def build_sa_bwt(args, mode):
 
     ds_path = os.path.join(args.save_dir, f'text_{mode}.sdsl')
@@ -327,6 +636,16 @@ def main():
     parser.add_argument('--cpus', type=int, default=mp.cpu_count(), help='Number of CPU cores available to the program.')
     parser.add_argument('--mem', type=int, required=True, help='Amount of memory in GiB available to the program.')
     parser.add_argument('--ulimit', type=int, default=1048576, help='Maximum number of open files allowed.')
+    parser.add_argument('--dedup', type=str, default='none', choices=['none', 'exact', 'whitespace'], help='Index only the first of the docs with the same text (exact), or the same text up to runs of whitespace (whitespace), and keep the metadata of the others in doc_dups, from which the engine reports and counts them.')
+    parser.add_argument('--doc_rmq', default=False, action='store_true', help='Also build the document listing structure (data.doc_rmq) used by count_docs and list_docs. Requires ./doc_rmq.')
+    parser.add_argument('--index_type', type=str, default='huff', choices=['huff', 'rlmn'], help='Wavelet tree of the data FM-index: Huffman-shaped (data.fm9), or run-length encoded (data.rl.fm9), which is much smaller on corpora with many duplicates.')
+    parser.add_argument('--tokenizer', type=str, default=None, help='If set, also build an FM-index over the token ids of the docs (data.tok.fm9), tokenized with this Hugging Face tokenizer. Requires transformers.')
+    parser.add_argument('--kgram_k', type=int, default=0, help='If positive, also build a k-gram SA-interval table (data.kgram) to speed up backward search. Requires ./kgram_table.')
+    parser.add_argument('--doc_attrs', type=str, nargs='*', default=[], help='Dotted metadata fields to also store as dictionary-encoded per-doc columns (doc_attr.<field>), used by count_by_attribute.')
+    parser.add_argument('--meta_store', default=False, action='store_true', help='Store metadata as zstd-compressed blocks (meta.store) instead of an FM-index (meta.fm9 and meta_offset).')
+    parser.add_argument('--meta_block_kb', type=int, default=16, help='Uncompressed size of a meta.store block, in KiB.')
+    parser.add_argument('--meta_zstd_level', type=int, default=9, help='zstd compression level of meta.store blocks.')
+    parser.add_argument('--meta_dict_fields', type=str, nargs='*', default=['path', 'metadata.meta.pile_set_name'], help='Dotted metadata fields that meta.store also keeps as dictionary-encoded columns.')
     args = parser.parse_args()
     if args.temp_dir is None:
         args.temp_dir = args.save_dir
@@ -336,6 +655,9 @@ def main():
 
     assert args.batch_size > 0
     assert args.cpus > 0
+    assert 0 <= args.kgram_k <= 7
+    assert args.index_type == 'huff' or not (args.doc_rmq or args.kgram_k), 'doc_rmq and kgram_table read data.fm9'
+    assert 0 < args.meta_block_kb < 4 * 1024 * 1024
 
     assert os.path.exists(args.data_dir)
     os.makedirs(args.temp_dir, exist_ok=True)
@@ -345,9 +667,25 @@ def main():
     resource.setrlimit(resource.RLIMIT_NOFILE, (args.ulimit, args.ulimit))
 
     prepare(args)
+    if args.dedup != 'none':
+        dedup(args)
+    if args.doc_attrs:
+        build_doc_attrs(args)
+    if args.meta_store:
+        build_meta_store(args)
+        # cpp_indexing only builds meta.fm9 if text_meta.sdsl is there
+        os.remove(os.path.join(args.save_dir, 'text_meta.sdsl'))
+        os.remove(os.path.join(args.save_dir, 'meta_offset'))
+    if args.tokenizer:
+        prepare_tokens(args)
     build_sa_bwt(args, mode='data')
-    build_sa_bwt(args, mode='meta')
-    print(os.popen(f'./cpp_indexing {args.save_dir} 2>/dev/null').read(), flush=True)
+    if not args.meta_store:
+        build_sa_bwt(args, mode='meta')
+    print(os.popen(f'./cpp_indexing {args.save_dir} {args.index_type} 2>/dev/null').read(), flush=True)
+    if args.doc_rmq:
+        print(os.popen(f'./doc_rmq {args.save_dir}').read(), flush=True)
+    if args.kgram_k > 0:
+        print(os.popen(f'./kgram_table {args.save_dir} {args.kgram_k}').read(), flush=True)
 
 if __name__ == '__main__':
     main()
\ No newline at end of file
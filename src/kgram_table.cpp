@@ -0,0 +1,93 @@
+// g++ -std=c++17 -O3 -I../sdsl/include -L../sdsl/lib kgram_table.cpp -o kgram_table -lsdsl -ldivsufsort -ldivsufsort64
+
+// Builds data.kgram next to data.fm9: the SA interval of every string of length 1..k that occurs in the shard.
+// The engine starts backward search from the interval of the last k bytes of a query, and answers queries of
+// length <= k with a single lookup.
+//
+// File layout (all uint64, little-endian):
+//   k, number of entries, then entries of (key, lo, hi) sorted by key, where [lo, hi] is the SA interval (inclusive)
+//   and key holds the string bytes left-aligned in the upper 7 bytes, with the string length in the lowest byte.
+
+#include <sdsl/suffix_arrays.hpp>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+
+using namespace sdsl;
+using namespace std;
+using namespace std::chrono;
+
+typedef csa_wt<wt_huff<rrr_vector<127> >, 32, 64> index_t;
+
+struct KGramEntry {
+    uint64_t key;
+    uint64_t lo;
+    uint64_t hi;
+};
+
+void enumerate(const index_t& index, const uint64_t k, const uint64_t bytes, const uint64_t len, const uint64_t lo, const uint64_t hi, vector<KGramEntry>& entries) {
+    if (len > 0) {
+        entries.push_back(KGramEntry{(bytes << 8) | len, lo, hi});
+    }
+    if (len == k) {
+        return;
+    }
+
+    // the distinct bytes preceding the occurrences of the current string, with their ranks at both interval ends
+    uint64_t sigma = 0;
+    vector<uint8_t> cs(index.sigma);
+    vector<uint64_t> rank_c_i(index.sigma), rank_c_j(index.sigma);
+    index.wavelet_tree.interval_symbols(lo, hi + 1, sigma, cs, rank_c_i, rank_c_j);
+    for (uint64_t i = 0; i < sigma; i++) {
+        uint8_t c = cs[i];
+        uint64_t cc = index.char2comp[c];
+        if (cc == 0) continue; // the sentinel; backward search never matches it
+        uint64_t c_begin = index.C[cc];
+        // prepend c: it becomes the most significant byte and the rest of the string shifts down
+        uint64_t new_bytes = (bytes >> 8) | ((uint64_t)c << 48);
+        enumerate(index, k, new_bytes, len + 1, c_begin + rank_c_i[i], c_begin + rank_c_j[i] - 1, entries);
+    }
+}
+
+int build(const string& index_dir, const uint64_t k) {
+    index_t index;
+    if (!load_from_file(index, index_dir + "/data.fm9")) {
+        cerr << "Failed to load " << index_dir << "/data.fm9" << endl;
+        return 1;
+    }
+
+    auto start_time = steady_clock::now();
+    vector<KGramEntry> entries;
+    enumerate(index, k, 0, 0, 0, index.size() - 1, entries);
+    sort(entries.begin(), entries.end(), [](const KGramEntry& a, const KGramEntry& b) { return a.key < b.key; });
+
+    string path = index_dir + "/data.kgram";
+    ofstream fout(path, ios::binary | ios::trunc);
+    uint64_t n = entries.size();
+    fout.write((const char*)&k, sizeof(k));
+    fout.write((const char*)&n, sizeof(n));
+    fout.write((const char*)entries.data(), n * sizeof(KGramEntry));
+    fout.close();
+
+    auto end_time = steady_clock::now();
+    cout << "Wrote " << n << " entries (" << fixed << setprecision(1) << (2 + 3 * n) * 8 / 1048576.0 << " MiB) for k = " << k
+         << " to " << path << " in " << setprecision(3) << duration<double>(end_time - start_time).count() << " seconds" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " [index directory] [k]" << endl;
+        return 1;
+    }
+
+    uint64_t k = stoull(argv[2]);
+    if (k < 1 || k > 7) {
+        cerr << "k must be between 1 and 7" << endl;
+        return 1;
+    }
+
+    return build(argv[1], k);
+}